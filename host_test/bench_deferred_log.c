@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Per-call cost of logging a DS18B20 readout on the hot path: the ESP_LOGI()
+// it used to be (formatted in place, float and all) next to the DLOG() that
+// replaced it, and what formatting the record costs the deferred_log task
+// later on. The log output is formatted into a buffer and thrown away, so
+// the UART time a real ESP_LOGI() also waits for comes on top; it is
+// estimated from the line length at the console's 115200 baud.
+
+#include "deferred_log.h"
+#include "fake_rtos.h"
+#include "sdkconfig.h"
+#include "types.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ITERATIONS 1000000
+// records written between two flushes, so the ring never overflows
+#define BURST (CONFIG_DEFERRED_LOG_RING_SIZE / 2)
+#define UART_BAUD 115200
+
+static const char *TAG = "sensor_manager_ds18b20";
+
+static char output[256];
+static uint64_t output_bytes = 0;
+static uint64_t output_lines = 0;
+
+// The console, minus the UART
+void esp_log_write(const esp_log_level_t level, const char *tag,
+                   const char *format, ...) {
+  (void)level;
+  (void)tag;
+  va_list args;
+  va_start(args, format);
+  const int length = vsnprintf(output, sizeof(output), format, args);
+  va_end(args);
+  if (length > 0)
+    output_bytes += (uint64_t)length;
+  output_lines++;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Readouts that change from one call to the next, like the real ones
+static uint64_t probe_address(const unsigned i) {
+  return 0x28FF641E8216C300ull | (i % 8);
+}
+
+static float probe_temperature(const unsigned i) {
+  return 18.0f + (float)(i % 200) / 16.0f;
+}
+
+static void report(const char *what, const uint64_t elapsed_ns,
+                   const uint64_t calls) {
+  printf("%-34s %8.1f ns/call\n", what, (double)elapsed_ns / (double)calls);
+}
+
+int main(void) {
+  // before: ESP_LOGI(TAG, "READOUT -> DS18B20 %016llX: %.2f", ...), which
+  // expands to this
+  output_bytes = 0;
+  output_lines = 0;
+  uint64_t start = now_ns();
+  for (unsigned i = 0; i < ITERATIONS; i++) {
+    esp_log_write(ESP_LOG_INFO, TAG,
+                  "I (%" PRIu32 ") %s: READOUT -> DS18B20 %016llX: %.2f\n",
+                  esp_log_timestamp(), TAG,
+                  (unsigned long long)probe_address(i),
+                  (double)probe_temperature(i));
+  }
+  const uint64_t formatted_ns = now_ns() - start;
+  const double formatted_line = (double)output_bytes / (double)output_lines;
+  report("ESP_LOGI(), formatted in place", formatted_ns, ITERATIONS);
+
+  // after: DLOG() on the hot path, the deferred_log task formats the records
+  // when it gets to them
+  output_bytes = 0;
+  output_lines = 0;
+  uint64_t recorded_ns = 0;
+  uint64_t flushed_ns = 0;
+  for (unsigned i = 0; i < ITERATIONS; i += BURST) {
+    start = now_ns();
+    for (unsigned j = i; j < i + BURST; j++) {
+      const int32_t value = readout_value_to_fixed(probe_temperature(j));
+      DLOG(ESP_LOG_INFO, DLOG_DS18B20_READOUT, j % 8,
+           (uint32_t)(probe_address(j) >> 32), (uint32_t)probe_address(j),
+           (uint32_t)value);
+    }
+    const uint64_t recorded = now_ns();
+    fake_rtos_run(deferred_log, NULL,
+                  CONFIG_DEFERRED_LOG_FLUSH_MS * 1000ll + 1);
+    recorded_ns += recorded - start;
+    flushed_ns += now_ns() - recorded;
+  }
+  const uint64_t deferred_calls = ITERATIONS / BURST * BURST;
+  const double deferred_line = (double)output_bytes / (double)output_lines;
+  report("DLOG(), recorded to the ring", recorded_ns, deferred_calls);
+  report("  formatted later by deferred_log", flushed_ns, deferred_calls);
+
+  printf("UART at %d baud: %.0f us per formatted line (%.0f B), "
+         "%.0f us per deferred one (%.0f B), off the hot path\n",
+         UART_BAUD, formatted_line * 10 * 1e6 / UART_BAUD, formatted_line,
+         deferred_line * 10 * 1e6 / UART_BAUD, deferred_line);
+
+  if (output_lines != deferred_calls) {
+    fprintf(stderr, "%" PRIu64 " of %" PRIu64 " records were printed\n",
+            output_lines, deferred_calls);
+    return EXIT_FAILURE;
+  }
+  // the point of the ring: recording has to be cheaper than formatting
+  if (recorded_ns >= formatted_ns) {
+    fprintf(stderr, "DLOG() is no cheaper than formatting in place\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
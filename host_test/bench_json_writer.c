@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Throughput and heap use of json_writer.c for the payloads mqtt_manager.c
+// publishes, next to cJSON's (when available, see CMakeLists.txt) for the
+// same payloads. Heap allocations are counted by wrapping malloc() and
+// friends at link time, and cJSON's through its hooks.
+
+#include "json_messages.h"
+#include "json_writer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SINGLE_ITERATIONS 200000
+#define BATCH_SIZE 16
+#define BATCH_ITERATIONS (SINGLE_ITERATIONS / BATCH_SIZE)
+
+static uint64_t allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Readouts that change from one message to the next, like the real ones
+static void make_sample(JsonSample *sample, const unsigned i) {
+  *sample = (JsonSample){
+      .value = 18.0 + (double)(i % 200) / 16.0,
+      .address = 0x28FF641E8216C300ull | (i % 8),
+      .aggregate = i % 4 == 0,
+      .min = 17.5,
+      .max = 31.0625,
+      .stddev = 0.25 + (double)(i % 7) / 100.0,
+      .samples = 60,
+      .suppressed = i % 3,
+      .timestamp = (double)(1760000000000ull + i * 250ull) / 1000.0,
+      .clock = NULL,
+  };
+}
+
+static void report(const char *writer, const char *payload,
+                   const unsigned messages, const uint64_t bytes,
+                   const uint64_t allocated, const uint64_t elapsed_ns) {
+  const double seconds = (double)elapsed_ns / 1e9;
+  printf("%-12s %-7s %6.0f B/msg %7.2f allocs/msg %8.0f ns/msg %8.1f MB/s\n",
+         writer, payload, (double)bytes / messages,
+         (double)allocated / messages, (double)elapsed_ns / messages,
+         (double)bytes / seconds / 1e6);
+}
+
+static char buffer[8192];
+static JsonSample batch[BATCH_SIZE];
+
+// Returns the number of heap allocations, which should be none
+static uint64_t bench_json_writer(void) {
+  const uint64_t allocated_before = allocations;
+  JsonWriter writer;
+  JsonSample sample;
+  uint64_t bytes = 0;
+  uint64_t allocated = allocations;
+  uint64_t start = now_ns();
+  for (unsigned i = 0; i < SINGLE_ITERATIONS; i++) {
+    make_sample(&sample, i);
+    if (!write_single_message(&writer, buffer, sizeof(buffer), &sample))
+      abort();
+    bytes += writer.length;
+  }
+  report("json_writer", "single", SINGLE_ITERATIONS, bytes,
+         allocations - allocated, now_ns() - start);
+
+  bytes = 0;
+  allocated = allocations;
+  start = now_ns();
+  for (unsigned i = 0; i < BATCH_ITERATIONS; i++) {
+    for (unsigned j = 0; j < BATCH_SIZE; j++) {
+      make_sample(&batch[j], i * BATCH_SIZE + j);
+    }
+    if (!write_batch_message(&writer, buffer, sizeof(buffer), batch,
+                             BATCH_SIZE))
+      abort();
+    bytes += writer.length;
+  }
+  report("json_writer", "batch", BATCH_ITERATIONS, bytes,
+         allocations - allocated, now_ns() - start);
+  return allocations - allocated_before;
+}
+
+#if HOST_TEST_HAVE_CJSON
+#include <string.h>
+
+// cJSON may be a shared library, out of reach of the malloc() wrappers
+static void *counted_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+static void bench_cjson(void) {
+  cJSON_Hooks hooks = {.malloc_fn = counted_malloc, .free_fn = free};
+  cJSON_InitHooks(&hooks);
+
+  JsonSample sample;
+  uint64_t bytes = 0;
+  uint64_t allocated = allocations;
+  uint64_t start = now_ns();
+  for (unsigned i = 0; i < SINGLE_ITERATIONS; i++) {
+    make_sample(&sample, i);
+    char *printed = cjson_single_message(&sample);
+    if (printed == NULL)
+      abort();
+    bytes += strlen(printed);
+    free(printed);
+  }
+  report("cJSON", "single", SINGLE_ITERATIONS, bytes,
+         allocations - allocated, now_ns() - start);
+
+  bytes = 0;
+  allocated = allocations;
+  start = now_ns();
+  for (unsigned i = 0; i < BATCH_ITERATIONS; i++) {
+    for (unsigned j = 0; j < BATCH_SIZE; j++) {
+      make_sample(&batch[j], i * BATCH_SIZE + j);
+    }
+    char *printed = cjson_batch_message(batch, BATCH_SIZE);
+    if (printed == NULL)
+      abort();
+    bytes += strlen(printed);
+    free(printed);
+  }
+  report("cJSON", "batch", BATCH_ITERATIONS, bytes, allocations - allocated,
+         now_ns() - start);
+}
+#endif
+
+int main(void) {
+  const uint64_t allocated = bench_json_writer();
+#if HOST_TEST_HAVE_CJSON
+  bench_cjson();
+#else
+  printf("cJSON not available, not benchmarked\n");
+#endif
+  if (allocated > 0) {
+    fprintf(stderr, "json_writer.c allocated from the heap %llu times\n",
+            (unsigned long long)allocated);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
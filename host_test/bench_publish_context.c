@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Per-message formatting cost of a single readout in mqtt_publish_readout(),
+// before and after publish_context.c: the topic snprintf()ed from
+// get_device_id() and the descriptor's strings escaped into every payload,
+// next to the interned topic and pre-serialized members spliced in. Both
+// are written the way mqtt_manager.c writes them (with MQTT 3.1.1, where
+// every message names the device), and must come out byte for byte the
+// same.
+
+#include "device_id.h"
+#include "json_writer.h"
+#include "publish_context.h"
+#include "readout_aggregate.h"
+#include "sensor_descriptors.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 500000
+
+static const char device_id[] = "EDLAVP-A0B1C2D3E4F5";
+
+const char *get_device_id(void) { return device_id; }
+
+uint64_t sensor_manager_ds18b20_get_address(const uint8_t channel) {
+  return 0x28FF641E8216C300ull | channel;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// What mqtt_manager.c adds to every payload apart from the fixed members
+
+static uint64_t readout_address(const SensorDescriptor *descriptor,
+                                const UniversalSingleReadout *readout) {
+  if (descriptor->channel_address == NULL)
+    return 0;
+  return descriptor->channel_address(readout->channel);
+}
+
+static void add_variable_members(JsonWriter *writer,
+                                 const SensorDescriptor *descriptor,
+                                 const UniversalSingleReadout *readout) {
+  const uint64_t address = readout_address(descriptor, readout);
+  if (address != 0) {
+    char address_string[17];
+    snprintf(address_string, sizeof(address_string), "%016llX",
+             (unsigned long long)address);
+    json_writer_add_string(writer, "address", address_string);
+  }
+  const ReadoutSummary summary = readout_get_summary(readout);
+  if (readout->flags & READOUT_FLAG_AGGREGATE) {
+    json_writer_add_number(writer, "min", readout_min(readout, &summary));
+    json_writer_add_number(writer, "max", readout_max(readout, &summary));
+    json_writer_add_number(writer, "stddev",
+                           readout_spread_from_fixed(summary.stddev));
+    json_writer_add_number(writer, "samples", summary.samples);
+  }
+  if (summary.suppressed > 0)
+    json_writer_add_number(writer, "suppressed", summary.suppressed);
+}
+
+typedef struct {
+  char topic[PUBLISH_TOPIC_LENGTH];
+  const char *interned_topic;
+  char payload[512];
+  size_t length;
+} Message;
+
+// Before: the topic and every constant string formatted per message
+static bool format_per_message(Message *message,
+                               const UniversalSingleReadout *readout) {
+  const SensorDescriptor *descriptor =
+      sensor_descriptor_get(readout->descriptor);
+  JsonWriter writer;
+  json_writer_init(&writer, message->payload, sizeof(message->payload));
+  json_writer_begin_object(&writer, NULL);
+  json_writer_begin_object(&writer, "metadata");
+  json_writer_add_number(&writer, "timestamp",
+                         (double)readout_time_to_unix_ms(readout) / 1000.0);
+  json_writer_add_string(&writer, "device", get_device_id());
+  json_writer_add_string(&writer, "clock", "synced");
+  json_writer_end_object(&writer);
+  json_writer_begin_object(&writer, "readout");
+  json_writer_add_number(&writer, "value",
+                         readout_value_from_fixed(readout->value));
+  json_writer_add_string(&writer, "sensor", descriptor->sensor_type);
+  json_writer_add_string(&writer, "unit", descriptor->unit);
+  add_variable_members(&writer, descriptor, readout);
+  json_writer_end_object(&writer);
+  json_writer_end_object(&writer);
+  if (!json_writer_finish(&writer))
+    return false;
+  message->length = writer.length;
+
+  snprintf(message->topic, sizeof(message->topic), "edlavp/%s/sensor/%s%s",
+           get_device_id(), descriptor->topic, "");
+  message->interned_topic = message->topic;
+  return true;
+}
+
+// After: the constant parts come from the publish context
+static bool format_with_context(Message *message,
+                                const UniversalSingleReadout *readout) {
+  const PublishContext *context = publish_context_get(readout->descriptor);
+  size_t device_length;
+  const char *device = publish_context_device_member(&device_length);
+  JsonWriter writer;
+  json_writer_init(&writer, message->payload, sizeof(message->payload));
+  json_writer_begin_object(&writer, NULL);
+  json_writer_begin_object(&writer, "metadata");
+  json_writer_add_number(&writer, "timestamp",
+                         (double)readout_time_to_unix_ms(readout) / 1000.0);
+  json_writer_add_members(&writer, device, device_length);
+  json_writer_add_string(&writer, "clock", "synced");
+  json_writer_end_object(&writer);
+  json_writer_begin_object(&writer, "readout");
+  json_writer_add_number(&writer, "value",
+                         readout_value_from_fixed(readout->value));
+  json_writer_add_members(&writer, context->fields, context->fields_length);
+  add_variable_members(&writer, context->descriptor, readout);
+  json_writer_end_object(&writer);
+  json_writer_end_object(&writer);
+  if (!json_writer_finish(&writer))
+    return false;
+  message->length = writer.length;
+  message->interned_topic = context->topic;
+  return true;
+}
+
+// Readouts that change from one message to the next, like the real ones,
+// some with a summary record
+static void make_readout(UniversalSingleReadout records[2],
+                         const unsigned i) {
+  records[0] = (UniversalSingleReadout){
+      .timestamp = 24000000 + i / 4,
+      .subsecond = (uint8_t)(i * 64),
+      .value = readout_value_to_fixed(18.0 + (double)(i % 200) / 16.0),
+      .descriptor = i % 4 == 3 ? SENSOR_DESCRIPTOR_MOCK
+                               : SENSOR_DESCRIPTOR_DS18B20,
+      .channel = (uint8_t)(i % 8)};
+  if (i % 5 == 0) {
+    const ReadoutSummary summary = {.samples = 1, .suppressed = 3};
+    readout_set_summary(records, &summary);
+  }
+}
+
+typedef bool (*FormatFunction)(Message *message,
+                               const UniversalSingleReadout *readout);
+
+static uint64_t bench(const char *what, const FormatFunction format) {
+  Message message;
+  UniversalSingleReadout readout[2];
+  uint64_t bytes = 0;
+  const uint64_t start = now_ns();
+  for (unsigned i = 0; i < ITERATIONS; i++) {
+    make_readout(readout, i);
+    if (!format(&message, readout))
+      abort();
+    bytes += message.length + strlen(message.interned_topic);
+  }
+  const uint64_t elapsed = now_ns() - start;
+  printf("%-34s %7.0f ns/msg %6.0f B/msg\n", what,
+         (double)elapsed / ITERATIONS, (double)bytes / ITERATIONS);
+  return elapsed;
+}
+
+int main(void) {
+  publish_context_init();
+
+  // both ways give the same messages
+  unsigned mismatches = 0;
+  for (unsigned i = 0; i < 1000; i++) {
+    UniversalSingleReadout readout[2];
+    make_readout(readout, i);
+    Message before;
+    Message after;
+    if (!format_per_message(&before, readout) ||
+        !format_with_context(&after, readout) ||
+        before.length != after.length ||
+        memcmp(before.payload, after.payload, before.length) != 0 ||
+        strcmp(before.topic, after.interned_topic) != 0)
+      mismatches++;
+  }
+
+  const uint64_t before = bench("snprintf topic, escaped strings",
+                                format_per_message);
+  const uint64_t after = bench("publish context", format_with_context);
+  printf("%.0f%% of the per-message formatting time saved\n",
+         100.0 * (1.0 - (double)after / (double)before));
+
+  if (mismatches > 0) {
+    fprintf(stderr, "%u of 1000 messages differ\n", mismatches);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
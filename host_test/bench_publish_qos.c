@@ -0,0 +1,275 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Messages per second and outbox memory at each QoS level, with the
+// publishing side mqtt_manager.c runs for a readout: publish_window.c for
+// the flow control and outbox_pool.c as the MQTT client's outbox. The client
+// and the broker are simulated on the fake clock of fake_rtos.c: every
+// message takes its bytes' time on the link, and the broker answers a
+// round trip later (PUBACK for QoS 1, PUBREC and then PUBCOMP for QoS 2).
+// The client keeps a QoS 1 or 2 message in the outbox until it is
+// acknowledged, as esp-mqtt does, and sends QoS 0 ones without a copy.
+//
+// The linux target runs the same at its scale against a real broker, see
+// sdkconfig.bench.
+
+#include "fake_rtos.h"
+#include "mqtt_outbox.h"
+#include "outbox_pool.h"
+#include "publish_window.h"
+#include "sdkconfig.h"
+#include "types.h"
+
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESSAGES 20000
+// what a JSON readout of bench_publish_context comes to
+#define PAYLOAD_BYTES 190
+#define TOPIC "edlavp/EDLAVP-A0B1C2D3E4F5/sensor/mock"
+// a broker on the local network, and about what an ESP32 gets through over
+// Wi-Fi
+#define ROUND_TRIP_US 2000
+#define LINK_BITS_PER_S 10000000
+#define ACK_BYTES 4 // PUBACK, PUBREC, PUBREL and PUBCOMP are all 4 bytes
+
+#define MQTT_MSG_TYPE_PUBLISH 3
+
+static uint8_t payload[PAYLOAD_BYTES];
+
+// What the client encodes a PUBLISH as: fixed header, topic, packet
+// identifier (QoS 1 and 2 only) and payload
+static uint8_t packet[OUTBOX_POOL_SLOT_SIZE];
+
+static size_t encode_publish(const int msg_id, const int qos) {
+  const size_t topic_length = strlen(TOPIC);
+  const size_t remaining =
+      2 + topic_length + (qos > 0 ? 2 : 0) + sizeof(payload);
+  size_t length = 0;
+  packet[length++] = (uint8_t)(MQTT_MSG_TYPE_PUBLISH << 4 | qos << 1);
+  size_t value = remaining;
+  do {
+    packet[length++] = (uint8_t)((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+    value >>= 7;
+  } while (value > 0);
+  packet[length++] = (uint8_t)(topic_length >> 8);
+  packet[length++] = (uint8_t)topic_length;
+  memcpy(&packet[length], TOPIC, topic_length);
+  length += topic_length;
+  if (qos > 0) {
+    packet[length++] = (uint8_t)(msg_id >> 8);
+    packet[length++] = (uint8_t)msg_id;
+  }
+  memcpy(&packet[length], payload, sizeof(payload));
+  return length + sizeof(payload);
+}
+
+static void send_bytes(const size_t bytes) {
+  fake_clock_advance((int64_t)bytes * 8 * 1000000 / LINK_BITS_PER_S);
+}
+
+// The broker's answers on their way back, in the order they arrive
+typedef struct {
+  int msg_id;
+  int64_t due;
+  bool pubrec; // a QoS 2 PUBREC, to be answered with a PUBREL
+} Answer;
+
+#define MAX_ANSWERS (2 * CONFIG_MQTT_INFLIGHT_WINDOW + 4)
+static Answer answers[MAX_ANSWERS];
+static size_t answer_count = 0;
+
+static void expect_answer(const int msg_id, const bool pubrec) {
+  if (answer_count == MAX_ANSWERS)
+    abort();
+  answers[answer_count++] = (Answer){
+      .msg_id = msg_id,
+      .due = esp_timer_get_time() + ROUND_TRIP_US,
+      .pubrec = pubrec};
+}
+
+static outbox_handle_t outbox;
+static int next_msg_id = 1;
+
+// The part of the run the measurements are taken over
+typedef struct {
+  uint32_t outbox_peak; // slots
+  uint64_t outbox_peak_bytes;
+} RunStats;
+
+static RunStats run;
+
+static void sample_outbox(void) {
+  OutboxPoolStats pool;
+  outbox_pool_get_stats(&pool);
+  if (pool.in_use > run.outbox_peak)
+    run.outbox_peak = pool.in_use;
+  if (outbox_get_size(outbox) > run.outbox_peak_bytes)
+    run.outbox_peak_bytes = outbox_get_size(outbox);
+}
+
+// Handles the first answer from the broker, once it has arrived
+static void receive_answer(void) {
+  const Answer answer = answers[0];
+  memmove(&answers[0], &answers[1], --answer_count * sizeof(answers[0]));
+  if (answer.due > esp_timer_get_time())
+    fake_clock_advance(answer.due - esp_timer_get_time());
+
+  if (answer.pubrec) {
+    // the PUBLISH stays in the outbox until its PUBCOMP
+    send_bytes(ACK_BYTES);
+    expect_answer(answer.msg_id, false);
+    return;
+  }
+  outbox_delete(outbox, answer.msg_id, MQTT_MSG_TYPE_PUBLISH);
+  publish_window_ack(answer.msg_id);
+  sample_outbox();
+}
+
+static uint32_t notifications = 0;
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  (void)task;
+  notifications++;
+  return pdPASS;
+}
+
+// The publishing task waits for the window to move: the broker's answers
+// come in meanwhile
+uint32_t ulTaskNotifyTake(const BaseType_t clear_on_exit,
+                          const TickType_t ticks_to_wait) {
+  (void)clear_on_exit;
+  const int64_t until = ticks_to_wait == portMAX_DELAY
+                            ? INT64_MAX
+                            : esp_timer_get_time() +
+                                  (int64_t)ticks_to_wait * portTICK_PERIOD_MS *
+                                      1000;
+  while (notifications == 0 && answer_count > 0 && answers[0].due <= until)
+    receive_answer();
+  if (notifications == 0 && until != INT64_MAX)
+    fake_clock_advance(until - esp_timer_get_time());
+  const uint32_t taken = notifications;
+  notifications = 0;
+  return taken;
+}
+
+// esp_mqtt_client_publish() as far as the outbox goes
+static int client_publish(const int qos) {
+  const int msg_id = qos > 0 ? next_msg_id : 0;
+  if (qos > 0)
+    next_msg_id = next_msg_id % 65535 + 1;
+  const size_t length = encode_publish(msg_id, qos);
+  if (qos > 0) {
+    outbox_message_t message = {.data = packet,
+                                .len = (int)length,
+                                .msg_id = msg_id,
+                                .msg_qos = qos,
+                                .msg_type = MQTT_MSG_TYPE_PUBLISH};
+    if (outbox_enqueue(outbox, &message, esp_timer_get_time()) == NULL)
+      return -1;
+    sample_outbox();
+  }
+  send_bytes(length);
+  if (qos > 0)
+    expect_answer(msg_id, qos == 2);
+  return msg_id;
+}
+
+// mqtt_publish_readout() with the JSON already written
+static bool publish_readout(const UniversalSingleReadout *readout,
+                            const int qos) {
+  if (!publish_window_begin(readout, 1))
+    return false;
+  bool ok = true;
+  if (qos == 0) {
+    ok = client_publish(0) >= 0;
+  } else if (publish_window_wait_slot()) {
+    const int msg_id = client_publish(qos);
+    ok = msg_id >= 0;
+    if (ok)
+      publish_window_track(msg_id);
+  } else {
+    ok = false;
+  }
+  publish_window_end(ok);
+  return ok;
+}
+
+static bool bench(const int qos) {
+  run = (RunStats){0};
+  PublishWindowStats before;
+  publish_window_get_stats(&before);
+  const int64_t start = esp_timer_get_time();
+  unsigned failed = 0;
+  for (unsigned i = 0; i < MESSAGES; i++) {
+    const UniversalSingleReadout readout = {
+        .timestamp = 24000000 + i / 4,
+        .value = readout_value_to_fixed(18.0 + (double)(i % 200) / 16.0),
+        .descriptor = SENSOR_DESCRIPTOR_MOCK,
+        .channel = (uint8_t)(i % 8)};
+    if (!publish_readout(&readout, qos))
+      failed++;
+  }
+  publish_window_flush(portMAX_DELAY);
+  const int64_t elapsed = esp_timer_get_time() - start;
+  PublishWindowStats after;
+  publish_window_get_stats(&after);
+
+  printf("QoS %d: %6.0f msgs/s, outbox peak %u of %d slots (%llu bytes "
+         "queued, %u reserved)\n",
+         qos, (double)MESSAGES * 1e6 / (double)elapsed,
+         (unsigned)run.outbox_peak, OUTBOX_POOL_SLOTS,
+         (unsigned long long)run.outbox_peak_bytes,
+         (unsigned)(OUTBOX_POOL_SLOTS * OUTBOX_POOL_SLOT_SIZE));
+
+  bool passed = failed == 0;
+  if (qos == 0) {
+    // the fast path: nothing kept, nothing to wait for
+    passed &= run.outbox_peak == 0 && after.published == before.published;
+  } else {
+    // the window caps the outbox, and every message got its answer
+    passed &= run.outbox_peak <= CONFIG_MQTT_INFLIGHT_WINDOW &&
+              after.acked - before.acked == MESSAGES;
+  }
+  if (!passed)
+    fprintf(stderr, "QoS %d: %u of %d messages failed, or the outbox "
+                    "outgrew the window\n", qos, failed, MESSAGES);
+  return passed;
+}
+
+int main(void) {
+  memset(payload, 'x', sizeof(payload));
+  outbox = outbox_init();
+  publish_window_set_connected(true);
+
+  printf("%d messages of %d bytes, %d us round trip, %d Mbit/s, window of "
+         "%d\n",
+         MESSAGES, PAYLOAD_BYTES, ROUND_TRIP_US, LINK_BITS_PER_S / 1000000,
+         CONFIG_MQTT_INFLIGHT_WINDOW);
+  bool passed = true;
+  for (int qos = 0; qos <= 2; qos++)
+    passed &= bench(qos);
+
+  OutboxPoolStats pool;
+  outbox_pool_get_stats(&pool);
+  if (pool.heap_copies > 0 || pool.in_use > 0) {
+    fprintf(stderr, "%u message(s) copied to the heap, %u slot(s) left in "
+                    "use\n", (unsigned)pool.heap_copies,
+            (unsigned)pool.in_use);
+    passed = false;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,336 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Cost per readout of the readout queue: the single-producer/single-consumer
+// ring of system_state.c next to a locked queue like the xQueue it replaced,
+// which takes its lock, copies one fixed-size item and wakes a blocked
+// receiver on every send and receive. Here the lock is a pthread mutex where
+// the chip has a critical section, and the tasks are threads, so the figures
+// compare the two on the host rather than predict the chip's.
+//
+// Measured on one thread, sending bursts and taking them back (the cost of
+// the calls themselves, the best of a few runs), and with a producer and a
+// consumer thread (the transfer, waking the consumer included). Every fifth
+// readout carries a summary record, as after the deadband stage. Fails if a
+// readout is lost, reordered or split from its summary, or if the ring is no
+// cheaper per readout than the locked queue on one thread.
+
+#include "metrics.h"
+#include "sdkconfig.h"
+#include "system_state.h"
+#include "types.h"
+
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 2000000
+// readouts sent before taking them back on one thread, so neither queue
+// overflows
+#define BURST 8
+// what mqtt_manager.c takes off the queue at once
+#define RECEIVE_RECORDS 8
+// one-thread runs of each queue, taking turns, of which the fastest counts
+#define REPEATS 5
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// The metrics, the event group and the consumer's task notification, for
+// system_state.c
+
+void metrics_count(const MetricCounter counter) {}
+void metrics_add(const MetricCounter counter, const uint32_t amount) {}
+
+EventGroupHandle_t xEventGroupCreate(void) { return NULL; }
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+  return 0;
+}
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+  return 0;
+}
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) { return 0; }
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all,
+                                TickType_t ticks_to_wait) {
+  return 0;
+}
+
+static pthread_mutex_t notify_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notify_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t notifications = 0;
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return &notifications; }
+
+// the consumer only ever waits forever, or not at all
+void vTaskSetTimeOutState(TimeOut_t *timeout) { timeout->entered_us = 0; }
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeout,
+                                TickType_t *ticks_to_wait) {
+  return *ticks_to_wait == 0 ? pdTRUE : pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(const BaseType_t clear_on_exit,
+                          const TickType_t ticks_to_wait) {
+  pthread_mutex_lock(&notify_lock);
+  while (notifications == 0 && ticks_to_wait == portMAX_DELAY)
+    pthread_cond_wait(&notify_cond, &notify_lock);
+  const uint32_t taken = notifications;
+  notifications = 0;
+  pthread_mutex_unlock(&notify_lock);
+  return taken;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  pthread_mutex_lock(&notify_lock);
+  notifications++;
+  pthread_cond_signal(&notify_cond);
+  pthread_mutex_unlock(&notify_lock);
+  return pdPASS;
+}
+
+// The locked queue: CONFIG_READOUT_QUEUE_SIZE items, each with room for a
+// readout and its summary, as an xQueue's items all have the same size
+
+typedef struct {
+  UniversalSingleReadout records[2];
+} QueueItem;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  bool receiver_waiting;
+  QueueItem items[CONFIG_READOUT_QUEUE_SIZE];
+  size_t head;
+  size_t count;
+} locked_queue = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                  .not_empty = PTHREAD_COND_INITIALIZER};
+
+// xQueueSend() without waiting
+static bool locked_queue_send(const UniversalSingleReadout *readout) {
+  pthread_mutex_lock(&locked_queue.lock);
+  if (locked_queue.count == CONFIG_READOUT_QUEUE_SIZE) {
+    pthread_mutex_unlock(&locked_queue.lock);
+    return false;
+  }
+  QueueItem *item = &locked_queue.items[(locked_queue.head +
+                                         locked_queue.count) %
+                                        CONFIG_READOUT_QUEUE_SIZE];
+  memcpy(item->records, readout, sizeof(item->records));
+  locked_queue.count++;
+  if (locked_queue.receiver_waiting)
+    pthread_cond_signal(&locked_queue.not_empty);
+  pthread_mutex_unlock(&locked_queue.lock);
+  return true;
+}
+
+// xQueueReceive() of one item, waiting forever or not at all. Returns the
+// number of records received.
+static size_t locked_queue_receive(UniversalSingleReadout *records,
+                                   const bool wait) {
+  pthread_mutex_lock(&locked_queue.lock);
+  while (locked_queue.count == 0) {
+    if (!wait) {
+      pthread_mutex_unlock(&locked_queue.lock);
+      return 0;
+    }
+    locked_queue.receiver_waiting = true;
+    pthread_cond_wait(&locked_queue.not_empty, &locked_queue.lock);
+    locked_queue.receiver_waiting = false;
+  }
+  const QueueItem *item = &locked_queue.items[locked_queue.head];
+  memcpy(records, item->records, sizeof(item->records));
+  locked_queue.head = (locked_queue.head + 1) % CONFIG_READOUT_QUEUE_SIZE;
+  locked_queue.count--;
+  pthread_mutex_unlock(&locked_queue.lock);
+  return readout_records(records);
+}
+
+// The two queues behind the same calls
+
+typedef struct {
+  const char *name;
+  bool (*send)(const UniversalSingleReadout *readout);
+  size_t (*receive)(UniversalSingleReadout *records, bool wait);
+} Queue;
+
+static bool ring_send(const UniversalSingleReadout *readout) {
+  return readout_queue_send(readout) == pdPASS;
+}
+
+static size_t ring_receive(UniversalSingleReadout *records, const bool wait) {
+  return readout_queue_receive_batch(records, RECEIVE_RECORDS,
+                                     wait ? portMAX_DELAY : 0);
+}
+
+static const Queue queues[] = {
+    {"locked queue, one item per receive", locked_queue_send,
+     locked_queue_receive},
+    {"SPSC ring, batch receive", ring_send, ring_receive},
+};
+
+// Readout @p i, every fifth one with a summary
+static void make_readout(UniversalSingleReadout records[2], const uint32_t i) {
+  records[0] = (UniversalSingleReadout){
+      .timestamp = 24000000 + i / 4,
+      .value = (int32_t)i,
+      .descriptor = 0,
+      .channel = (uint8_t)(i % 8)};
+  if (i % 5 == 0) {
+    const ReadoutSummary summary = {.samples = 1, .suppressed = 3};
+    readout_set_summary(records, &summary);
+  }
+}
+
+// Checks the records received against the readouts sent, returns false on
+// the first that doesn't match
+static bool check_received(const UniversalSingleReadout *records,
+                           const size_t count, uint32_t *expected) {
+  for (size_t i = 0; i < count; i += readout_records(&records[i])) {
+    const bool summary = *expected % 5 == 0;
+    if (readout_is_summary(&records[i]) ||
+        records[i].value != (int32_t)*expected ||
+        (readout_records(&records[i]) == 2) != summary ||
+        i + readout_records(&records[i]) > count ||
+        (summary && !readout_is_summary(&records[i + 1]))) {
+      fprintf(stderr, "readout %u received out of order or split\n",
+              (unsigned)*expected);
+      return false;
+    }
+    (*expected)++;
+  }
+  return true;
+}
+
+static bool single_thread(const Queue *queue, double *ns_per_readout) {
+  UniversalSingleReadout records[RECEIVE_RECORDS];
+  uint32_t expected = 0;
+  const uint64_t start = now_ns();
+  for (uint32_t i = 0; i < ITERATIONS; i += BURST) {
+    for (uint32_t j = i; j < i + BURST; j++) {
+      UniversalSingleReadout readout[2];
+      make_readout(readout, j);
+      if (!queue->send(readout)) {
+        fprintf(stderr, "%s overflowed\n", queue->name);
+        return false;
+      }
+    }
+    size_t count;
+    while ((count = queue->receive(records, false)) > 0) {
+      if (!check_received(records, count, &expected))
+        return false;
+    }
+  }
+  *ns_per_readout = (double)(now_ns() - start) / ITERATIONS;
+  return expected == ITERATIONS;
+}
+
+typedef struct {
+  const Queue *queue;
+  uint64_t full; // sends retried because the queue was full
+} Producer;
+
+// The sensor task, which would drop a readout on a full queue, retries
+// instead so every readout is transferred
+static void *produce(void *parameter) {
+  Producer *producer = parameter;
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    UniversalSingleReadout readout[2];
+    make_readout(readout, i);
+    while (!producer->queue->send(readout)) {
+      producer->full++;
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static bool two_threads(const Queue *queue, double *ns_per_readout,
+                        uint64_t *full) {
+  Producer producer = {.queue = queue};
+  UniversalSingleReadout records[RECEIVE_RECORDS];
+  uint32_t expected = 0;
+  bool ok = true;
+  const uint64_t start = now_ns();
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, produce, &producer) != 0)
+    return false;
+  while (ok && expected < ITERATIONS) {
+    const size_t count = queue->receive(records, true);
+    ok = check_received(records, count, &expected);
+  }
+  pthread_join(thread, NULL);
+  *ns_per_readout = (double)(now_ns() - start) / ITERATIONS;
+  *full = producer.full;
+  return ok;
+}
+
+int main(void) {
+  readout_queue_init();
+  printf("%d readouts, queues of %d records, %d at once on one thread\n",
+         ITERATIONS, CONFIG_READOUT_QUEUE_SIZE, BURST);
+
+  const size_t queue_count = sizeof(queues) / sizeof(queues[0]);
+  double single_ns[sizeof(queues) / sizeof(queues[0])];
+  uint64_t ring_full = 0;
+  bool passed = true;
+  for (size_t i = 0; i < queue_count; i++)
+    single_ns[i] = INFINITY;
+  for (int repeat = 0; repeat < REPEATS; repeat++) {
+    for (size_t i = 0; i < queue_count; i++) {
+      double ns = INFINITY;
+      passed &= single_thread(&queues[i], &ns);
+      if (ns < single_ns[i])
+        single_ns[i] = ns;
+    }
+  }
+
+  for (size_t i = 0; i < queue_count; i++) {
+    double threaded_ns = 0;
+    uint64_t full = 0;
+    passed &= two_threads(&queues[i], &threaded_ns, &full);
+    if (queues[i].send == ring_send)
+      ring_full = full;
+    printf("%-36s %6.1f ns/readout on one thread, %6.1f ns/readout "
+           "between two (%llu sends found it full)\n",
+           queues[i].name, single_ns[i], threaded_ns,
+           (unsigned long long)full);
+  }
+
+  // a send that found the ring full was counted as a dropped readout
+  ReadoutQueueStats stats;
+  readout_queue_get_stats(&stats);
+  if (stats.dropped != ring_full || stats.depth > 0) {
+    fprintf(stderr, "the ring dropped %u readout(s) of %llu sent to it "
+                    "full, %u record(s) left\n",
+            (unsigned)stats.dropped, (unsigned long long)ring_full,
+            (unsigned)stats.depth);
+    passed = false;
+  }
+  // the point of the ring: no lock on either side
+  if (single_ns[1] >= single_ns[0]) {
+    fprintf(stderr, "the ring is no cheaper than the locked queue\n");
+    passed = false;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "fake_onewire.h"
+
+#include "esp_timer.h"
+#include "fake_rtos.h"
+#include "onewire_bus.h"
+#include "onewire_bus_impl_rmt.h"
+#include "onewire_cmd.h"
+#include "onewire_device.h"
+
+#include <stddef.h>
+
+#define CMD_CONVERT_TEMP 0x44
+// what a probe reads before its first conversion
+#define POWER_ON_TEMPERATURE 85.0f
+
+FakeOnewireBus fake_onewire;
+
+// the handles point into fake_onewire, which there is only one of
+static unsigned search_position;
+
+FakeProbe *fake_onewire_add(const uint64_t address, const bool ds18b20,
+                            const float temperature) {
+  FakeProbe *probe = &fake_onewire.devices[fake_onewire.device_count++];
+  *probe = (FakeProbe){.address = address,
+                       .ds18b20 = ds18b20,
+                       .temperature = temperature,
+                       .resolution = DS18B20_RESOLUTION_12B,
+                       .conversion_start_us = -1};
+  return probe;
+}
+
+int64_t fake_ds18b20_conversion_us(const ds18b20_resolution_t resolution) {
+  return 93750 << resolution;
+}
+
+static void bus_time(const unsigned resets, const unsigned bytes) {
+  fake_clock_advance(resets * FAKE_ONEWIRE_RESET_US +
+                     bytes * FAKE_ONEWIRE_BYTE_US);
+}
+
+esp_err_t onewire_new_bus_rmt(const onewire_bus_config_t *bus_config,
+                              const onewire_bus_rmt_config_t *rmt_config,
+                              onewire_bus_handle_t *ret_bus) {
+  (void)bus_config;
+  (void)rmt_config;
+  *ret_bus = (onewire_bus_handle_t)&fake_onewire;
+  return ESP_OK;
+}
+
+esp_err_t onewire_bus_del(onewire_bus_handle_t bus) {
+  (void)bus;
+  return ESP_OK;
+}
+
+esp_err_t onewire_bus_reset(onewire_bus_handle_t bus) {
+  (void)bus;
+  bus_time(1, 0);
+  return fake_onewire.device_count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t bus,
+                                  const uint8_t *tx_data,
+                                  const uint8_t tx_data_size) {
+  (void)bus;
+  bus_time(0, tx_data_size);
+  if (tx_data_size == 2 && tx_data[0] == ONEWIRE_CMD_SKIP_ROM &&
+      tx_data[1] == CMD_CONVERT_TEMP) {
+    fake_onewire.conversions++;
+    fake_onewire.last_conversion_us = esp_timer_get_time();
+    for (unsigned i = 0; i < fake_onewire.device_count; i++) {
+      fake_onewire.devices[i].conversion_start_us =
+          fake_onewire.last_conversion_us;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t onewire_new_device_iter(onewire_bus_handle_t bus,
+                                  onewire_device_iter_handle_t *ret_iter) {
+  (void)bus;
+  search_position = 0;
+  *ret_iter = (onewire_device_iter_handle_t)&fake_onewire;
+  return ESP_OK;
+}
+
+esp_err_t onewire_device_iter_get_next(onewire_device_iter_handle_t iter,
+                                       onewire_device_t *dev) {
+  (void)iter;
+  // a search pass: a reset, the command, and 64 bits of triplets
+  bus_time(1, 1 + 3 * 8);
+  if (search_position >= fake_onewire.device_count)
+    return ESP_ERR_NOT_FOUND;
+  dev->bus = (onewire_bus_handle_t)&fake_onewire;
+  dev->address = fake_onewire.devices[search_position++].address;
+  return ESP_OK;
+}
+
+esp_err_t onewire_del_device_iter(onewire_device_iter_handle_t iter) {
+  (void)iter;
+  return ESP_OK;
+}
+
+static FakeProbe *find_probe(const uint64_t address) {
+  for (unsigned i = 0; i < fake_onewire.device_count; i++) {
+    if (fake_onewire.devices[i].address == address)
+      return &fake_onewire.devices[i];
+  }
+  return NULL;
+}
+
+esp_err_t ds18b20_new_device_from_enumeration(
+    onewire_device_t *device, const ds18b20_config_t *config,
+    ds18b20_device_handle_t *ret_ds18b20) {
+  (void)config;
+  FakeProbe *probe = find_probe(device->address);
+  if (probe == NULL || !probe->ds18b20)
+    return ESP_ERR_NOT_FOUND;
+  *ret_ds18b20 = (ds18b20_device_handle_t)probe;
+  return ESP_OK;
+}
+
+esp_err_t ds18b20_get_device_address(ds18b20_device_handle_t ds18b20,
+                                     onewire_device_address_t *ret_address) {
+  *ret_address = ((FakeProbe *)ds18b20)->address;
+  return ESP_OK;
+}
+
+esp_err_t ds18b20_set_resolution(ds18b20_device_handle_t ds18b20,
+                                 const ds18b20_resolution_t resolution) {
+  // MATCH ROM, WRITE SCRATCHPAD with its three bytes
+  bus_time(1, 1 + 8 + 1 + 3);
+  ((FakeProbe *)ds18b20)->resolution = resolution;
+  return ESP_OK;
+}
+
+esp_err_t ds18b20_get_temperature(ds18b20_device_handle_t ds18b20,
+                                  float *temperature) {
+  FakeProbe *probe = (FakeProbe *)ds18b20;
+  // MATCH ROM, READ SCRATCHPAD and its nine bytes
+  bus_time(1, 1 + 8 + 1 + 9);
+  probe->reads++;
+  if (probe->faulty)
+    return ESP_ERR_INVALID_CRC;
+
+  const int64_t now = esp_timer_get_time();
+  if (probe->conversion_start_us < 0 ||
+      now - probe->conversion_start_us <
+          fake_ds18b20_conversion_us(probe->resolution)) {
+    probe->early_reads++;
+    *temperature = POWER_ON_TEMPERATURE;
+  } else {
+    *temperature = probe->temperature;
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _FAKE_ONEWIRE_H
+#define _FAKE_ONEWIRE_H
+
+// A 1-Wire bus with DS18B20 probes (and other devices) on it, behind the
+// onewire_bus and ds18b20 component APIs. Every operation charges the fake
+// clock (fake_rtos.h) with its time on the bus at standard speed, and a
+// probe read before its conversion is done returns the stale value and is
+// counted, like a real one would.
+
+#include "ds18b20.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FAKE_ONEWIRE_MAX_DEVICES 32
+
+// Time on the bus at standard speed: a reset with its presence pulse, and a
+// byte (eight 65 µs slots)
+#define FAKE_ONEWIRE_RESET_US 960
+#define FAKE_ONEWIRE_BYTE_US 520
+
+typedef struct {
+  uint64_t address;
+  bool ds18b20;   // other families are skipped by the driver
+  bool faulty;    // reads fail with a CRC error
+  float temperature;
+  ds18b20_resolution_t resolution;
+  int64_t conversion_start_us; // the last CONVERT T, -1 if none yet
+  unsigned reads;
+  unsigned early_reads; // reads before the conversion was done
+} FakeProbe;
+
+typedef struct {
+  FakeProbe devices[FAKE_ONEWIRE_MAX_DEVICES];
+  unsigned device_count;
+  unsigned conversions; // CONVERT T commands sent with SKIP ROM
+  int64_t last_conversion_us;
+} FakeOnewireBus;
+
+extern FakeOnewireBus fake_onewire;
+
+// Puts a device on the bus, in search order
+FakeProbe *fake_onewire_add(uint64_t address, bool ds18b20, float temperature);
+
+// The datasheet's worst-case conversion time at a resolution
+int64_t fake_ds18b20_conversion_us(ds18b20_resolution_t resolution);
+
+#endif //_FAKE_ONEWIRE_H
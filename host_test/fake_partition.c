@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "fake_partition.h"
+
+#include "esp_rom_crc.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+FakePartition fake_partition;
+
+void fake_partition_reset(const char *label, const unsigned sectors) {
+  memset(&fake_partition, 0, sizeof(fake_partition));
+  fake_partition.partition = (esp_partition_t){
+      .type = ESP_PARTITION_TYPE_DATA,
+      .subtype = ESP_PARTITION_SUBTYPE_ANY,
+      .size = sectors * FAKE_PARTITION_SECTOR_SIZE,
+      .erase_size = FAKE_PARTITION_SECTOR_SIZE};
+  snprintf(fake_partition.partition.label,
+           sizeof(fake_partition.partition.label), "%s", label);
+  memset(fake_partition.flash, 0xFF, sizeof(fake_partition.flash));
+  fake_partition.torn_write = UINT_MAX;
+}
+
+void fake_partition_tear(const unsigned writes_from_now, const size_t bytes) {
+  fake_partition.torn_write = fake_partition.writes + writes_from_now;
+  fake_partition.torn_bytes = bytes;
+}
+
+const esp_partition_t *esp_partition_find_first(
+    const esp_partition_type_t type, const esp_partition_subtype_t subtype,
+    const char *label) {
+  const esp_partition_t *partition = &fake_partition.partition;
+  if (partition->size == 0 || type != partition->type ||
+      (subtype != ESP_PARTITION_SUBTYPE_ANY &&
+       subtype != partition->subtype) ||
+      (label != NULL && strcmp(label, partition->label) != 0))
+    return NULL;
+  return partition;
+}
+
+static bool in_range(const esp_partition_t *partition, const size_t offset,
+                     const size_t size) {
+  return partition == &fake_partition.partition &&
+         offset <= partition->size && size <= partition->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             const size_t src_offset, void *dst,
+                             const size_t size) {
+  if (!in_range(partition, src_offset, size))
+    return ESP_ERR_INVALID_ARG;
+  memcpy(dst, &fake_partition.flash[src_offset], size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                              const size_t dst_offset, const void *src,
+                              const size_t size) {
+  if (!in_range(partition, dst_offset, size))
+    return ESP_ERR_INVALID_ARG;
+  const bool torn = fake_partition.writes++ == fake_partition.torn_write &&
+                    fake_partition.torn_bytes < size;
+  const size_t length = torn ? fake_partition.torn_bytes : size;
+
+  // programming can only clear bits
+  const uint8_t *bytes = src;
+  for (size_t i = 0; i < length; i++)
+    fake_partition.flash[dst_offset + i] &= bytes[i];
+  return torn ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    const size_t offset, const size_t size) {
+  if (!in_range(partition, offset, size) ||
+      offset % partition->erase_size != 0 || size % partition->erase_size != 0)
+    return ESP_ERR_INVALID_ARG;
+  memset(&fake_partition.flash[offset], 0xFF, size);
+  fake_partition.erases++;
+  return ESP_OK;
+}
+
+// The ROM's CRC-32 (IEEE 802.3), a bit at a time
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf,
+                          const uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
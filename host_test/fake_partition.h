@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _FAKE_PARTITION_H
+#define _FAKE_PARTITION_H
+
+// A data partition in NOR flash, behind the esp_partition API: erasing sets
+// a whole sector to 0xFF and writing can only clear bits, like on the chip.
+// A write can be cut short to leave what a reset in the middle of it would.
+
+#include "esp_partition.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FAKE_PARTITION_SECTOR_SIZE 4096
+#define FAKE_PARTITION_MAX_SECTORS 8
+
+typedef struct {
+  esp_partition_t partition; // what esp_partition_find_first() returns
+  uint8_t flash[FAKE_PARTITION_MAX_SECTORS * FAKE_PARTITION_SECTOR_SIZE];
+  unsigned erases;
+  unsigned writes;
+  // write number torn_write (counted in writes) stores only its first
+  // torn_bytes bytes and fails, as if the chip was reset during it
+  unsigned torn_write;
+  size_t torn_bytes;
+} FakePartition;
+
+extern FakePartition fake_partition;
+
+// Erases the partition and gives it @p sectors sectors, found under @p label
+void fake_partition_reset(const char *label, unsigned sectors);
+
+// Tears the write @p writes_from_now writes ahead (0 for the next one)
+// after @p bytes bytes
+void fake_partition_tear(unsigned writes_from_now, size_t bytes);
+
+#endif //_FAKE_PARTITION_H
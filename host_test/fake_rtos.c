@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "fake_rtos.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <setjmp.h>
+#include <stddef.h>
+
+#define TICK_US ((int64_t)portTICK_PERIOD_MS * 1000)
+
+static int64_t now_us = 0;
+static int64_t stop_at_us = 0;
+static jmp_buf stop;
+
+int64_t fake_rtos_run(const FakeTask task, void *parameter,
+                      const int64_t until_us) {
+  now_us = 0;
+  stop_at_us = until_us;
+  // the task functions never return, they are unwound from their next wait
+  if (setjmp(stop) == 0)
+    task(parameter);
+  return now_us;
+}
+
+void fake_clock_advance(const int64_t us) { now_us += us; }
+
+int64_t esp_timer_get_time(void) { return now_us; }
+
+uint32_t esp_log_timestamp(void) { return (uint32_t)(now_us / 1000); }
+
+void vTaskDelay(const TickType_t ticks) {
+  // wakes on the ticks-th tick interrupt from now, so anywhere from
+  // ticks - 1 to ticks periods later
+  const int64_t wake_us = (now_us / TICK_US + (int64_t)ticks) * TICK_US;
+  if (wake_us >= stop_at_us)
+    longjmp(stop, 1);
+  now_us = wake_us;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  // there is only the one task, any handle will do
+  static int task;
+  return &task;
+}
+
+void vTaskSetTimeOutState(TimeOut_t *timeout) { timeout->entered_us = now_us; }
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeout,
+                                TickType_t *ticks_to_wait) {
+  if (*ticks_to_wait == portMAX_DELAY)
+    return pdFALSE;
+  const int64_t elapsed = (now_us - timeout->entered_us) / TICK_US;
+  if (elapsed >= (int64_t)*ticks_to_wait) {
+    *ticks_to_wait = 0;
+    return pdTRUE;
+  }
+  *ticks_to_wait -= (TickType_t)elapsed;
+  timeout->entered_us += elapsed * TICK_US;
+  return pdFALSE;
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+  (void)task;
+  longjmp(stop, 1);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  (void)task;
+  longjmp(stop, 1);
+}
+
+const char *esp_err_to_name(const esp_err_t code) {
+  switch (code) {
+  case ESP_OK:
+    return "ESP_OK";
+  case ESP_ERR_NO_MEM:
+    return "ESP_ERR_NO_MEM";
+  case ESP_ERR_NOT_FOUND:
+    return "ESP_ERR_NOT_FOUND";
+  case ESP_ERR_INVALID_CRC:
+    return "ESP_ERR_INVALID_CRC";
+  default:
+    return "ESP_FAIL";
+  }
+}
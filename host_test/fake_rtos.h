@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _FAKE_RTOS_H
+#define _FAKE_RTOS_H
+
+// FreeRTOS and esp_timer for a single task on a fake clock. Time only moves
+// when the task waits (vTaskDelay(), which wakes on a tick boundary like the
+// real one) or when a fake peripheral charges it for the time an operation
+// takes, so a run is deterministic and takes no real time. Task
+// notifications are left to the test, which decides what a wait lets happen.
+
+#include <stdint.h>
+
+typedef void (*FakeTask)(void *parameter);
+
+/**
+ * @brief Runs a task function from clock 0 until its first wait that ends
+ * at or past @p until_us, or until it suspends or deletes itself.
+ *
+ * @return The clock when the task was stopped.
+ */
+int64_t fake_rtos_run(FakeTask task, void *parameter, int64_t until_us);
+
+// Moves the clock forward, for time spent on something other than waiting
+void fake_clock_advance(int64_t us);
+
+#endif //_FAKE_RTOS_H
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _HOST_TEST_H
+#define _HOST_TEST_H
+
+// Just enough of a test harness for the host tests: CHECK() reports a failed
+// expectation and carries on, test_exit() turns the outcome into the exit
+// status ctest looks at.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int test_failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      test_failures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+static inline int test_exit(void) {
+  if (test_failures > 0) {
+    fprintf(stderr, "%d check(s) failed\n", test_failures);
+    return EXIT_FAILURE;
+  }
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
+
+#endif //_HOST_TEST_H
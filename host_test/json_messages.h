@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _JSON_MESSAGES_H
+#define _JSON_MESSAGES_H
+
+// The JSON payloads mqtt_manager.c publishes, written once with JsonWriter
+// and, with HOST_TEST_HAVE_CJSON, once the way they were before json_writer.c
+// replaced cJSON: as a cJSON tree printed with cJSON_PrintUnformatted().
+
+#include "json_writer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if HOST_TEST_HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+typedef struct {
+  double value;
+  uint64_t address;
+  bool aggregate;
+  double min;
+  double max;
+  double stddev;
+  unsigned samples;
+  unsigned suppressed;
+  double timestamp; // seconds since the Unix epoch, with milliseconds
+  const char *clock;
+} JsonSample;
+
+// What publish_context.c serializes once per sensor
+#define JSON_SENSOR_TYPE "DS18B20"
+#define JSON_UNIT "°C"
+#define JSON_DEVICE "edlavp-a0b1c2d3e4f5"
+
+static inline void json_sample_address(const JsonSample *sample,
+                                       char *address) {
+  snprintf(address, 17, "%016llX", (unsigned long long)sample->address);
+}
+
+static inline void write_sample(JsonWriter *writer, const char *key,
+                         const JsonSample *sample, const bool with_timestamp) {
+  json_writer_begin_object(writer, key);
+  json_writer_add_number(writer, "value", sample->value);
+  json_writer_add_string(writer, "sensor", JSON_SENSOR_TYPE);
+  json_writer_add_string(writer, "unit", JSON_UNIT);
+  if (sample->address != 0) {
+    char address[17];
+    json_sample_address(sample, address);
+    json_writer_add_string(writer, "address", address);
+  }
+  if (sample->aggregate) {
+    json_writer_add_number(writer, "min", sample->min);
+    json_writer_add_number(writer, "max", sample->max);
+    json_writer_add_number(writer, "stddev", sample->stddev);
+    json_writer_add_number(writer, "samples", sample->samples);
+  }
+  if (sample->suppressed > 0)
+    json_writer_add_number(writer, "suppressed", sample->suppressed);
+  if (with_timestamp) {
+    json_writer_add_number(writer, "timestamp", sample->timestamp);
+    if (sample->clock != NULL)
+      json_writer_add_string(writer, "clock", sample->clock);
+  }
+  json_writer_end_object(writer);
+}
+
+// A single readout, as published by mqtt_publish_readout()
+static inline bool write_single_message(JsonWriter *writer, char *buffer,
+                                 const size_t capacity,
+                                 const JsonSample *sample) {
+  json_writer_init(writer, buffer, capacity);
+  json_writer_begin_object(writer, NULL);
+  json_writer_begin_object(writer, "metadata");
+  json_writer_add_number(writer, "timestamp", sample->timestamp);
+  json_writer_add_string(writer, "device", JSON_DEVICE);
+  json_writer_add_string(writer, "clock",
+                         sample->clock != NULL ? sample->clock : "synced");
+  json_writer_end_object(writer);
+  write_sample(writer, "readout", sample, false);
+  json_writer_end_object(writer);
+  return json_writer_finish(writer);
+}
+
+// A batch of @p count readouts, as published by mqtt_publish_batch()
+static inline bool write_batch_message(JsonWriter *writer, char *buffer,
+                                const size_t capacity,
+                                const JsonSample *samples, const size_t count) {
+  json_writer_init(writer, buffer, capacity);
+  json_writer_begin_object(writer, NULL);
+  json_writer_begin_object(writer, "metadata");
+  json_writer_add_string(writer, "device", JSON_DEVICE);
+  json_writer_end_object(writer);
+  json_writer_begin_array(writer, "readouts");
+  for (size_t i = 0; i < count; i++) {
+    write_sample(writer, NULL, &samples[i], true);
+  }
+  json_writer_end_array(writer);
+  json_writer_end_object(writer);
+  return json_writer_finish(writer);
+}
+
+#if HOST_TEST_HAVE_CJSON
+static inline cJSON *cjson_sample(const JsonSample *sample,
+                                  const bool with_timestamp) {
+  cJSON *object = cJSON_CreateObject();
+  cJSON_AddNumberToObject(object, "value", sample->value);
+  cJSON_AddStringToObject(object, "sensor", JSON_SENSOR_TYPE);
+  cJSON_AddStringToObject(object, "unit", JSON_UNIT);
+  if (sample->address != 0) {
+    char address[17];
+    json_sample_address(sample, address);
+    cJSON_AddStringToObject(object, "address", address);
+  }
+  if (sample->aggregate) {
+    cJSON_AddNumberToObject(object, "min", sample->min);
+    cJSON_AddNumberToObject(object, "max", sample->max);
+    cJSON_AddNumberToObject(object, "stddev", sample->stddev);
+    cJSON_AddNumberToObject(object, "samples", sample->samples);
+  }
+  if (sample->suppressed > 0)
+    cJSON_AddNumberToObject(object, "suppressed", sample->suppressed);
+  if (with_timestamp) {
+    cJSON_AddNumberToObject(object, "timestamp", sample->timestamp);
+    if (sample->clock != NULL)
+      cJSON_AddStringToObject(object, "clock", sample->clock);
+  }
+  return object;
+}
+
+// The same as write_single_message(), the caller frees the result
+static inline char *cjson_single_message(const JsonSample *sample) {
+  cJSON *root = cJSON_CreateObject();
+  cJSON *metadata = cJSON_AddObjectToObject(root, "metadata");
+  cJSON_AddNumberToObject(metadata, "timestamp", sample->timestamp);
+  cJSON_AddStringToObject(metadata, "device", JSON_DEVICE);
+  cJSON_AddStringToObject(metadata, "clock",
+                          sample->clock != NULL ? sample->clock : "synced");
+  cJSON_AddItemToObject(root, "readout", cjson_sample(sample, false));
+  char *printed = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  return printed;
+}
+
+// The same as write_batch_message(), the caller frees the result
+static inline char *cjson_batch_message(const JsonSample *samples,
+                                 const size_t count) {
+  cJSON *root = cJSON_CreateObject();
+  cJSON *metadata = cJSON_AddObjectToObject(root, "metadata");
+  cJSON_AddStringToObject(metadata, "device", JSON_DEVICE);
+  cJSON *readouts = cJSON_AddArrayToObject(root, "readouts");
+  for (size_t i = 0; i < count; i++) {
+    cJSON_AddItemToArray(readouts, cjson_sample(&samples[i], true));
+  }
+  char *printed = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  return printed;
+}
+#endif
+
+#endif //_JSON_MESSAGES_H
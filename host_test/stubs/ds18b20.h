@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Stand-in for the ds18b20 component's ds18b20.h, see fake_onewire.h
+
+#pragma once
+
+#include "onewire_device.h"
+#include "onewire_types.h"
+
+typedef struct ds18b20_device_t *ds18b20_device_handle_t;
+
+typedef struct {
+  int unused;
+} ds18b20_config_t;
+
+typedef enum {
+  DS18B20_RESOLUTION_9B,
+  DS18B20_RESOLUTION_10B,
+  DS18B20_RESOLUTION_11B,
+  DS18B20_RESOLUTION_12B,
+} ds18b20_resolution_t;
+
+esp_err_t
+ds18b20_new_device_from_enumeration(onewire_device_t *device,
+                                    const ds18b20_config_t *config,
+                                    ds18b20_device_handle_t *ret_ds18b20);
+esp_err_t ds18b20_get_device_address(ds18b20_device_handle_t ds18b20,
+                                     onewire_device_address_t *ret_address);
+esp_err_t ds18b20_set_resolution(ds18b20_device_handle_t ds18b20,
+                                 ds18b20_resolution_t resolution);
+esp_err_t ds18b20_get_temperature(ds18b20_device_handle_t ds18b20,
+                                  float *temperature);
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Stand-in for esp-mqtt's mqtt_outbox.h, the interface outbox_pool.c
+// implements
+
+#pragma once
+
+#include "esp_err.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct outbox_item;
+
+typedef long long outbox_tick_t;
+typedef struct outbox_item *outbox_item_handle_t;
+typedef struct outbox_message *outbox_message_handle_t;
+typedef struct outbox_t *outbox_handle_t;
+
+typedef struct outbox_message {
+  uint8_t *data;
+  int len;
+  int msg_id;
+  int msg_qos;
+  int msg_type;
+  uint8_t *remaining_data;
+  int remaining_len;
+} outbox_message_t;
+
+typedef enum pending_state {
+  QUEUED,
+  TRANSMITTED,
+  ACKNOWLEDGED,
+  CONFIRMED
+} pending_state_t;
+
+outbox_handle_t outbox_init(void);
+outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox,
+                                    outbox_message_handle_t message,
+                                    outbox_tick_t tick);
+outbox_item_handle_t outbox_dequeue(outbox_handle_t outbox,
+                                    pending_state_t pending,
+                                    outbox_tick_t *tick);
+outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id);
+esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type);
+uint64_t outbox_get_size(outbox_handle_t outbox);
+void outbox_destroy(outbox_handle_t outbox);
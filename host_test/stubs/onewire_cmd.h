@@ -7,9 +7,9 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
-#ifndef _TIMER_MANAGER_H
-#define _TIMER_MANAGER_H
 
-void setup_readout_timer(void);
+// Stand-in for the onewire_bus component's onewire_cmd.h
 
-#endif //_TIMER_MANAGER_H
+#pragma once
+
+#define ONEWIRE_CMD_SKIP_ROM 0xCC
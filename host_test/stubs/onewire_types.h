@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Stand-in for the onewire_bus component's types, see fake_onewire.h
+
+#pragma once
+
+#include "esp_err.h"
+
+#include <stdint.h>
+
+typedef struct onewire_bus_t *onewire_bus_handle_t;
+typedef struct onewire_device_iter_t *onewire_device_iter_handle_t;
+typedef uint64_t onewire_device_address_t;
+
+typedef struct {
+  onewire_bus_handle_t bus;
+  onewire_device_address_t address;
+} onewire_device_t;
+
+typedef struct {
+  int bus_gpio_num;
+  struct {
+    uint32_t en_pull_up : 1;
+  } flags;
+} onewire_bus_config_t;
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Configuration the host tests build main/ with, in place of the sdkconfig.h
+// generated by ESP-IDF
+
+#pragma once
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS 255
+#define CONFIG_HARDWARE_DS18B20_GPIO_PIN 4
+#define CONFIG_HARDWARE_DS18B20_MAX_DEVICES 16
+#define CONFIG_HARDWARE_DS18B20_DEFAULT_RESOLUTION 12
+#define CONFIG_HARDWARE_DS18B20_RESOLUTION_OVERRIDES ""
+#define CONFIG_SOFTWARE_DS18B20_READOUT_INTERVAL 5
+#define CONFIG_READOUT_AGGREGATION_OFF 1
+#define CONFIG_SOFTWARE_DS18B20_MQTT_QOS 1
+#define CONFIG_DEFERRED_LOG 1
+#define CONFIG_DEFERRED_LOG_RING_SIZE 64
+#define CONFIG_DEFERRED_LOG_FLUSH_MS 200
+#define CONFIG_MQTT_PAYLOAD_BUFFER_SIZE 2048
+#define CONFIG_MQTT_INFLIGHT_WINDOW 8
+#define CONFIG_MQTT_INFLIGHT_TIMEOUT 60
+#define CONFIG_READOUT_LOG_ENABLE 1
+#define CONFIG_READOUT_LOG_PARTITION_LABEL "readout_log"
+#define CONFIG_READOUT_DEADBAND 1
+#define CONFIG_READOUT_PIPELINE_STREAMS 1
+#define CONFIG_READOUT_PIPELINE_MAX_STREAMS 4
+#define CONFIG_SOFTWARE_DS18B20_DEADBAND 100
+#define CONFIG_SOFTWARE_DS18B20_HEARTBEAT 600
+#define CONFIG_READOUT_QUEUE_SIZE 20
+#define CONFIG_READOUT_QUEUE_OVERFLOW_DROP_NEWEST 1
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// deferred_log.c with the ring on: DLOG() records come out of the
+// deferred_log task (run on the fake clock of fake_rtos.c) formatted as the
+// ESP_LOG*() calls they replaced, with the time they were recorded at, in
+// order across the wrap of the ring. A full ring drops and counts the
+// newest records, levels above LOG_LOCAL_LEVEL never reach the ring, and the
+// record layout a host-side decoder depends on stays put.
+
+#include "host_test.h"
+
+#include "deferred_log.h"
+#include "fake_rtos.h"
+#include "sdkconfig.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RING_SIZE CONFIG_DEFERRED_LOG_RING_SIZE
+#define MAX_LINES (2 * RING_SIZE)
+
+typedef struct {
+  esp_log_level_t level;
+  char tag[32];
+  char text[192];
+} LogLine;
+
+static LogLine lines[MAX_LINES];
+static unsigned line_count = 0;
+
+void esp_log_write(const esp_log_level_t level, const char *tag,
+                   const char *format, ...) {
+  if (line_count >= MAX_LINES) {
+    line_count++;
+    return;
+  }
+  LogLine *line = &lines[line_count++];
+  line->level = level;
+  snprintf(line->tag, sizeof(line->tag), "%s", tag);
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line->text, sizeof(line->text), format, args);
+  va_end(args);
+}
+
+// Lets the deferred_log task run through one flush of the ring
+static void flush(void) {
+  line_count = 0;
+  fake_rtos_run(deferred_log, NULL,
+                CONFIG_DEFERRED_LOG_FLUSH_MS * 1000ll + 1);
+}
+
+static unsigned evaluated = 0;
+
+static uint32_t count_evaluation(void) {
+  evaluated++;
+  return 1;
+}
+
+static void test_layout(void) {
+  // what a decoder reading a ring dumped from RAM relies on
+  CHECK(sizeof(DeferredLogRecord) == 24);
+  CHECK(offsetof(DeferredLogRecord, time_ms) == 0);
+  CHECK(offsetof(DeferredLogRecord, format) == 4);
+  CHECK(offsetof(DeferredLogRecord, level) == 5);
+  CHECK(offsetof(DeferredLogRecord, arg_count) == 6);
+  CHECK(offsetof(DeferredLogRecord, args) == 8);
+}
+
+static void test_records(void) {
+  fake_clock_advance(1234567);
+  const int32_t value = -215000;
+  DLOG(ESP_LOG_INFO, DLOG_DS18B20_READOUT, 3, 0x28FF641Eu, 0x8216C3A1u,
+       (uint32_t)value);
+  fake_clock_advance(1000);
+  DLOG(ESP_LOG_WARN, DLOG_QUEUE_FULL, 2, 7);
+  DLOG(ESP_LOG_INFO, DLOG_MQTT_EVENT, (uint32_t)-1);
+  DLOG(ESP_LOG_ERROR, DLOG_MQTT_PUBLISHED, 65535);
+  // nothing is formatted until the task gets to it
+  CHECK(line_count == 0);
+
+  flush();
+  CHECK(line_count == 4);
+  CHECK(lines[0].level == ESP_LOG_INFO);
+  CHECK(strcmp(lines[0].tag, "sensor_manager_ds18b20") == 0);
+  CHECK(strcmp(lines[0].text,
+               "I (1234) sensor_manager_ds18b20: READOUT -> DS18B20 #3 "
+               "28FF641E8216C3A1: -215000 (1/10000 C)\n") == 0);
+  CHECK(lines[1].level == ESP_LOG_WARN);
+  CHECK(strcmp(lines[1].text,
+               "W (1235) readout_pipeline: Queue full, dropping readout of "
+               "sensor 2 channel 7!\n") == 0);
+  CHECK(strcmp(lines[2].text, "I (1235) mqtt_manager: Event dispatched from "
+                              "event loop, event_id=-1\n") == 0);
+  CHECK(lines[3].level == ESP_LOG_ERROR);
+  CHECK(strcmp(lines[3].text, "E (1235) mqtt_manager: Published a message "
+                              "to an MQTT topic: msg_id=65535\n") == 0);
+
+  // an empty ring prints nothing
+  flush();
+  CHECK(line_count == 0);
+}
+
+// Every format, with the widest arguments, fits the message buffer
+static void test_widest(void) {
+  for (int format = 0; format < DLOG_FORMAT_COUNT; format++) {
+    const uint32_t args[DEFERRED_LOG_MAX_ARGS] = {UINT32_MAX, UINT32_MAX,
+                                                  UINT32_MAX, UINT32_MAX};
+    deferred_log_write(ESP_LOG_INFO, (DeferredLogFormat)format, args,
+                       DEFERRED_LOG_MAX_ARGS);
+  }
+  flush();
+  CHECK(line_count == DLOG_FORMAT_COUNT);
+  for (unsigned i = 0; i < line_count && i < MAX_LINES; i++) {
+    const char *message = strstr(lines[i].text, ": ");
+    CHECK(message != NULL);
+    // print_record() formats into 128 bytes, a longer message is cut short
+    // and loses its newline
+    if (message != NULL)
+      CHECK(strlen(message + 2) < 127);
+    CHECK(lines[i].text[strlen(lines[i].text) - 1] == '\n');
+  }
+}
+
+// Records come out in the order they went in, across the end of the ring
+static void test_wrap(void) {
+  uint32_t next = 0;
+  uint32_t expected = 0;
+  for (int round = 0; round < 5; round++) {
+    const unsigned count = round % 2 == 0 ? RING_SIZE * 2 / 3 : RING_SIZE;
+    for (unsigned i = 0; i < count; i++)
+      DLOG(ESP_LOG_INFO, DLOG_MQTT_PUBLISHED, next++);
+    flush();
+    CHECK(line_count == count);
+    for (unsigned i = 0; i < line_count && i < MAX_LINES; i++) {
+      char text[96];
+      snprintf(text, sizeof(text),
+               "to an MQTT topic: msg_id=%d\n", (int)expected++);
+      CHECK(strstr(lines[i].text, text) != NULL);
+    }
+  }
+}
+
+// A full ring keeps the oldest records, and the next flush says how many
+// were dropped, once
+static void test_full(void) {
+  for (uint32_t i = 0; i < RING_SIZE + 10; i++)
+    DLOG(ESP_LOG_INFO, DLOG_MQTT_EVENT, i);
+  flush();
+  CHECK(line_count == RING_SIZE + 1);
+  CHECK(lines[0].level == ESP_LOG_WARN);
+  CHECK(strstr(lines[0].text,
+               "deferred_log: 10 record(s) dropped, the ring was full\n") !=
+        NULL);
+  CHECK(strstr(lines[1].text, "event_id=0\n") != NULL);
+  char last[32];
+  snprintf(last, sizeof(last), "event_id=%d\n", RING_SIZE - 1);
+  CHECK(strstr(lines[RING_SIZE].text, last) != NULL);
+
+  DLOG(ESP_LOG_INFO, DLOG_MQTT_EVENT, 100);
+  flush();
+  CHECK(line_count == 1);
+  CHECK(strstr(lines[0].text, "event_id=100\n") != NULL);
+}
+
+// Levels above LOG_LOCAL_LEVEL are compiled out, arguments and all
+static void test_gating(void) {
+  DLOG(ESP_LOG_DEBUG, DLOG_MQTT_EVENT, count_evaluation());
+  DLOG(ESP_LOG_VERBOSE, DLOG_MQTT_EVENT, count_evaluation());
+  CHECK(evaluated == 0);
+  DLOG(ESP_LOG_INFO, DLOG_MQTT_EVENT, count_evaluation());
+  CHECK(evaluated == 1);
+  flush();
+  CHECK(line_count == 1);
+}
+
+int main(void) {
+  test_layout();
+  test_records();
+  test_widest();
+  test_wrap();
+  test_full();
+  test_gating();
+  return test_exit();
+}
@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// json_writer.c against the output of cJSON_PrintUnformatted(), which it has
+// to match byte for byte. The expected strings here follow cJSON's rules and
+// always run. With cJSON available (see CMakeLists.txt) the same payloads,
+// and a few thousand numbers and strings, are also printed by cJSON itself
+// and compared.
+
+#include "host_test.h"
+#include "json_messages.h"
+#include "json_writer.h"
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Writes @p value as the root of a document and compares it to @p expected
+static void check_number(const double value, const char *expected) {
+  char buffer[64];
+  JsonWriter writer;
+  json_writer_init(&writer, buffer, sizeof(buffer));
+  json_writer_add_number(&writer, NULL, value);
+  CHECK(json_writer_finish(&writer));
+  if (strcmp(buffer, expected) != 0) {
+    fprintf(stderr, "%.17g: got %s, expected %s\n", value, buffer, expected);
+    test_failures++;
+  }
+}
+
+static void check_string(const char *value, const char *expected) {
+  char buffer[256];
+  JsonWriter writer;
+  json_writer_init(&writer, buffer, sizeof(buffer));
+  json_writer_add_string(&writer, NULL, value);
+  CHECK(json_writer_finish(&writer));
+  if (strcmp(buffer, expected) != 0) {
+    fprintf(stderr, "got %s, expected %s\n", buffer, expected);
+    test_failures++;
+  }
+}
+
+static void test_numbers(void) {
+  check_number(0, "0");
+  check_number(-0.0, "0");
+  check_number(42, "42");
+  check_number(-7, "-7");
+  check_number(INT_MAX, "2147483647");
+  check_number(INT_MIN, "-2147483648");
+  // past int, printed with %g
+  check_number(2147483648.0, "2147483648");
+  check_number(1e15, "1e+15");
+  check_number(0.1, "0.1");
+  check_number(21.5625, "21.5625");
+  check_number(-55.0625, "-55.0625");
+  check_number(1760000000.123, "1760000000.123");
+  // 15 digits don't survive a round trip, 17 are used
+  check_number(1.0 / 3.0, "0.33333333333333331");
+  check_number(1e300, "1e+300");
+  check_number(DBL_MIN, "2.2250738585072014e-308");
+  check_number(NAN, "null");
+  check_number(INFINITY, "null");
+  check_number(-INFINITY, "null");
+}
+
+static void test_strings(void) {
+  check_string("", "\"\"");
+  check_string("plain", "\"plain\"");
+  check_string("a\"b\\c", "\"a\\\"b\\\\c\"");
+  check_string("\b\f\n\r\t", "\"\\b\\f\\n\\r\\t\"");
+  check_string("\x01\x1f", "\"\\u0001\\u001f\"");
+  // '/', DEL and UTF-8 pass through
+  check_string("a/b\x7f", "\"a/b\x7f\"");
+  check_string("°C", "\"°C\"");
+}
+
+static void test_structure(void) {
+  char buffer[128];
+  JsonWriter writer;
+
+  json_writer_init(&writer, buffer, sizeof(buffer));
+  json_writer_begin_object(&writer, NULL);
+  json_writer_begin_array(&writer, "a");
+  json_writer_add_number(&writer, NULL, 1);
+  json_writer_begin_object(&writer, NULL);
+  json_writer_begin_array(&writer, "b");
+  json_writer_end_array(&writer);
+  json_writer_end_object(&writer);
+  json_writer_begin_array(&writer, NULL);
+  json_writer_end_array(&writer);
+  json_writer_end_array(&writer);
+  json_writer_begin_object(&writer, "c");
+  json_writer_end_object(&writer);
+  json_writer_add_string(&writer, "d\n", "e");
+  json_writer_end_object(&writer);
+  CHECK(json_writer_finish(&writer));
+  CHECK(strcmp(buffer, "{\"a\":[1,{\"b\":[]},[]],\"c\":{},\"d\\n\":\"e\"}") ==
+        0);
+
+  // members serialized ahead of time, by a writer without an object
+  char members[64];
+  JsonWriter member_writer;
+  json_writer_init(&member_writer, members, sizeof(members));
+  json_writer_add_string(&member_writer, "device", "d");
+  json_writer_add_number(&member_writer, "n", 2);
+  CHECK(json_writer_finish(&member_writer));
+  CHECK(strcmp(members, "\"device\":\"d\",\"n\":2") == 0);
+
+  json_writer_init(&writer, buffer, sizeof(buffer));
+  json_writer_begin_object(&writer, NULL);
+  json_writer_add_members(&writer, members, member_writer.length);
+  json_writer_add_members(&writer, "", 0);
+  json_writer_add_number(&writer, "x", 1);
+  json_writer_add_members(&writer, members, member_writer.length);
+  json_writer_end_object(&writer);
+  CHECK(json_writer_finish(&writer));
+  CHECK(strcmp(buffer,
+               "{\"device\":\"d\",\"n\":2,\"x\":1,\"device\":\"d\",\"n\":2}") ==
+        0);
+}
+
+static void test_overflow(void) {
+  static const char expected[] = "{\"key\":\"value\"}";
+  char buffer[sizeof(expected)];
+  JsonWriter writer;
+
+  // an exact fit, terminator included
+  json_writer_init(&writer, buffer, sizeof(buffer));
+  json_writer_begin_object(&writer, NULL);
+  json_writer_add_string(&writer, "key", "value");
+  CHECK(json_writer_remaining(&writer) == 1);
+  json_writer_end_object(&writer);
+  CHECK(json_writer_remaining(&writer) == 0);
+  CHECK(json_writer_finish(&writer));
+  CHECK(strcmp(buffer, expected) == 0);
+
+  // one byte short
+  json_writer_init(&writer, buffer, sizeof(buffer) - 1);
+  json_writer_begin_object(&writer, NULL);
+  json_writer_add_string(&writer, "key", "value");
+  json_writer_end_object(&writer);
+  CHECK(writer.overflow);
+  CHECK(!json_writer_finish(&writer));
+
+  // a checkpoint to roll back to
+  json_writer_init(&writer, buffer, sizeof(buffer));
+  json_writer_begin_object(&writer, NULL);
+  const JsonWriter checkpoint = writer;
+  json_writer_add_string(&writer, "far too long a key", "and a value");
+  CHECK(writer.overflow);
+  writer = checkpoint;
+  json_writer_add_string(&writer, "key", "value");
+  json_writer_end_object(&writer);
+  CHECK(json_writer_finish(&writer));
+  CHECK(strcmp(buffer, expected) == 0);
+
+  json_writer_init(&writer, buffer, 0);
+  CHECK(!json_writer_finish(&writer));
+}
+
+static const JsonSample samples[] = {
+    {.value = 21.5625, .address = 0x28FF641E8216C3A1ull,
+     .timestamp = 1760000000.123},
+    {.value = 22.25, .address = 0x28FF641E8216C3A1ull, .aggregate = true,
+     .min = 21, .max = 23.5, .stddev = 0.62548, .samples = 60,
+     .suppressed = 3, .timestamp = 1760000060.5, .clock = "syncing"},
+    {.value = -0.5, .timestamp = 12.25, .clock = "unsynced"},
+};
+
+#define SAMPLE_COUNT (sizeof(samples) / sizeof(samples[0]))
+
+static void test_messages(void) {
+  char buffer[1024];
+  JsonWriter writer;
+
+  CHECK(write_single_message(&writer, buffer, sizeof(buffer), &samples[0]));
+  CHECK(strcmp(buffer,
+               "{\"metadata\":{\"timestamp\":1760000000.123,"
+               "\"device\":\"" JSON_DEVICE "\",\"clock\":\"synced\"},"
+               "\"readout\":{\"value\":21.5625,\"sensor\":\"DS18B20\","
+               "\"unit\":\"°C\",\"address\":\"28FF641E8216C3A1\"}}") == 0);
+
+  CHECK(write_batch_message(&writer, buffer, sizeof(buffer), samples,
+                            SAMPLE_COUNT));
+  CHECK(strcmp(buffer,
+               "{\"metadata\":{\"device\":\"" JSON_DEVICE "\"},\"readouts\":["
+               "{\"value\":21.5625,\"sensor\":\"DS18B20\",\"unit\":\"°C\","
+               "\"address\":\"28FF641E8216C3A1\",\"timestamp\":1760000000.123},"
+               "{\"value\":22.25,\"sensor\":\"DS18B20\",\"unit\":\"°C\","
+               "\"address\":\"28FF641E8216C3A1\",\"min\":21,\"max\":23.5,"
+               "\"stddev\":0.62548,\"samples\":60,\"suppressed\":3,"
+               "\"timestamp\":1760000060.5,\"clock\":\"syncing\"},"
+               "{\"value\":-0.5,\"sensor\":\"DS18B20\",\"unit\":\"°C\","
+               "\"timestamp\":12.25,\"clock\":\"unsynced\"}]}") == 0);
+}
+
+#if HOST_TEST_HAVE_CJSON
+static void compare(const char *what, const char *written, char *printed) {
+  if (printed == NULL || strcmp(written, printed) != 0) {
+    fprintf(stderr, "%s differs from cJSON:\n  json_writer: %s\n", what,
+            written);
+    fprintf(stderr, "  cJSON:       %s\n", printed != NULL ? printed : "");
+    test_failures++;
+  }
+  free(printed);
+}
+
+// xorshift64, so every run compares the same values
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static double random_double(uint64_t *state) {
+  const uint64_t bits = next_random(state);
+  switch (bits % 4) {
+  case 0: // any bit pattern, including NaNs and infinities
+  {
+    double value;
+    const uint64_t raw = next_random(state);
+    memcpy(&value, &raw, sizeof(value));
+    return value;
+  }
+  case 1: // a sensor value in 1/16 °C steps
+    return (double)((int64_t)(bits >> 8) % 4000 - 1000) / 16.0;
+  case 2: // a timestamp with milliseconds
+    return (double)(1700000000000 + (int64_t)(bits >> 24) % 100000000000) /
+           1000.0;
+  default: // an integer around the int limits
+    return (double)((int64_t)(bits >> 8) % 8589934592 - 4294967296);
+  }
+}
+
+static void test_against_cjson(void) {
+  char buffer[4096];
+  JsonWriter writer;
+
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for (int i = 0; i < 5000; i++) {
+    const double value = random_double(&state);
+    json_writer_init(&writer, buffer, sizeof(buffer));
+    json_writer_add_number(&writer, NULL, value);
+    json_writer_finish(&writer);
+    cJSON *number = cJSON_CreateNumber(value);
+    compare("number", buffer, cJSON_PrintUnformatted(number));
+    cJSON_Delete(number);
+  }
+
+  // every byte but the terminator
+  char all_bytes[256];
+  for (int i = 1; i < 256; i++) {
+    all_bytes[i - 1] = (char)i;
+  }
+  all_bytes[255] = '\0';
+  json_writer_init(&writer, buffer, sizeof(buffer));
+  json_writer_add_string(&writer, NULL, all_bytes);
+  json_writer_finish(&writer);
+  cJSON *string = cJSON_CreateString(all_bytes);
+  compare("string", buffer, cJSON_PrintUnformatted(string));
+  cJSON_Delete(string);
+
+  for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+    write_single_message(&writer, buffer, sizeof(buffer), &samples[i]);
+    compare("single readout", buffer, cjson_single_message(&samples[i]));
+  }
+  write_batch_message(&writer, buffer, sizeof(buffer), samples, SAMPLE_COUNT);
+  compare("batch", buffer, cjson_batch_message(samples, SAMPLE_COUNT));
+
+  // and batches of random readouts
+  JsonSample random_samples[16];
+  for (int round = 0; round < 100; round++) {
+    for (size_t i = 0; i < 16; i++) {
+      const uint64_t bits = next_random(&state);
+      random_samples[i] = (JsonSample){
+          .value = random_double(&state),
+          .address = bits & 1 ? next_random(&state) : 0,
+          .aggregate = bits & 2,
+          .min = random_double(&state),
+          .max = random_double(&state),
+          .stddev = random_double(&state),
+          .samples = (unsigned)(bits >> 16) & 0xFFFF,
+          .suppressed = bits & 4 ? (unsigned)(bits >> 32) & 0xFFFF : 0,
+          .timestamp = random_double(&state),
+          .clock = bits & 8 ? "stale" : NULL,
+      };
+    }
+    CHECK(write_batch_message(&writer, buffer, sizeof(buffer), random_samples,
+                              16));
+    compare("random batch", buffer, cjson_batch_message(random_samples, 16));
+  }
+}
+#endif
+
+int main(void) {
+  test_numbers();
+  test_strings();
+  test_structure();
+  test_overflow();
+  test_messages();
+#if HOST_TEST_HAVE_CJSON
+  test_against_cjson();
+#else
+  printf("cJSON not available, not compared against it\n");
+#endif
+  return test_exit();
+}
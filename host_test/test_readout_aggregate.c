@@ -0,0 +1,412 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// readout_aggregate.c against a two-pass reference: the accumulator over
+// single samples or over aggregates, and aggregates merged in any order,
+// give the mean, population standard deviation, extremes and counts of all
+// the samples, to within the fixed-point precision of the record and the
+// drift of rounding it again on every merge. Also
+// checks the bookkeeping of a merge (time base, flags, saturated counts) and
+// that the streaming variance stays accurate far from zero, and that a single
+// sample takes up one record, with a summary record only where there is one.
+
+#include "host_test.h"
+#include "readout_aggregate.h"
+#include "types.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SAMPLE_COUNT 6000
+
+// half a unit of the fixed-point value and spread fields
+#define VALUE_STEP (0.5 / READOUT_VALUE_SCALE)
+#define SPREAD_STEP (0.5 / READOUT_SPREAD_SCALE)
+
+typedef struct {
+  double mean;
+  double stddev;
+  double min;
+  double max;
+} Reference;
+
+static double samples[SAMPLE_COUNT];
+
+// xorshift32, so every run sees the same samples
+static uint32_t random_state = 0x2545F491u;
+
+static uint32_t next_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+// Uniform in [-1, 1)
+static double random_unit(void) {
+  return (double)next_random() / 2147483648.0 - 1.0;
+}
+
+// Two passes over the samples, as they were stored (fixed point)
+static Reference reference(const double *values, const size_t count) {
+  Reference ref = {.mean = 0, .min = INFINITY, .max = -INFINITY};
+  for (size_t i = 0; i < count; i++) {
+    ref.mean += values[i];
+    ref.min = fmin(ref.min, values[i]);
+    ref.max = fmax(ref.max, values[i]);
+  }
+  ref.mean /= (double)count;
+  double m2 = 0;
+  for (size_t i = 0; i < count; i++)
+    m2 += (values[i] - ref.mean) * (values[i] - ref.mean);
+  ref.stddev = sqrt(m2 / (double)count);
+  return ref;
+}
+
+// A readout along with its summary, which the queue and the log keep in a
+// record of its own
+typedef struct {
+  UniversalSingleReadout readout;
+  ReadoutSummary summary;
+} Summarized;
+
+// A single sample, taken at @p second
+static Summarized single(const double value, const uint32_t second) {
+  const UniversalSingleReadout readout = {
+      .timestamp = second,
+      .value = readout_value_to_fixed(value),
+      .descriptor = 1,
+      .channel = 3};
+  return (Summarized){.readout = readout,
+                      .summary = readout_get_summary(&readout)};
+}
+
+static void merge(Summarized *into, const Summarized *other) {
+  readout_aggregate_merge(&into->readout, &into->summary, &other->readout,
+                          &other->summary);
+}
+
+static void add(ReadoutAccumulator *accumulator, const Summarized *readout) {
+  readout_accumulator_add(accumulator, &readout->readout, &readout->summary);
+}
+
+static void summarize(const ReadoutAccumulator *accumulator,
+                      Summarized *readout) {
+  readout_accumulator_summarize(accumulator, &readout->readout,
+                                &readout->summary);
+}
+
+// The aggregate of samples[first, first + count)
+static Summarized aggregate(const size_t first, const size_t count) {
+  ReadoutAccumulator accumulator;
+  readout_accumulator_reset(&accumulator);
+  for (size_t i = first; i < first + count; i++) {
+    const Summarized readout = single(samples[i], (uint32_t)i);
+    add(&accumulator, &readout);
+  }
+  Summarized summary = {.readout = {.descriptor = 1, .channel = 3}};
+  summarize(&accumulator, &summary);
+  return summary;
+}
+
+// Checks an aggregate of @p count samples against the reference. Every
+// field was rounded @p roundings times on the way (once per merge on the
+// longest path, plus the summary), and independent rounding errors add up
+// like a random walk, to about sqrt(roundings) steps.
+static void check_aggregate(const Summarized *aggregate, const Reference *ref,
+                            const size_t count, const unsigned roundings) {
+  const double steps = 1 + sqrt(roundings);
+  const UniversalSingleReadout *readout = &aggregate->readout;
+  const ReadoutSummary *summary = &aggregate->summary;
+  CHECK(readout->flags & READOUT_FLAG_AGGREGATE);
+  CHECK(readout->flags & READOUT_FLAG_SUMMARY);
+  CHECK(summary->descriptor == READOUT_SUMMARY_DESCRIPTOR);
+  CHECK(summary->samples == count);
+  CHECK(fabs(readout_value_from_fixed(readout->value) - ref->mean) <=
+        steps * VALUE_STEP + 1e-9);
+  CHECK(fabs(readout_spread_from_fixed(summary->stddev) - ref->stddev) <=
+        steps * SPREAD_STEP + 1e-9);
+  CHECK(fabs(readout_min(readout, summary) - ref->min) <=
+        steps * SPREAD_STEP + 1e-9);
+  CHECK(fabs(readout_max(readout, summary) - ref->max) <=
+        steps * SPREAD_STEP + 1e-9);
+}
+
+static void test_records(void) {
+  // a single sample takes one record, the summary another one only where
+  // there is one
+  CHECK(sizeof(UniversalSingleReadout) == 12);
+  const Summarized plain = single(20.0, 1);
+  CHECK(readout_records(&plain.readout) == 1);
+  CHECK(plain.summary.samples == 1 && plain.summary.suppressed == 0);
+
+  UniversalSingleReadout records[3] = {plain.readout};
+  const ReadoutSummary summary = {.samples = 7, .stddev = 3,
+                                  .suppressed = 2};
+  readout_set_summary(records, &summary);
+  CHECK(readout_records(&records[0]) == 2);
+  CHECK(!readout_is_summary(&records[0]) && readout_is_summary(&records[1]));
+  const ReadoutSummary read_back = readout_get_summary(&records[0]);
+  CHECK(read_back.samples == 7 && read_back.stddev == 3 &&
+        read_back.suppressed == 2);
+}
+
+static void test_accumulator(void) {
+  const Reference ref = reference(samples, SAMPLE_COUNT);
+  const Summarized summary = aggregate(0, SAMPLE_COUNT);
+  check_aggregate(&summary, &ref, SAMPLE_COUNT, 0);
+  // keeps the oldest readout's time
+  CHECK(summary.readout.timestamp == 0);
+  CHECK(summary.summary.suppressed == 0);
+
+  // an accumulator fed the same samples as aggregates of uneven size agrees
+  // with the one fed every sample, as far as the aggregates' precision goes
+  ReadoutAccumulator accumulator;
+  readout_accumulator_reset(&accumulator);
+  size_t first = 0;
+  while (first < SAMPLE_COUNT) {
+    size_t count = 1 + next_random() % 97;
+    if (first + count > SAMPLE_COUNT)
+      count = SAMPLE_COUNT - first;
+    const Summarized part = aggregate(first, count);
+    add(&accumulator, &part);
+    first += count;
+  }
+  Summarized from_parts = {0};
+  summarize(&accumulator, &from_parts);
+  check_aggregate(&from_parts, &ref, SAMPLE_COUNT, 1);
+}
+
+static void test_merge_orders(void) {
+  const Reference ref = reference(samples, SAMPLE_COUNT);
+
+  // cut the samples into uneven parts
+  enum { PARTS = 64 };
+  Summarized parts[PARTS];
+  size_t bounds[PARTS + 1] = {0};
+  for (size_t i = 1; i < PARTS; i++)
+    bounds[i] = (size_t)i * SAMPLE_COUNT / PARTS + next_random() % 40;
+  bounds[PARTS] = SAMPLE_COUNT;
+  for (size_t i = 0; i < PARTS; i++)
+    parts[i] = aggregate(bounds[i], bounds[i + 1] - bounds[i]);
+
+  // left to right, as the coalesce policy folds readouts into its last slot
+  Summarized folded = parts[0];
+  for (size_t i = 1; i < PARTS; i++)
+    merge(&folded, &parts[i]);
+  check_aggregate(&folded, &ref, SAMPLE_COUNT, PARTS);
+  CHECK(folded.readout.timestamp == 0);
+
+  // newest first, the merged readout still takes the oldest time
+  Summarized reversed = parts[PARTS - 1];
+  for (size_t i = PARTS - 1; i-- > 0;)
+    merge(&reversed, &parts[i]);
+  check_aggregate(&reversed, &ref, SAMPLE_COUNT, PARTS);
+  CHECK(reversed.readout.timestamp == 0);
+
+  // pairwise, as a tree
+  Summarized tree[PARTS];
+  memcpy(tree, parts, sizeof(tree));
+  for (size_t width = 1; width < PARTS; width *= 2) {
+    for (size_t i = 0; i + width < PARTS; i += 2 * width)
+      merge(&tree[i], &tree[i + width]);
+  }
+  // log2(PARTS) merges deep
+  check_aggregate(&tree[0], &ref, SAMPLE_COUNT, 7);
+
+  // single samples, one at a time, as a coalescing queue under sustained
+  // overflow does
+  Summarized by_sample = single(samples[0], 0);
+  for (size_t i = 1; i < 400; i++) {
+    const Summarized readout = single(samples[i], (uint32_t)i);
+    merge(&by_sample, &readout);
+  }
+  const Reference first_400 = reference(samples, 400);
+  check_aggregate(&by_sample, &first_400, 400, 400);
+}
+
+static void test_merge_two_samples(void) {
+  Summarized into = single(20.0, 100);
+  const Summarized other = single(21.0, 99);
+  merge(&into, &other);
+
+  CHECK(into.summary.samples == 2);
+  CHECK(into.readout.value == readout_value_to_fixed(20.5));
+  CHECK(into.summary.stddev == readout_spread_to_fixed(0.5));
+  CHECK(into.summary.below == readout_spread_to_fixed(0.5));
+  CHECK(into.summary.above == readout_spread_to_fixed(0.5));
+  CHECK(into.readout.flags ==
+        (READOUT_FLAG_AGGREGATE | READOUT_FLAG_SUMMARY));
+  CHECK(into.readout.timestamp == 99);
+  CHECK(into.readout.descriptor == 1 && into.readout.channel == 3);
+
+  // a zeroed count is taken as one sample
+  Summarized zeroed = single(10.0, 5);
+  zeroed.summary.samples = 0;
+  Summarized plain = single(30.0, 6);
+  merge(&zeroed, &plain);
+  CHECK(zeroed.summary.samples == 2);
+  CHECK(zeroed.readout.value == readout_value_to_fixed(20.0));
+}
+
+static void test_merge_bookkeeping(void) {
+  // suppressed readouts aren't samples: they add up on their own and leave
+  // the weights alone
+  Summarized into = single(10.0, 10);
+  into.summary.suppressed = 40;
+  Summarized other = single(20.0, 20);
+  other.summary.suppressed = 2;
+  merge(&into, &other);
+  CHECK(into.summary.samples == 2);
+  CHECK(into.summary.suppressed == 42);
+  CHECK(into.readout.value == readout_value_to_fixed(15.0));
+
+  // the counts saturate instead of wrapping
+  Summarized big = single(1.0, 0);
+  big.readout.flags = READOUT_FLAG_AGGREGATE | READOUT_FLAG_SUMMARY;
+  big.summary.samples = UINT16_MAX - 10;
+  big.summary.suppressed = UINT16_MAX - 1;
+  Summarized more = big;
+  merge(&big, &more);
+  CHECK(big.summary.samples == UINT16_MAX);
+  CHECK(big.summary.suppressed == UINT16_MAX);
+  CHECK(big.readout.value == readout_value_to_fixed(1.0));
+  CHECK(big.summary.stddev == 0);
+
+  // a readout from before the first sync is on another time base: the
+  // merged one keeps the time and base of the readout merged into, and
+  // every other flag of both
+  Summarized synced = single(5.0, 1000);
+  synced.readout.flags = READOUT_FLAG_CLOCK_STALE;
+  Summarized boot = single(7.0, 3);
+  boot.readout.flags = READOUT_FLAG_MONOTONIC | READOUT_FLAG_CLOCK_SYNCING;
+  merge(&synced, &boot);
+  CHECK(synced.readout.timestamp == 1000);
+  CHECK(synced.readout.flags ==
+        (READOUT_FLAG_AGGREGATE | READOUT_FLAG_SUMMARY |
+         READOUT_FLAG_CLOCK_STALE | READOUT_FLAG_CLOCK_SYNCING));
+
+  Summarized early = single(7.0, 3);
+  early.readout.flags = READOUT_FLAG_MONOTONIC;
+  Summarized late = single(5.0, 1000);
+  merge(&early, &late);
+  CHECK(early.readout.timestamp == 3);
+  CHECK(early.readout.flags & READOUT_FLAG_MONOTONIC);
+
+  // the subsecond breaks a tie on the second
+  Summarized a = single(1.0, 50);
+  a.readout.subsecond = 200;
+  Summarized b = single(2.0, 50);
+  b.readout.subsecond = 10;
+  merge(&a, &b);
+  CHECK(a.readout.timestamp == 50 && a.readout.subsecond == 10);
+
+  // a spread too wide for the record saturates
+  Summarized low = single(-100.0, 0);
+  Summarized high = single(100.0, 1);
+  merge(&low, &high);
+  CHECK(low.summary.below == UINT16_MAX && low.summary.above == UINT16_MAX);
+  CHECK(low.summary.stddev == UINT16_MAX);
+}
+
+static void test_accumulator_bookkeeping(void) {
+  ReadoutAccumulator accumulator;
+  readout_accumulator_reset(&accumulator);
+
+  Summarized first = single(4.0, 30);
+  first.readout.subsecond = 128;
+  first.readout.flags = READOUT_FLAG_CLOCK_SYNCING;
+  first.summary.suppressed = 5;
+  Summarized second = single(6.0, 30);
+  second.readout.subsecond = 64;
+  second.summary.suppressed = 1;
+  add(&accumulator, &first);
+  add(&accumulator, &second);
+  CHECK(accumulator.count == 2);
+  CHECK(accumulator.suppressed == 6);
+  CHECK(accumulator.start == 30 && accumulator.start_subsecond == 64);
+
+  // summarize() leaves the descriptor and channel alone and adds to the
+  // flags already there
+  Summarized summary = {.readout = {.descriptor = 9, .channel = 2,
+                                    .flags = READOUT_FLAG_CLOCK_STALE}};
+  summarize(&accumulator, &summary);
+  CHECK(summary.readout.descriptor == 9 && summary.readout.channel == 2);
+  CHECK(summary.readout.flags ==
+        (READOUT_FLAG_AGGREGATE | READOUT_FLAG_SUMMARY |
+         READOUT_FLAG_CLOCK_SYNCING | READOUT_FLAG_CLOCK_STALE));
+  CHECK(summary.readout.timestamp == 30 && summary.readout.subsecond == 64);
+  CHECK(summary.summary.samples == 2 && summary.summary.suppressed == 6);
+  CHECK(summary.readout.value == readout_value_to_fixed(5.0));
+  CHECK(summary.summary.stddev == readout_spread_to_fixed(1.0));
+
+  // the sample count keeps going past what the record holds
+  readout_accumulator_reset(&accumulator);
+  Summarized full = single(1.0, 0);
+  full.readout.flags = READOUT_FLAG_AGGREGATE | READOUT_FLAG_SUMMARY;
+  full.summary.samples = UINT16_MAX;
+  add(&accumulator, &full);
+  add(&accumulator, &full);
+  CHECK(accumulator.count == 2u * UINT16_MAX);
+  summary = (Summarized){0};
+  summarize(&accumulator, &summary);
+  CHECK(summary.summary.samples == UINT16_MAX);
+}
+
+// A reading near the top of the record's range, with millikelvin noise: the
+// squares of the values are ~1e10 times the variance, which a sum of squares
+// would lose to cancellation
+static void test_far_from_zero(void) {
+  enum { COUNT = 200000 };
+  const double offset = 200000.0;
+  ReadoutAccumulator accumulator;
+  readout_accumulator_reset(&accumulator);
+  double sum = 0;
+  double sum_squares = 0;
+  static double values[COUNT];
+  for (size_t i = 0; i < COUNT; i++) {
+    values[i] = readout_value_from_fixed(
+        readout_value_to_fixed(offset + 0.05 * random_unit()));
+    const Summarized readout = single(values[i], (uint32_t)i);
+    add(&accumulator, &readout);
+    sum += values[i];
+    sum_squares += values[i] * values[i];
+  }
+  const Reference ref = reference(values, COUNT);
+  CHECK(fabs(accumulator.mean - ref.mean) <= 1e-7);
+  CHECK(fabs(sqrt(accumulator.m2 / accumulator.count) - ref.stddev) <=
+        1e-6 * ref.stddev);
+
+  const double naive =
+      sqrt(fmax(0, sum_squares / COUNT - (sum / COUNT) * (sum / COUNT)));
+  printf("stddev %.6f, Welford off by %.2g, sum of squares off by %.2g\n",
+         ref.stddev, fabs(sqrt(accumulator.m2 / accumulator.count) -
+                          ref.stddev),
+         fabs(naive - ref.stddev));
+}
+
+int main(void) {
+  // a few slow cycles plus noise, stored in fixed point like a real reading
+  for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+    const double value = 21.0 + 3.0 * sin((double)i / 150.0) +
+                         0.25 * random_unit();
+    samples[i] = readout_value_from_fixed(readout_value_to_fixed(value));
+  }
+
+  test_records();
+  test_accumulator();
+  test_merge_orders();
+  test_merge_two_samples();
+  test_merge_bookkeeping();
+  test_accumulator_bookkeeping();
+  test_far_from_zero();
+  return test_exit();
+}
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Round trips of readout_codec.c: records encoded as version 3 decode to the
+// same values and encode back to the same bytes, and payloads of the older
+// versions (written here byte by byte, from the layouts described in
+// readout_codec.h) decode to the records they were made from.
+
+#include "host_test.h"
+#include "readout_codec.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+static const ReadoutRecord records[] = {
+    // a single sample
+    {.timestamp = 1760000000123, .value = 21.5f,
+     .address = 0x28FF641E8216C3A1ull},
+    // no probe address, negative value
+    {.timestamp = 1760000001000, .value = -55.0625f},
+    // an aggregate
+    {.timestamp = 1760000060000, .value = 22.25f, .address = 7,
+     .flags = READOUT_CODEC_FLAG_AGGREGATE, .samples = 60, .min = 21.0f,
+     .max = 23.5f, .stddev = 0.625f},
+    // suppressed readouts before a sample
+    {.timestamp = 1760000120456, .value = 19.0f, .address = 7,
+     .flags = READOUT_CODEC_FLAG_SUPPRESSED, .suppressed = 12},
+    // both optional parts, and the clock flags
+    {.timestamp = 1760000180789, .value = 18.75f, .address = UINT64_MAX,
+     .flags = READOUT_CODEC_FLAG_AGGREGATE | READOUT_CODEC_FLAG_SUPPRESSED |
+              READOUT_CODEC_FLAG_CLOCK_SYNCING |
+              READOUT_CODEC_FLAG_CLOCK_STALE,
+     .samples = UINT16_MAX, .min = -1.0f, .max = 125.0f, .stddev = 3.5f,
+     .suppressed = UINT16_MAX},
+    // a timestamp before the epoch, and a read error
+    {.timestamp = -1000, .value = NAN},
+};
+
+#define RECORD_COUNT (sizeof(records) / sizeof(records[0]))
+
+static bool same_float(const float a, const float b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Checks a decoded record against the one it was encoded from, with the
+// defaults the decoder fills in for what the payload doesn't carry
+static void check_record(const ReadoutRecord *decoded,
+                         const ReadoutRecord *expected,
+                         const int64_t timestamp) {
+  CHECK(decoded->timestamp == timestamp);
+  CHECK(same_float(decoded->value, expected->value));
+  CHECK(decoded->address == expected->address);
+  CHECK(decoded->flags == expected->flags);
+  if (expected->flags & READOUT_CODEC_FLAG_AGGREGATE) {
+    CHECK(decoded->samples == expected->samples);
+    CHECK(same_float(decoded->min, expected->min));
+    CHECK(same_float(decoded->max, expected->max));
+    CHECK(same_float(decoded->stddev, expected->stddev));
+  } else {
+    CHECK(decoded->samples == 1);
+    CHECK(same_float(decoded->min, expected->value));
+    CHECK(same_float(decoded->max, expected->value));
+  }
+  if (expected->flags & READOUT_CODEC_FLAG_SUPPRESSED) {
+    CHECK(decoded->suppressed == expected->suppressed);
+  } else {
+    CHECK(decoded->suppressed == 0);
+  }
+}
+
+static void put_le(uint8_t *dst, const uint64_t value, const size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static void put_float(uint8_t *dst, const float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put_le(dst, bits, 4);
+}
+
+// Writes @p count records as a payload of version 1 or 2, which both have
+// timestamps in whole seconds. Returns the payload's length.
+static size_t encode_legacy(uint8_t *payload, const uint8_t version,
+                            const ReadoutRecord *source, const size_t count) {
+  payload[0] = READOUT_CODEC_MAGIC;
+  payload[1] = version;
+  put_le(&payload[2], count, 2);
+  uint8_t *dst = payload + READOUT_CODEC_HEADER_SIZE;
+  for (size_t i = 0; i < count; i++) {
+    put_le(&dst[0], (uint64_t)(source[i].timestamp / 1000), 8);
+    put_float(&dst[8], source[i].value);
+    put_le(&dst[12], source[i].address, 8);
+    if (version == 1) {
+      dst += READOUT_CODEC_V1_RECORD_SIZE;
+      continue;
+    }
+    dst[20] = source[i].flags;
+    dst += READOUT_CODEC_RECORD_SIZE;
+    if (source[i].flags & READOUT_CODEC_FLAG_AGGREGATE) {
+      put_le(&dst[0], source[i].samples, 2);
+      put_float(&dst[2], source[i].min);
+      put_float(&dst[6], source[i].max);
+      put_float(&dst[10], source[i].stddev);
+      dst += READOUT_CODEC_AGGREGATE_SIZE;
+    }
+    if (source[i].flags & READOUT_CODEC_FLAG_SUPPRESSED) {
+      put_le(&dst[0], source[i].suppressed, 2);
+      dst += READOUT_CODEC_SUPPRESSED_SIZE;
+    }
+  }
+  return (size_t)(dst - payload);
+}
+
+static void test_version_3(void) {
+  uint8_t payload[512];
+  ReadoutEncoder encoder;
+  CHECK(readout_encoder_init(&encoder, payload, sizeof(payload)));
+  size_t expected_length = READOUT_CODEC_HEADER_SIZE;
+  for (size_t i = 0; i < RECORD_COUNT; i++) {
+    CHECK(readout_encoder_append(&encoder, &records[i]));
+    expected_length += READOUT_CODEC_RECORD_SIZE;
+    if (records[i].flags & READOUT_CODEC_FLAG_AGGREGATE)
+      expected_length += READOUT_CODEC_AGGREGATE_SIZE;
+    if (records[i].flags & READOUT_CODEC_FLAG_SUPPRESSED)
+      expected_length += READOUT_CODEC_SUPPRESSED_SIZE;
+  }
+  CHECK(encoder.length == expected_length);
+  CHECK(payload[0] == READOUT_CODEC_MAGIC);
+  CHECK(payload[1] == 3);
+
+  ReadoutRecord decoded[RECORD_COUNT];
+  CHECK(readout_decode(payload, encoder.length, decoded, RECORD_COUNT) ==
+        (int)RECORD_COUNT);
+  for (size_t i = 0; i < RECORD_COUNT; i++) {
+    check_record(&decoded[i], &records[i], records[i].timestamp);
+  }
+
+  // and back to the same bytes
+  uint8_t again[512];
+  ReadoutEncoder reencoder;
+  readout_encoder_init(&reencoder, again, sizeof(again));
+  for (size_t i = 0; i < RECORD_COUNT; i++) {
+    CHECK(readout_encoder_append(&reencoder, &decoded[i]));
+  }
+  CHECK(reencoder.length == encoder.length);
+  CHECK(memcmp(again, payload, encoder.length) == 0);
+}
+
+static void test_legacy_version(const uint8_t version) {
+  uint8_t payload[512];
+  const size_t length = encode_legacy(payload, version, records, RECORD_COUNT);
+  ReadoutRecord decoded[RECORD_COUNT];
+  CHECK(readout_decode(payload, length, decoded, RECORD_COUNT) ==
+        (int)RECORD_COUNT);
+  for (size_t i = 0; i < RECORD_COUNT; i++) {
+    // version 1 had nothing but samples
+    ReadoutRecord expected = records[i];
+    if (version == 1)
+      expected.flags = 0;
+    check_record(&decoded[i], &expected, records[i].timestamp / 1000 * 1000);
+  }
+}
+
+static void test_full_payload(void) {
+  // room for the header and two plain records, and a bit more
+  uint8_t payload[READOUT_CODEC_HEADER_SIZE + 2 * READOUT_CODEC_RECORD_SIZE +
+                  10];
+  ReadoutEncoder encoder;
+  CHECK(readout_encoder_init(&encoder, payload, sizeof(payload)));
+  CHECK(readout_encoder_append(&encoder, &records[0]));
+  CHECK(readout_encoder_append(&encoder, &records[1]));
+  const size_t length = encoder.length;
+  CHECK(!readout_encoder_append(&encoder, &records[2]));
+  CHECK(encoder.length == length);
+  CHECK(encoder.count == 2);
+
+  ReadoutRecord decoded[2];
+  CHECK(readout_decode(payload, length, decoded, 2) == 2);
+
+  uint8_t tiny[READOUT_CODEC_HEADER_SIZE - 1];
+  CHECK(!readout_encoder_init(&encoder, tiny, sizeof(tiny)));
+  CHECK(!readout_encoder_append(&encoder, &records[0]));
+}
+
+static void test_malformed(void) {
+  uint8_t payload[512];
+  ReadoutEncoder encoder;
+  readout_encoder_init(&encoder, payload, sizeof(payload));
+  for (size_t i = 0; i < RECORD_COUNT; i++) {
+    readout_encoder_append(&encoder, &records[i]);
+  }
+  ReadoutRecord decoded[RECORD_COUNT];
+
+  // fewer slots than records: the count is still returned
+  CHECK(readout_decode(payload, encoder.length, decoded, 2) ==
+        (int)RECORD_COUNT);
+  check_record(&decoded[1], &records[1], records[1].timestamp);
+
+  CHECK(readout_decode(payload, READOUT_CODEC_HEADER_SIZE - 1, decoded,
+                       RECORD_COUNT) == -1);
+  // truncated in a fixed part, in an optional part, and trailing bytes
+  CHECK(readout_decode(payload, READOUT_CODEC_HEADER_SIZE + 10, decoded,
+                       RECORD_COUNT) == -1);
+  CHECK(readout_decode(payload, encoder.length - 1, decoded, RECORD_COUNT) ==
+        -1);
+  CHECK(readout_decode(payload, encoder.length + 1, decoded, RECORD_COUNT) ==
+        -1);
+
+  payload[1] = 0;
+  CHECK(readout_decode(payload, encoder.length, decoded, RECORD_COUNT) == -1);
+  payload[1] = READOUT_CODEC_VERSION + 1;
+  CHECK(readout_decode(payload, encoder.length, decoded, RECORD_COUNT) == -1);
+  payload[1] = READOUT_CODEC_VERSION;
+  payload[0] = 0;
+  CHECK(readout_decode(payload, encoder.length, decoded, RECORD_COUNT) == -1);
+
+  // an empty payload is fine
+  readout_encoder_init(&encoder, payload, sizeof(payload));
+  CHECK(readout_decode(payload, encoder.length, decoded, RECORD_COUNT) == 0);
+}
+
+int main(void) {
+  test_version_3();
+  test_legacy_version(2);
+  test_legacy_version(1);
+  test_full_payload();
+  test_malformed();
+  return test_exit();
+}
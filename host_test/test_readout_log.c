@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// readout_log.c on the NOR flash of fake_partition.c: readouts come back in
+// the order they were appended, a readout and its summary record together,
+// and only what was consumed is gone. A reboot (readout_log_init() again)
+// rebuilds the same state from the slots, a full log drops its oldest
+// sector and whatever summary lost its readout with it, and a torn write
+// costs the slot it was in and a readout whose summary it was, no more.
+
+#include "host_test.h"
+
+#include "fake_partition.h"
+#include "readout_log.h"
+#include "sensor_descriptors.h"
+#include "sdkconfig.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SECTORS 3
+// READOUT_LOG_SLOT_SIZE from main/CMakeLists.txt
+#define SLOT_SIZE 24
+#define SLOTS_PER_SECTOR (FAKE_PARTITION_SECTOR_SIZE / SLOT_SIZE)
+#define SLOT_COUNT (SECTORS * SLOTS_PER_SECTOR)
+
+static void fresh_log(void) {
+  fake_partition_reset(CONFIG_READOUT_LOG_PARTITION_LABEL, SECTORS);
+  CHECK(readout_log_init() == ESP_OK);
+  CHECK(readout_log_count() == 0);
+}
+
+// Appends readout number @p n, with a summary record if @p summary
+static esp_err_t append(const int32_t n, const bool summary,
+                        const uint8_t flags) {
+  UniversalSingleReadout records[2] = {
+      {.timestamp = 1000 + (uint32_t)n,
+       .value = n,
+       .descriptor = SENSOR_DESCRIPTOR_MOCK,
+       .flags = flags}};
+  if (summary)
+    readout_set_summary(records, &(ReadoutSummary){
+                                     .samples = 4,
+                                     .stddev = (uint16_t)n,
+                                     .descriptor = READOUT_SUMMARY_DESCRIPTOR});
+  return readout_log_append(records);
+}
+
+// Peeks everything up to READOUT_LOG_MAX_PEEK and checks that every readout
+// comes with the summary it was appended with. Returns the readouts' numbers.
+static size_t peek_numbers(int32_t *numbers, size_t *records_peeked) {
+  UniversalSingleReadout records[READOUT_LOG_MAX_PEEK];
+  const size_t count = readout_log_peek(records, READOUT_LOG_MAX_PEEK);
+  size_t readouts = 0;
+  for (size_t i = 0; i < count; i += readout_records(&records[i])) {
+    CHECK(!readout_is_summary(&records[i]));
+    if (records[i].flags & READOUT_FLAG_SUMMARY) {
+      CHECK(i + 1 < count);
+      CHECK(readout_get_summary(&records[i]).stddev == records[i].value);
+    }
+    numbers[readouts++] = records[i].value;
+  }
+  if (records_peeked != NULL)
+    *records_peeked = count;
+  return readouts;
+}
+
+static void test_missing_partition(void) {
+  fake_partition_reset("nvs", SECTORS);
+  CHECK(readout_log_init() == ESP_ERR_NOT_FOUND);
+}
+
+static void test_order(void) {
+  fresh_log();
+  // every third readout with a summary: 10 readouts in 14 records
+  for (int32_t n = 0; n < 10; n++)
+    CHECK(append(n, n % 3 == 0, 0) == ESP_OK);
+  CHECK(readout_log_count() == 14);
+  CHECK(readout_log_pending() == 14);
+
+  int32_t numbers[READOUT_LOG_MAX_PEEK];
+  size_t records = 0;
+  CHECK(peek_numbers(numbers, &records) == 10);
+  CHECK(records == 14);
+  for (int32_t n = 0; n < 10; n++)
+    CHECK(numbers[n] == n);
+  // peeking consumes nothing
+  CHECK(readout_log_count() == 14);
+
+  // a pair doesn't fit in what is left of max_records
+  UniversalSingleReadout first[4];
+  CHECK(readout_log_peek(first, 3) == 3); // 0 and its summary, 1
+  CHECK(readout_log_peek(first, 2) == 2);
+  CHECK(readout_log_consume(3) == ESP_ERR_INVALID_ARG);
+  CHECK(readout_log_consume(2) == ESP_OK); // readout 0
+  CHECK(readout_log_count() == 12);
+  CHECK(readout_log_peek(first, 3) == 2); // 1 and 2, 3 has a summary
+  CHECK(first[0].value == 1 && first[1].value == 2);
+  CHECK(readout_log_peek(first, 4) == 4); // peeked again from the tail
+  // 1, 2 and the readout record of 3 is a split no caller makes, but the
+  // tail still moves past it
+  CHECK(readout_log_consume(3) == ESP_OK);
+  CHECK(readout_log_count() == 9);
+  // the orphaned summary is skipped, not handed out
+  CHECK(peek_numbers(numbers, NULL) == 6);
+  CHECK(numbers[0] == 4);
+}
+
+static void test_reboot(void) {
+  fresh_log();
+  for (int32_t n = 0; n < 20; n++)
+    CHECK(append(n, n % 4 == 1, 0) == ESP_OK);
+  // a readout timed since boot can't be placed after the next one
+  CHECK(append(20, false, READOUT_FLAG_MONOTONIC) == ESP_OK);
+  CHECK(append(21, true, READOUT_FLAG_MONOTONIC) == ESP_OK);
+
+  UniversalSingleReadout records[READOUT_LOG_MAX_PEEK];
+  CHECK(readout_log_peek(records, 10) == 10); // readouts 0 to 7
+  CHECK(readout_log_consume(10) == ESP_OK);
+  const uint32_t count = readout_log_count();
+
+  // everything the log knows is in the flash
+  CHECK(readout_log_init() == ESP_OK);
+  CHECK(readout_log_count() == count);
+  CHECK(readout_log_pending() == count);
+  CHECK(append(22, false, READOUT_FLAG_MONOTONIC) == ESP_OK);
+
+  int32_t numbers[READOUT_LOG_MAX_PEEK];
+  const size_t readouts = peek_numbers(numbers, NULL);
+  CHECK(readouts == 13); // 8 to 19, and 22
+  for (size_t i = 0; i < readouts && i < 12; i++)
+    CHECK(numbers[i] == (int32_t)i + 8);
+  CHECK(numbers[12] == 22);
+
+  // and so does a reboot with nothing left
+  size_t peeked = readout_log_peek(records, READOUT_LOG_MAX_PEEK);
+  CHECK(readout_log_consume(peeked) == ESP_OK);
+  CHECK(readout_log_count() == 0);
+  CHECK(readout_log_init() == ESP_OK);
+  CHECK(readout_log_count() == 0);
+  CHECK(readout_log_peek(records, READOUT_LOG_MAX_PEEK) == 0);
+}
+
+static void test_wraparound(void) {
+  fresh_log();
+  // readout n in slot n, until the pair in the last slot of sector 0 and the
+  // first of sector 1
+  int32_t n = 0;
+  for (; n < SLOTS_PER_SECTOR - 1; n++)
+    CHECK(append(n, false, 0) == ESP_OK);
+  CHECK(append(n++, true, 0) == ESP_OK);
+  // fills the log and goes 100 slots into the next lap
+  const int32_t last = SLOT_COUNT + 100 - 2;
+  for (; n <= last; n++)
+    CHECK(append(n, false, 0) == ESP_OK);
+  const unsigned erases = fake_partition.erases;
+
+  // the lap wiped sector 0 and with it the pair's readout
+  CHECK(readout_log_count() == SLOT_COUNT - SLOTS_PER_SECTOR + 100);
+  int32_t numbers[READOUT_LOG_MAX_PEEK];
+  CHECK(peek_numbers(numbers, NULL) == READOUT_LOG_MAX_PEEK);
+  CHECK(numbers[0] == SLOTS_PER_SECTOR);
+
+  CHECK(readout_log_init() == ESP_OK);
+  CHECK(readout_log_count() == SLOT_COUNT - SLOTS_PER_SECTOR + 100);
+
+  // drains the rest in order, across the end of the partition
+  int32_t expected = SLOTS_PER_SECTOR;
+  size_t readouts;
+  size_t records;
+  while ((readouts = peek_numbers(numbers, &records)) > 0) {
+    for (size_t i = 0; i < readouts; i++)
+      CHECK(numbers[i] == expected++);
+    CHECK(readout_log_consume(records) == ESP_OK);
+  }
+  CHECK(expected == last + 1);
+  CHECK(readout_log_count() == 0);
+  // nothing erased that didn't have to be
+  CHECK(fake_partition.erases == erases);
+}
+
+static void test_torn_slot(void) {
+  fresh_log();
+  CHECK(append(0, false, 0) == ESP_OK);
+  CHECK(append(1, true, 0) == ESP_OK);
+  // the write stops in the middle of the record
+  fake_partition_tear(0, SLOT_SIZE / 2);
+  CHECK(append(2, false, 0) != ESP_OK);
+  CHECK(append(3, false, 0) == ESP_OK);
+  // the summary of a pair never makes it
+  fake_partition_tear(1, 0);
+  CHECK(append(4, true, 0) != ESP_OK);
+  CHECK(append(5, true, 0) == ESP_OK);
+
+  int32_t numbers[READOUT_LOG_MAX_PEEK];
+  CHECK(peek_numbers(numbers, NULL) == 4);
+  CHECK(numbers[0] == 0 && numbers[1] == 1 && numbers[2] == 3 &&
+        numbers[3] == 5);
+
+  // the same after a reboot, and the reset in the middle of a pair's
+  // summary leaves its slot to the next readout
+  CHECK(readout_log_init() == ESP_OK);
+  CHECK(peek_numbers(numbers, NULL) == 4);
+  CHECK(numbers[3] == 5);
+  fake_partition_tear(0, 0);
+  CHECK(append(6, true, 0) != ESP_OK);
+  CHECK(readout_log_init() == ESP_OK);
+  CHECK(append(7, false, 0) == ESP_OK);
+  size_t records;
+  CHECK(peek_numbers(numbers, &records) == 5);
+  CHECK(numbers[4] == 7);
+  CHECK(readout_log_consume(records) == ESP_OK);
+  CHECK(readout_log_count() == 0);
+}
+
+int main(void) {
+  test_missing_partition();
+  test_order();
+  test_reboot();
+  test_wraparound();
+  test_torn_slot();
+  return test_exit();
+}
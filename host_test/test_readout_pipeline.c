@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// The deadband stage of readout_pipeline.c, with the DS18B20's deadband and
+// heartbeat from the host sdkconfig.h: a readout within the deadband of the
+// last one that passed is suppressed, the next one to pass carries the
+// number suppressed before it in a summary record (and only then has one),
+// and the heartbeat forces one through while the value stands still. Every
+// channel is a stream of its own, aggregates and sensors without a deadband
+// pass as they are, and readouts of channels past the stream table pass
+// through and are counted.
+
+#include "host_test.h"
+
+#include "deferred_log.h"
+#include "metrics.h"
+#include "ntp_manager.h"
+#include "readout_pipeline.h"
+#include "sdkconfig.h"
+#include "sensor_descriptors.h"
+#include "system_state.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// sensor_descriptors.c's DS18B20 deadband, fixed point
+#define DEADBAND                                                               \
+  (CONFIG_SOFTWARE_DS18B20_DEADBAND * (READOUT_VALUE_SCALE / 1000))
+#define HEARTBEAT CONFIG_SOFTWARE_DS18B20_HEARTBEAT
+#define T0 24000000 // some time after READOUT_EPOCH_BASE
+#define BASE 215000 // 21.5 °C, where test_suppression() leaves channel 0
+
+// What reaches the readout queue
+#define MAX_QUEUED 64
+static UniversalSingleReadout queued[MAX_QUEUED];
+static size_t queued_count = 0;
+static unsigned unstreamed = 0;
+
+BaseType_t readout_queue_send(const UniversalSingleReadout *readout) {
+  for (size_t i = 0; i < readout_records(readout); i++) {
+    if (queued_count < MAX_QUEUED)
+      queued[queued_count] = readout[i];
+    queued_count++;
+  }
+  return pdPASS;
+}
+
+EventBits_t system_get_bits(void) { return SYS_BIT_TIME_VALID; }
+
+bool ntp_manager_get_boot_time(int64_t *boot_time) {
+  *boot_time = 0;
+  return true;
+}
+
+void metrics_count(const MetricCounter counter) {
+  if (counter == METRIC_READOUTS_UNSTREAMED)
+    unstreamed++;
+}
+
+void deferred_log_write(const esp_log_level_t level,
+                        const DeferredLogFormat format, const uint32_t *args,
+                        const size_t arg_count) {}
+
+uint64_t sensor_manager_ds18b20_get_address(const uint8_t channel) {
+  return 0x28FF641E8216C300ull | channel;
+}
+
+// Submits a DS18B20 readout taken @p second seconds after T0, returns how
+// many records that queued
+static size_t submit(const uint8_t channel, const uint32_t second,
+                     const int32_t value) {
+  const size_t before = queued_count;
+  const UniversalSingleReadout readout = {
+      .timestamp = T0 + second,
+      .value = value,
+      .descriptor = SENSOR_DESCRIPTOR_DS18B20,
+      .channel = channel};
+  readout_pipeline_submit(&readout);
+  return queued_count - before;
+}
+
+// The last readout queued, and the number suppressed before it
+static const UniversalSingleReadout *last_queued(uint16_t *suppressed) {
+  size_t last = queued_count - 1;
+  if (readout_is_summary(&queued[last]))
+    last--;
+  *suppressed = readout_get_summary(&queued[last]).suppressed;
+  return &queued[last];
+}
+
+static void test_suppression(void) {
+  const uint8_t channel = 0;
+  const int32_t base = BASE;
+  uint16_t suppressed;
+
+  // the first readout always passes, on its own
+  CHECK(submit(channel, 0, base) == 1);
+  CHECK(!(last_queued(&suppressed)->flags & READOUT_FLAG_SUMMARY));
+
+  // within the deadband either way, its edges included
+  CHECK(submit(channel, 5, base + DEADBAND) == 0);
+  CHECK(submit(channel, 10, base - DEADBAND) == 0);
+  CHECK(submit(channel, 15, base + 1) == 0);
+
+  // out of it, with the three before it in its summary
+  CHECK(submit(channel, 20, base + DEADBAND + 1) == 2);
+  const UniversalSingleReadout *passed = last_queued(&suppressed);
+  CHECK(passed->value == base + DEADBAND + 1);
+  CHECK(passed->timestamp == T0 + 20);
+  CHECK(suppressed == 3);
+  CHECK(readout_get_summary(passed).samples == 1);
+  CHECK(readout_is_summary(&passed[1]));
+
+  // measured from the one that passed, and the count starts over
+  CHECK(submit(channel, 25, base + 1) == 0);
+  CHECK(submit(channel, 30, base - 1) == 2);
+  CHECK(last_queued(&suppressed)->value == base - 1);
+  CHECK(suppressed == 1);
+  CHECK(submit(channel, 35, base + DEADBAND) == 1);
+  CHECK(last_queued(&suppressed)->value == base + DEADBAND);
+}
+
+static void test_heartbeat(void) {
+  const uint8_t channel = 1;
+  const int32_t base = readout_value_to_fixed(18.0);
+  uint16_t suppressed;
+
+  CHECK(submit(channel, 0, base) == 1);
+  unsigned count = 0;
+  for (uint32_t second = 5; second < HEARTBEAT; second += 5) {
+    CHECK(submit(channel, second, base) == 0);
+    count++;
+  }
+  CHECK(submit(channel, HEARTBEAT - 1, base) == 0);
+  count++;
+
+  // the value never moved, but the heartbeat ran out
+  CHECK(submit(channel, HEARTBEAT, base) == 2);
+  CHECK(last_queued(&suppressed)->timestamp == T0 + HEARTBEAT);
+  CHECK(suppressed == count);
+
+  // and the next heartbeat counts from there
+  CHECK(submit(channel, 2 * HEARTBEAT - 1, base) == 0);
+  CHECK(submit(channel, 2 * HEARTBEAT, base) == 2);
+  CHECK(last_queued(&suppressed)->timestamp == T0 + 2 * HEARTBEAT);
+  CHECK(suppressed == 1);
+}
+
+static void test_saturation(void) {
+  const uint8_t channel = 2;
+  uint16_t suppressed;
+
+  // more suppressed readouts than a summary can count, well within the
+  // heartbeat
+  CHECK(submit(channel, 0, 0) == 1);
+  for (uint32_t i = 0; i < UINT16_MAX + 10u; i++)
+    submit(channel, 1, 0);
+  CHECK(submit(channel, 2, 2 * DEADBAND) == 2);
+  last_queued(&suppressed);
+  CHECK(suppressed == UINT16_MAX);
+}
+
+static void test_passing_through(void) {
+  // aggregates pass, and don't move the stream's last value
+  const UniversalSingleReadout aggregate = {
+      .timestamp = T0 + 40,
+      .value = 0,
+      .descriptor = SENSOR_DESCRIPTOR_DS18B20,
+      .channel = 0,
+      .flags = READOUT_FLAG_AGGREGATE};
+  const size_t before = queued_count;
+  readout_pipeline_submit(&aggregate);
+  readout_pipeline_submit(&aggregate);
+  CHECK(queued_count - before == 2);
+  CHECK(submit(0, 45, BASE) == 0);
+
+  // the mock sensor has no deadband
+  for (uint32_t i = 0; i < 3; i++) {
+    const UniversalSingleReadout mock = {
+        .timestamp = T0 + i,
+        .value = 1,
+        .descriptor = SENSOR_DESCRIPTOR_MOCK};
+    const size_t queued_before = queued_count;
+    readout_pipeline_submit(&mock);
+    CHECK(queued_count - queued_before == 1);
+  }
+
+  // channels 0 to 2 have their streams, 3 takes the last one and 4 gets
+  // none: its readouts all pass, and are counted
+  CHECK(submit(3, 0, 0) == 1);
+  CHECK(submit(3, 5, 0) == 0);
+  CHECK(unstreamed == 0);
+  CHECK(submit(4, 0, 0) == 1);
+  CHECK(submit(4, 5, 0) == 1);
+  CHECK(unstreamed == 2);
+}
+
+int main(void) {
+  test_suppression();
+  test_heartbeat();
+  test_saturation();
+  test_passing_through();
+  CHECK(queued_count <= MAX_QUEUED);
+  return test_exit();
+}
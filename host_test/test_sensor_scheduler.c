@@ -0,0 +1,407 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+// Timing of sensor_scheduler.c under load, on the fake clock of fake_rtos.c:
+// the DS18B20 driver with a dozen probes on a fake 1-Wire bus (fake_onewire.h)
+// next to 254 virtual sensors fills the driver table. Checks that
+//
+//  - every sample starts no earlier than its deadline, and no later than a
+//    tick plus the work that can be queued ahead of it,
+//  - fixed-rate schedules don't drift: every period gets its sample, except
+//    those of a sensor whose samples take longer than its interval,
+//  - DS18B20 readouts are collected once the conversion time of the
+//    slowest resolution has passed, never before (the fake probes count
+//    early reads), carry the time of the trigger, and follow a resolution
+//    change made at run time.
+
+#include "host_test.h"
+
+#include "deferred_log.h"
+#include "esp_timer.h"
+#include "fake_onewire.h"
+#include "fake_rtos.h"
+#include "freertos/FreeRTOS.h"
+#include "metrics.h"
+#include "readout_pipeline.h"
+#include "sensor_descriptors.h"
+#include "sensor_manager_ds18b20.h"
+#include "sensor_scheduler.h"
+#include "types.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define RUN_US (120 * 1000000ll)
+#define TICK_US ((int64_t)portTICK_PERIOD_MS * 1000)
+#define DS18B20_PROBES 12
+#define VIRTUAL_SENSORS (CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS - 1)
+#define DRIVER_COUNT (VIRTUAL_SENSORS + 1)
+
+// the work a virtual sensor does when starting and collecting a sample
+#define START_COST_US 20
+#define COLLECT_COST_US 60
+
+// the sensor that switches the probes to 9 bits, and when
+#define SWITCHER 7
+#define SWITCH_AT_US (RUN_US / 2)
+
+// a sensor whose samples take longer than its interval
+#define SLOW_SENSOR 100
+#define SLOW_INTERVAL_MS 1000
+#define SLOW_COLLECT_MS 1500
+
+typedef struct {
+  int64_t first_deadline_us; // from schedule_start_us
+  uint32_t collect_delay_ms;
+  int64_t started_us; // start of the running sample
+  unsigned starts;
+  unsigned collects;
+  int64_t max_lateness_us;
+  int64_t min_lateness_us;
+  bool early_collect; // collected before its delay had passed
+} VirtualSensor;
+
+static SensorDriver virtual_drivers[VIRTUAL_SENSORS];
+static VirtualSensor virtual_sensors[VIRTUAL_SENSORS];
+
+static const uint32_t intervals_ms[] = {100, 250, 500, 1000, 2000};
+static const uint32_t collect_delays_ms[] = {0, 10, 50};
+
+// when the last driver was initialized, which the schedule counts from
+static int64_t schedule_start_us = 0;
+// lateness of every sample start, in 1 ms buckets
+static unsigned lateness_histogram[1000];
+static int64_t longest_callback_us = 0;
+static int64_t switched_at_us = -1;
+
+// The deadline the scheduler gives the first sample of the driver registered
+// at @p index: spread over its interval from the schedule start
+static int64_t first_deadline(const size_t index, const uint32_t interval_ms) {
+  return (int64_t)interval_ms * 1000 * (int64_t)index / DRIVER_COUNT;
+}
+
+// How late a sample started at @p now is, on the fixed-rate grid
+static int64_t lateness(const int64_t now, const int64_t first_deadline_us,
+                        const uint32_t interval_ms) {
+  return (now - schedule_start_us - first_deadline_us) %
+         ((int64_t)interval_ms * 1000);
+}
+
+static void record_lateness(const int64_t lateness_us) {
+  size_t bucket = (size_t)(lateness_us / 1000);
+  if (bucket >= sizeof(lateness_histogram) / sizeof(lateness_histogram[0]))
+    bucket = sizeof(lateness_histogram) / sizeof(lateness_histogram[0]) - 1;
+  lateness_histogram[bucket]++;
+}
+
+static void measure_callback(const int64_t started_us) {
+  const int64_t duration = esp_timer_get_time() - started_us;
+  if (duration > longest_callback_us)
+    longest_callback_us = duration;
+}
+
+static esp_err_t virtual_init(const SensorDriver *driver) {
+  (void)driver;
+  // the virtual sensors are registered last
+  schedule_start_us = esp_timer_get_time();
+  return ESP_OK;
+}
+
+static esp_err_t virtual_start_sample(const SensorDriver *driver,
+                                      uint32_t *collect_delay_ms) {
+  VirtualSensor *sensor = driver->context;
+  const int64_t now = esp_timer_get_time();
+  const int64_t late =
+      lateness(now, sensor->first_deadline_us, driver->interval_ms);
+  if (sensor->starts == 0 || late > sensor->max_lateness_us)
+    sensor->max_lateness_us = late;
+  if (sensor->starts == 0 || late < sensor->min_lateness_us)
+    sensor->min_lateness_us = late;
+  record_lateness(late);
+  sensor->starts++;
+  sensor->started_us = now;
+
+  if (sensor == &virtual_sensors[SWITCHER] && switched_at_us < 0 &&
+      now >= SWITCH_AT_US) {
+    // the faulty probe too, or it would keep the wait at 12 bits
+    for (uint8_t channel = 0; channel <= DS18B20_PROBES; channel++) {
+      CHECK(sensor_manager_ds18b20_set_resolution(
+                sensor_manager_ds18b20_get_address(channel),
+                DS18B20_RESOLUTION_9B) == ESP_OK);
+    }
+    switched_at_us = now;
+  }
+
+  fake_clock_advance(START_COST_US);
+  *collect_delay_ms = sensor->collect_delay_ms;
+  return ESP_OK;
+}
+
+static bool virtual_collect(const SensorDriver *driver) {
+  VirtualSensor *sensor = driver->context;
+  if (esp_timer_get_time() - sensor->started_us <
+      (int64_t)sensor->collect_delay_ms * 1000)
+    sensor->early_collect = true;
+  sensor->collects++;
+  fake_clock_advance(COLLECT_COST_US);
+  return false;
+}
+
+// The DS18B20 driver, wrapped to time its calls
+static SensorDriver ds18b20_driver;
+static int64_t ds18b20_trigger_us = -1;
+static ReadoutTime ds18b20_trigger_time;
+static unsigned ds18b20_triggers = 0;
+static unsigned ds18b20_collects = 0; // finished, all probes read
+static bool ds18b20_collecting = false;
+static int64_t ds18b20_max_lateness_us = 0;
+static int64_t ds18b20_min_wait_us[2] = {INT64_MAX, INT64_MAX};
+static int64_t ds18b20_max_wait_us[2] = {0, 0};
+static unsigned ds18b20_readouts = 0;
+static bool ds18b20_readout_mismatch = false;
+
+static esp_err_t ds18b20_start_sample(const SensorDriver *driver,
+                                      uint32_t *collect_delay_ms) {
+  const int64_t now = esp_timer_get_time();
+  const int64_t late = lateness(now, 0, driver->interval_ms);
+  if (late > ds18b20_max_lateness_us)
+    ds18b20_max_lateness_us = late;
+  record_lateness(late);
+
+  const esp_err_t ret =
+      sensor_driver_ds18b20.start_sample(driver, collect_delay_ms);
+  measure_callback(now);
+  if (ret == ESP_OK) {
+    ds18b20_triggers++;
+    ds18b20_trigger_us = fake_onewire.last_conversion_us;
+    ds18b20_trigger_time = readout_pipeline_now();
+  }
+  return ret;
+}
+
+static bool ds18b20_collect(const SensorDriver *driver) {
+  const int64_t now = esp_timer_get_time();
+  if (!ds18b20_collecting) {
+    // the wait before and after the probes were switched to 9 bits
+    const int after_switch =
+        switched_at_us >= 0 && ds18b20_trigger_us > switched_at_us;
+    const int64_t wait = now - ds18b20_trigger_us;
+    if (wait < ds18b20_min_wait_us[after_switch])
+      ds18b20_min_wait_us[after_switch] = wait;
+    if (wait > ds18b20_max_wait_us[after_switch])
+      ds18b20_max_wait_us[after_switch] = wait;
+  }
+
+  ds18b20_collecting = sensor_driver_ds18b20.collect(driver);
+  measure_callback(now);
+  if (!ds18b20_collecting)
+    ds18b20_collects++;
+  return ds18b20_collecting;
+}
+
+// The rest of the firmware, as far as the driver sees it
+
+ReadoutTime readout_pipeline_now(void) {
+  const int64_t now = esp_timer_get_time();
+  return (ReadoutTime){.timestamp = (uint32_t)(now / 1000000),
+                       .subsecond = (uint8_t)(now % 1000000 *
+                                              READOUT_SUBSECOND_SCALE /
+                                              1000000),
+                       .flags = READOUT_FLAG_MONOTONIC};
+}
+
+void readout_pipeline_submit(const UniversalSingleReadout *readout) {
+  ds18b20_readouts++;
+  const uint64_t address = sensor_manager_ds18b20_get_address(readout->channel);
+  float temperature = 0;
+  for (unsigned i = 0; i < fake_onewire.device_count; i++) {
+    if (fake_onewire.devices[i].address == address)
+      temperature = fake_onewire.devices[i].temperature;
+  }
+  if (readout->descriptor != SENSOR_DESCRIPTOR_DS18B20 ||
+      readout->value != readout_value_to_fixed(temperature) ||
+      readout->timestamp != ds18b20_trigger_time.timestamp ||
+      readout->subsecond != ds18b20_trigger_time.subsecond ||
+      !(readout->flags & READOUT_FLAG_MONOTONIC))
+    ds18b20_readout_mismatch = true;
+}
+
+void metrics_count(const MetricCounter counter) { (void)counter; }
+
+void metrics_record(const MetricHistogram histogram, const uint32_t value) {
+  (void)histogram;
+  (void)value;
+}
+
+void deferred_log_write(const esp_log_level_t level,
+                        const DeferredLogFormat format, const uint32_t *args,
+                        const size_t arg_count) {
+  (void)level;
+  (void)format;
+  (void)args;
+  (void)arg_count;
+}
+
+static void set_up(void) {
+  for (unsigned i = 0; i < DS18B20_PROBES; i++) {
+    fake_onewire_add(0x28000000000000A0ull + i, true, 18.0f + 0.5f * i);
+    if (i == 5) {
+      // not a DS18B20, the driver leaves it alone
+      fake_onewire_add(0x1000000000000042ull, false, 0);
+    }
+  }
+  // found, but every read fails
+  fake_onewire_add(0x28000000000000FFull, true, 0)->faulty = true;
+
+  ds18b20_driver = sensor_driver_ds18b20;
+  ds18b20_driver.start_sample = ds18b20_start_sample;
+  ds18b20_driver.collect = ds18b20_collect;
+  CHECK(sensor_scheduler_register(&ds18b20_driver) == ESP_OK);
+
+  for (size_t i = 0; i < VIRTUAL_SENSORS; i++) {
+    VirtualSensor *sensor = &virtual_sensors[i];
+    SensorDriver *driver = &virtual_drivers[i];
+    *driver = (SensorDriver){
+        .name = "virtual",
+        .interval_ms = intervals_ms[i % (sizeof(intervals_ms) /
+                                         sizeof(intervals_ms[0]))],
+        .context = sensor,
+        .init = virtual_init,
+        .start_sample = virtual_start_sample,
+        .collect = virtual_collect,
+    };
+    sensor->collect_delay_ms = collect_delays_ms[i % 3];
+    if (i == SLOW_SENSOR) {
+      driver->interval_ms = SLOW_INTERVAL_MS;
+      sensor->collect_delay_ms = SLOW_COLLECT_MS;
+    }
+    sensor->first_deadline_us = first_deadline(i + 1, driver->interval_ms);
+    CHECK(sensor_scheduler_register(driver) == ESP_OK);
+  }
+
+  // the table is full
+  CHECK(sensor_scheduler_register(&virtual_drivers[0]) == ESP_ERR_NO_MEM);
+}
+
+// Percentile of the sample start lateness, in milliseconds
+static unsigned lateness_percentile(const double fraction,
+                                    const unsigned total) {
+  unsigned seen = 0;
+  for (unsigned i = 0; i < sizeof(lateness_histogram) / sizeof(unsigned); i++) {
+    seen += lateness_histogram[i];
+    if (seen >= fraction * total)
+      return i + 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  set_up();
+  const int64_t ended = fake_rtos_run(sensor_scheduler, NULL, RUN_US);
+  CHECK(ended <= RUN_US);
+
+  SensorSchedulerStats stats;
+  sensor_scheduler_get_stats(&stats);
+
+  // a sample is at most a tick late, plus a long callback that started
+  // right before its deadline and one round of everything else
+  const int64_t bound_us =
+      TICK_US + longest_callback_us +
+      VIRTUAL_SENSORS * (START_COST_US + COLLECT_COST_US);
+
+  unsigned total_starts = ds18b20_triggers;
+  unsigned expected_skips = 0;
+  unsigned allowed_extra_skips = 0;
+  for (size_t i = 0; i < VIRTUAL_SENSORS; i++) {
+    const VirtualSensor *sensor = &virtual_sensors[i];
+    const int64_t interval_us = (int64_t)virtual_drivers[i].interval_ms * 1000;
+    total_starts += sensor->starts;
+
+    CHECK(sensor->min_lateness_us >= 0);
+    CHECK(sensor->max_lateness_us <= bound_us);
+    CHECK(!sensor->early_collect);
+    CHECK(sensor->collects + 1 >= sensor->starts &&
+          sensor->collects <= sensor->starts);
+
+    // a sample in every period up to the end of the run, give or take the
+    // last one. The longest callback (the DS18B20 resolution switch) may
+    // cost a sensor with a shorter interval one more.
+    const unsigned lost = interval_us <= longest_callback_us ? 1 : 0;
+    const unsigned periods =
+        (unsigned)((RUN_US - schedule_start_us - sensor->first_deadline_us) /
+                   interval_us) +
+        1;
+    if (i == SLOW_SENSOR) {
+      // every other period is skipped while the last sample still runs
+      CHECK(sensor->starts >= periods / 2 && sensor->starts <= periods / 2 + 1);
+      expected_skips += periods - sensor->starts;
+    } else {
+      CHECK(sensor->starts + 1 + lost >= periods && sensor->starts <= periods);
+      allowed_extra_skips += lost;
+      if (sensor->starts + 1 + lost < periods || sensor->starts > periods) {
+        fprintf(stderr, "virtual sensor %zu: %u samples in %u periods\n", i,
+                sensor->starts, periods);
+      }
+    }
+  }
+  CHECK(stats.samples == total_starts);
+  CHECK(stats.skipped + 1 >= expected_skips &&
+        stats.skipped <= expected_skips + 1 + allowed_extra_skips);
+  CHECK(stats.max_lateness_us <= bound_us);
+
+  // DS18B20: one conversion for the whole bus each interval
+  const int64_t ds18b20_interval_us = ds18b20_driver.interval_ms * 1000ll;
+  CHECK(ds18b20_triggers >= RUN_US / ds18b20_interval_us);
+  CHECK(fake_onewire.conversions == ds18b20_triggers);
+  CHECK(ds18b20_collects + 1 >= ds18b20_triggers);
+  CHECK(ds18b20_max_lateness_us <= bound_us);
+  CHECK(ds18b20_readouts == ds18b20_collects * DS18B20_PROBES);
+  CHECK(!ds18b20_readout_mismatch);
+  for (unsigned i = 0; i < fake_onewire.device_count; i++) {
+    const FakeProbe *probe = &fake_onewire.devices[i];
+    CHECK(probe->early_reads == 0);
+    if (probe->ds18b20) {
+      CHECK(probe->reads == ds18b20_collects);
+    } else {
+      CHECK(probe->reads == 0);
+    }
+  }
+  // 12 bits until the switch, 9 bits after it, each collected in time
+  CHECK(switched_at_us >= SWITCH_AT_US);
+  CHECK(ds18b20_min_wait_us[0] >=
+        fake_ds18b20_conversion_us(DS18B20_RESOLUTION_12B));
+  CHECK(ds18b20_max_wait_us[0] <=
+        fake_ds18b20_conversion_us(DS18B20_RESOLUTION_12B) + bound_us);
+  CHECK(ds18b20_min_wait_us[1] >=
+        fake_ds18b20_conversion_us(DS18B20_RESOLUTION_9B));
+  CHECK(ds18b20_max_wait_us[1] <=
+        fake_ds18b20_conversion_us(DS18B20_RESOLUTION_9B) + bound_us);
+  for (unsigned i = 0; i < fake_onewire.device_count; i++) {
+    if (fake_onewire.devices[i].ds18b20)
+      CHECK(fake_onewire.devices[i].resolution == DS18B20_RESOLUTION_9B);
+  }
+
+  printf("%d drivers, %u samples (%u skipped) in %lld s\n", DRIVER_COUNT,
+         stats.samples, stats.skipped, (long long)(RUN_US / 1000000));
+  printf("start lateness: mean %lld us, p50 <= %u ms, p99 <= %u ms, "
+         "max %lld us (bound %lld us)\n",
+         (long long)(stats.total_lateness_us / stats.events),
+         lateness_percentile(0.5, total_starts),
+         lateness_percentile(0.99, total_starts),
+         (long long)stats.max_lateness_us, (long long)bound_us);
+  printf("DS18B20: %u conversions, collected after %lld-%lld ms at 12 bits, "
+         "%lld-%lld ms at 9 bits\n",
+         ds18b20_triggers, (long long)ds18b20_min_wait_us[0] / 1000,
+         (long long)ds18b20_max_wait_us[0] / 1000,
+         (long long)ds18b20_min_wait_us[1] / 1000,
+         (long long)ds18b20_max_wait_us[1] / 1000);
+  printf("longest callback: %lld us\n", (long long)longest_callback_us);
+  return test_exit();
+}
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "deferred_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct {
+  const char *tag;
+  const char *format; // printf format, taking only 32-bit arguments
+} DeferredLogFormatInfo;
+
+static const DeferredLogFormatInfo formats[DLOG_FORMAT_COUNT] = {
+    [DLOG_DS18B20_READOUT] = {"sensor_manager_ds18b20",
+                              "READOUT -> DS18B20 #%" PRIu32 " %08" PRIX32
+                              "%08" PRIX32 ": %" PRIi32 " (1/10000 C)"},
+    [DLOG_QUEUE_FULL] = {"readout_pipeline",
+                         "Queue full, dropping readout of sensor %" PRIu32
+                         " channel %" PRIu32 "!"},
+    [DLOG_MQTT_EVENT] = {"mqtt_manager",
+                         "Event dispatched from event loop, event_id=%" PRIi32},
+    [DLOG_MQTT_PUBLISHED] = {"mqtt_manager",
+                             "Published a message to an MQTT topic: "
+                             "msg_id=%" PRIi32},
+};
+
+static const char level_letters[] = {
+    [ESP_LOG_NONE] = 'N',  [ESP_LOG_ERROR] = 'E', [ESP_LOG_WARN] = 'W',
+    [ESP_LOG_INFO] = 'I',  [ESP_LOG_DEBUG] = 'D', [ESP_LOG_VERBOSE] = 'V',
+};
+
+// Formats a record and writes it to the log output as ESP_LOG*() would
+static void print_record(const DeferredLogRecord *record) {
+  const DeferredLogFormatInfo *info = &formats[record->format];
+  const uint32_t *args = record->args;
+  char message[128];
+  // unused arguments are zero and ignored by the format
+  snprintf(message, sizeof(message), info->format, args[0], args[1], args[2],
+           args[3]);
+  esp_log_write((esp_log_level_t)record->level, info->tag,
+                "%c (%" PRIu32 ") %s: %s\n", level_letters[record->level],
+                record->time_ms, info->tag, message);
+}
+
+#if CONFIG_DEFERRED_LOG
+// Multiple producers (any task) and a single consumer (the deferred_log
+// task). Producers reserve and fill their slot within ring_lock, which only
+// covers a 24 byte copy. The consumer copies records out under the same lock
+// and formats them outside of it.
+static DeferredLogRecord ring[CONFIG_DEFERRED_LOG_RING_SIZE];
+static size_t ring_head = 0; // next slot to write
+static size_t ring_count = 0;
+static uint32_t records_dropped = 0;
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+void deferred_log_write(const esp_log_level_t level,
+                        const DeferredLogFormat format, const uint32_t *args,
+                        const size_t arg_count) {
+  DeferredLogRecord record = {.time_ms = esp_log_timestamp(),
+                              .format = (uint8_t)format,
+                              .level = (uint8_t)level,
+                              .arg_count = (uint8_t)arg_count};
+  for (size_t i = 0; i < arg_count && i < DEFERRED_LOG_MAX_ARGS; i++) {
+    record.args[i] = args[i];
+  }
+
+#if CONFIG_DEFERRED_LOG
+  portENTER_CRITICAL(&ring_lock);
+  if (ring_count == CONFIG_DEFERRED_LOG_RING_SIZE) {
+    records_dropped++;
+  } else {
+    ring[ring_head] = record;
+    ring_head = (ring_head + 1) % CONFIG_DEFERRED_LOG_RING_SIZE;
+    ring_count++;
+  }
+  portEXIT_CRITICAL(&ring_lock);
+#else
+  print_record(&record);
+#endif
+}
+
+void deferred_log(void *pvParameters) {
+#if CONFIG_DEFERRED_LOG
+  // ReSharper disable once CppDFAEndlessLoop
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_DEFERRED_LOG_FLUSH_MS));
+
+    while (1) {
+      DeferredLogRecord record;
+      uint32_t dropped;
+      portENTER_CRITICAL(&ring_lock);
+      const bool empty = ring_count == 0;
+      if (!empty) {
+        const size_t tail = (ring_head + CONFIG_DEFERRED_LOG_RING_SIZE -
+                             ring_count) %
+                            CONFIG_DEFERRED_LOG_RING_SIZE;
+        record = ring[tail];
+        ring_count--;
+      }
+      dropped = records_dropped;
+      records_dropped = 0;
+      portEXIT_CRITICAL(&ring_lock);
+
+      if (dropped > 0) {
+        esp_log_write(ESP_LOG_WARN, "deferred_log",
+                      "W (%" PRIu32 ") deferred_log: %" PRIu32
+                      " record(s) dropped, the ring was full\n",
+                      esp_log_timestamp(), dropped);
+      }
+      if (empty)
+        break;
+      print_record(&record);
+    }
+  }
+#else
+  // records are printed right away, nothing to do here
+  vTaskDelete(NULL);
+#endif
+}
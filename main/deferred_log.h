@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _DEFERRED_LOG_H
+#define _DEFERRED_LOG_H
+
+#include "esp_log.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Deferred logging for the hot paths. Instead of formatting a message and
+// waiting on the UART in place, DLOG() stores a binary record (the ID of a
+// format from the table in deferred_log.c plus up to DEFERRED_LOG_MAX_ARGS
+// raw 32-bit arguments) in a RAM ring, and the deferred_log task formats
+// the records later at the lowest priority. A record is a fixed-size
+// DeferredLogRecord, so a host-side decoder needs nothing but the format
+// table to read a ring dumped from RAM.
+//
+// Levels are gated at compile time against LOG_LOCAL_LEVEL, the same
+// per-file setting ESP_LOG*() uses, and at run time against the tag's
+// esp_log_level_set() level when the record is formatted. With
+// CONFIG_DEFERRED_LOG off, records are formatted right away instead.
+
+typedef enum {
+  DLOG_DS18B20_READOUT, // channel, address (high, low word), value (fixed)
+  DLOG_QUEUE_FULL,      // descriptor, channel
+  DLOG_MQTT_EVENT,      // event id
+  DLOG_MQTT_PUBLISHED,  // msg_id
+  DLOG_FORMAT_COUNT
+} DeferredLogFormat;
+
+#define DEFERRED_LOG_MAX_ARGS 4
+
+typedef struct {
+  uint32_t time_ms; // esp_log_timestamp() when recorded
+  uint8_t format;   // DeferredLogFormat
+  uint8_t level;    // esp_log_level_t
+  uint8_t arg_count;
+  uint8_t reserved;
+  uint32_t args[DEFERRED_LOG_MAX_ARGS];
+} DeferredLogRecord;
+
+_Static_assert(sizeof(DeferredLogRecord) == 24,
+               "DeferredLogRecord layout changed, update the host-side decoder");
+
+/**
+ * @brief Records a log message.
+ *
+ * Use DLOG() instead, which skips the call entirely for levels above
+ * LOG_LOCAL_LEVEL. Safe to call from any task, never blocks: if the ring is
+ * full the record is dropped and counted.
+ */
+void deferred_log_write(esp_log_level_t level, DeferredLogFormat format,
+                        const uint32_t *args, size_t arg_count);
+
+// Task function that formats the recorded messages
+void deferred_log(void *pvParameters);
+
+// Records a message of the given format, with 1 to DEFERRED_LOG_MAX_ARGS
+// arguments that each convert to uint32_t
+#define DLOG(level, format, ...)                                               \
+  do {                                                                         \
+    if ((level) <= LOG_LOCAL_LEVEL) {                                          \
+      const uint32_t dlog_args[] = {__VA_ARGS__};                              \
+      _Static_assert(sizeof(dlog_args) <=                                      \
+                         DEFERRED_LOG_MAX_ARGS * sizeof(uint32_t),             \
+                     "too many deferred log arguments");                       \
+      deferred_log_write(level, format, dlog_args,                             \
+                         sizeof(dlog_args) / sizeof(dlog_args[0]));            \
+    }                                                                          \
+  } while (0)
+
+#endif //_DEFERRED_LOG_H
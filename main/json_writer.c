@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include "json_writer.h"
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void json_writer_init(JsonWriter *writer, char *buffer,
+                      const size_t capacity) {
+  writer->buffer = buffer;
+  writer->capacity = capacity;
+  writer->length = 0;
+  writer->overflow = capacity == 0;
+  writer->need_comma = false;
+}
+
+size_t json_writer_remaining(const JsonWriter *writer) {
+  if (writer->overflow || writer->length + 1 >= writer->capacity)
+    return 0;
+  return writer->capacity - writer->length - 1;
+}
+
+static void append(JsonWriter *writer, const char *data, const size_t len) {
+  if (writer->overflow)
+    return;
+  // always keep one byte for the null terminator
+  if (len > json_writer_remaining(writer)) {
+    writer->overflow = true;
+    return;
+  }
+  memcpy(writer->buffer + writer->length, data, len);
+  writer->length += len;
+}
+
+static void append_char(JsonWriter *writer, const char c) {
+  append(writer, &c, 1);
+}
+
+// Same escaping rules as cJSON's print_string_ptr()
+static void append_quoted(JsonWriter *writer, const char *str) {
+  append_char(writer, '"');
+  for (const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++) {
+    switch (*p) {
+    case '"':
+      append(writer, "\\\"", 2);
+      break;
+    case '\\':
+      append(writer, "\\\\", 2);
+      break;
+    case '\b':
+      append(writer, "\\b", 2);
+      break;
+    case '\f':
+      append(writer, "\\f", 2);
+      break;
+    case '\n':
+      append(writer, "\\n", 2);
+      break;
+    case '\r':
+      append(writer, "\\r", 2);
+      break;
+    case '\t':
+      append(writer, "\\t", 2);
+      break;
+    default:
+      if (*p < 32) {
+        char escaped[7];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+        append(writer, escaped, 6);
+      } else {
+        append_char(writer, (char)*p);
+      }
+      break;
+    }
+  }
+  append_char(writer, '"');
+}
+
+// Writes the separating comma and the key (if any) of the next value
+static void begin_value(JsonWriter *writer, const char *key) {
+  if (writer->need_comma)
+    append_char(writer, ',');
+  if (key != NULL) {
+    append_quoted(writer, key);
+    append_char(writer, ':');
+  }
+}
+
+void json_writer_begin_object(JsonWriter *writer, const char *key) {
+  begin_value(writer, key);
+  append_char(writer, '{');
+  writer->need_comma = false;
+}
+
+void json_writer_end_object(JsonWriter *writer) {
+  append_char(writer, '}');
+  writer->need_comma = true;
+}
+
+void json_writer_begin_array(JsonWriter *writer, const char *key) {
+  begin_value(writer, key);
+  append_char(writer, '[');
+  writer->need_comma = false;
+}
+
+void json_writer_end_array(JsonWriter *writer) {
+  append_char(writer, ']');
+  writer->need_comma = true;
+}
+
+void json_writer_add_string(JsonWriter *writer, const char *key,
+                            const char *value) {
+  begin_value(writer, key);
+  append_quoted(writer, value);
+  writer->need_comma = true;
+}
+
+// Same tolerance as cJSON's compare_double()
+static bool nearly_equal(const double a, const double b) {
+  const double max_val = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+  return fabs(a - b) <= max_val * DBL_EPSILON;
+}
+
+// Same number formatting as cJSON's print_number(): integers are printed as
+// such, everything else with 15 significant digits, or 17 if 15 don't survive
+// a round trip.
+void json_writer_add_number(JsonWriter *writer, const char *key,
+                            const double value) {
+  char number[26];
+  int len;
+
+  if (isnan(value) || isinf(value)) {
+    len = snprintf(number, sizeof(number), "null");
+  } else if (value >= INT_MIN && value <= INT_MAX &&
+             value == (double)(int)value) {
+    len = snprintf(number, sizeof(number), "%d", (int)value);
+  } else {
+    len = snprintf(number, sizeof(number), "%1.15g", value);
+    if (!nearly_equal(strtod(number, NULL), value)) {
+      len = snprintf(number, sizeof(number), "%1.17g", value);
+    }
+  }
+
+  begin_value(writer, key);
+  append(writer, number, (size_t)len);
+  writer->need_comma = true;
+}
+
+void json_writer_add_members(JsonWriter *writer, const char *members,
+                             const size_t length) {
+  if (length == 0)
+    return;
+  if (writer->need_comma)
+    append_char(writer, ',');
+  append(writer, members, length);
+  writer->need_comma = true;
+}
+
+bool json_writer_finish(JsonWriter *writer) {
+  if (writer->overflow)
+    return false;
+  writer->buffer[writer->length] = '\0';
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef _JSON_WRITER_H
+#define _JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Streaming JSON writer that formats straight into a caller-provided
+ * buffer, without any heap allocations.
+ *
+ * The output is byte-for-byte what cJSON_PrintUnformatted() would produce for
+ * the same sequence of objects, arrays, strings and numbers. Once the buffer
+ * runs out of space the writer stops writing and sets @c overflow, so the
+ * calls can be chained without checking each one. The writer is a plain
+ * struct, so a copy of it can be used as a checkpoint to roll back to.
+ */
+typedef struct {
+  char *buffer;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+  bool need_comma;
+} JsonWriter;
+
+void json_writer_init(JsonWriter *writer, char *buffer, size_t capacity);
+
+// Pass NULL as the key for the root value or for array elements.
+
+void json_writer_begin_object(JsonWriter *writer, const char *key);
+void json_writer_end_object(JsonWriter *writer);
+void json_writer_begin_array(JsonWriter *writer, const char *key);
+void json_writer_end_array(JsonWriter *writer);
+void json_writer_add_string(JsonWriter *writer, const char *key,
+                            const char *value);
+void json_writer_add_number(JsonWriter *writer, const char *key,
+                            double value);
+
+/**
+ * @brief Appends members (or array elements) that were serialized ahead of
+ * time, e.g. by another writer that was never given an object or array to
+ * begin with, which produces a bare "key":value,"key":value list.
+ */
+void json_writer_add_members(JsonWriter *writer, const char *members,
+                             size_t length);
+
+/**
+ * @brief Gets the number of bytes still available, keeping room for the null
+ * terminator.
+ */
+size_t json_writer_remaining(const JsonWriter *writer);
+
+/**
+ * @brief Null-terminates the output.
+ *
+ * @return true if everything fit in the buffer, false if it overflowed (in
+ * which case the contents of the buffer must not be used).
+ */
+bool json_writer_finish(JsonWriter *writer);
+
+#endif //_JSON_WRITER_H
@@ -7,6 +7,7 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
+#include "deferred_log.h"
 #include "device_id.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
@@ -14,9 +15,16 @@
 #include "mqtt_manager.h"
 #include "ntp_manager.h"
 #include "nvs_flash.h"
+#include "publish_context.h"
+#include "resource_profiler.h"
+#include "sensor_driver_mock.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "sensor_manager_ds18b20.h"
+#else
+#include "sim_link.h"
+#endif
+#include "sensor_scheduler.h"
 #include "system_state.h"
-#include "timer_manager.h"
 #include "wifi_manager.h"
 
 #include <time.h>
@@ -36,12 +44,28 @@ void app_main(void) {
 
   // initialize the device id
   device_id_init();
+  publish_context_init();
 
   system_state_init();
+  // restore the clock from before a warm reset, if any, so sampling starts
+  // with real timestamps
+  ntp_manager_init();
 
   // attempt to start wifi stuff
   wifi_connect();
 
+#if CONFIG_DEFERRED_LOG
+  // start the deferred_log task, at the lowest priority so formatting log
+  // messages never holds up sampling or publishing
+  TaskHandle_t deferred_log_handle;
+  if (xTaskCreate(deferred_log, "deferred_log", CONFIG_DEFERRED_LOG_STACK_SIZE,
+                  NULL, tskIDLE_PRIORITY, &deferred_log_handle) != pdPASS) {
+    ESP_LOGE(TAG, "FATAL: Failed to create the deferred_log task!");
+    abort();
+  }
+#endif
+
+#if !CONFIG_IDF_TARGET_LINUX
   // start the ntp_manager task
   TaskHandle_t ntp_manager_handle;
   if (xTaskCreate(ntp_manager, "ntp_manager", CONFIG_NTP_MANAGER_STACK_SIZE,
@@ -49,13 +73,18 @@ void app_main(void) {
     ESP_LOGE(TAG, "FATAL: Failed to create the ntp_manager task!");
     abort();
   };
-
-  // start the sensor_manager_ds18b20 task
-  TaskHandle_t sensor_manager_handle;
-  if (xTaskCreate(sensor_manager_ds18b20, "sensor_manager_ds18b20",
-                  CONFIG_SENSOR_MANAGER_DS18B20_STACK_SIZE, NULL, 2,
-                  &sensor_manager_handle) != pdPASS) {
-    ESP_LOGE(TAG, "FATAL: Failed to create the sensor_manager_ds18b20 task!");
+#endif
+
+  // register the sensor drivers and start the sensor_scheduler task
+#if !CONFIG_IDF_TARGET_LINUX
+  sensor_scheduler_register(&sensor_driver_ds18b20);
+#endif
+  sensor_driver_mock_register();
+  TaskHandle_t sensor_scheduler_handle;
+  if (xTaskCreate(sensor_scheduler, "sensor_scheduler",
+                  CONFIG_SENSOR_SCHEDULER_STACK_SIZE, NULL, 2,
+                  &sensor_scheduler_handle) != pdPASS) {
+    ESP_LOGE(TAG, "FATAL: Failed to create the sensor_scheduler task!");
     abort();
   }
 
@@ -67,19 +96,17 @@ void app_main(void) {
     abort();
   };
 
-  // setup and start the readout timer
-  setup_readout_timer();
-
-  // ReSharper disable once CppDFAEndlessLoop
-  while (1) {
-    const size_t total_heap = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
-    const size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
-    const size_t used_heap = total_heap - free_heap;
-
-    const float percentage_used = (float)used_heap / (float)total_heap * 100.0f;
-
-    ESP_LOGW(TAG, "HEAP USAGE: (%d/%d) -> %.2f%c", used_heap, total_heap,
-             percentage_used, '%');
-    vTaskDelay(pdMS_TO_TICKS(500));
+#if CONFIG_IDF_TARGET_LINUX
+  // take the simulated broker link down and up again as configured, and
+  // end the scenario with a report
+  TaskHandle_t sim_link_handle;
+  if (xTaskCreate(sim_link, "sim_link", CONFIG_SIM_LINK_STACK_SIZE, NULL, 1,
+                  &sim_link_handle) != pdPASS) {
+    ESP_LOGE(TAG, "FATAL: Failed to create the sim_link task!");
+    abort();
   }
-}
\ No newline at end of file
+#endif
+
+  // keep an eye on the heap and the task stacks from here on
+  resource_profiler_run();
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "metrics.h"
+
+#include "esp_timer.h"
+#include "outbox_pool.h"
+#include "publish_window.h"
+#include "readout_log.h"
+#include "sensor_scheduler.h"
+#include "system_state.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+static atomic_uint counters[METRIC_COUNTER_COUNT];
+static atomic_uint histograms[METRIC_HISTOGRAM_COUNT]
+                             [METRICS_HISTOGRAM_BUCKETS];
+static atomic_uint histogram_max[METRIC_HISTOGRAM_COUNT];
+
+static const char *const counter_names[METRIC_COUNTER_COUNT] = {
+    [METRIC_READOUTS_QUEUED] = "queued",
+    [METRIC_READOUTS_RECEIVED] = "received",
+    [METRIC_READOUTS_UNSTREAMED] = "unstreamed",
+    [METRIC_SENSOR_READS] = "reads",
+    [METRIC_SENSOR_READ_ERRORS] = "read_errors",
+    [METRIC_READOUTS_PUBLISHED] = "published",
+    [METRIC_PUBLISH_FAILURES] = "publish_failures",
+    [METRIC_MQTT_CONNECTS] = "connects",
+    [METRIC_MQTT_DISCONNECTS] = "disconnects",
+    [METRIC_MQTT_ERRORS] = "mqtt_errors",
+};
+
+static const char *const histogram_names[METRIC_HISTOGRAM_COUNT] = {
+    [METRIC_CONVERSION_MS] = "conversion_ms",
+    [METRIC_SENSOR_READ_US] = "read_us",
+    [METRIC_PUBLISH_LATENCY_MS] = "latency_ms",
+};
+
+void metrics_count(const MetricCounter counter) {
+  atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+}
+
+void metrics_add(const MetricCounter counter, const uint32_t amount) {
+  atomic_fetch_add_explicit(&counters[counter], amount, memory_order_relaxed);
+}
+
+void metrics_record(const MetricHistogram histogram, const uint32_t value) {
+  // the bucket is the bit length of the value
+  size_t bucket = value == 0 ? 0 : 32 - (size_t)__builtin_clz(value);
+  if (bucket >= METRICS_HISTOGRAM_BUCKETS)
+    bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+  atomic_fetch_add_explicit(&histograms[histogram][bucket], 1,
+                            memory_order_relaxed);
+
+  unsigned max =
+      atomic_load_explicit(&histogram_max[histogram], memory_order_relaxed);
+  while (value > max &&
+         !atomic_compare_exchange_weak_explicit(&histogram_max[histogram],
+                                                &max, value,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+void metrics_snapshot(MetricsSnapshot *snapshot) {
+  for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+    snapshot->counters[i] =
+        atomic_load_explicit(&counters[i], memory_order_relaxed);
+  }
+  for (size_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+    for (size_t j = 0; j < METRICS_HISTOGRAM_BUCKETS; j++) {
+      snapshot->histograms[i].buckets[j] =
+          atomic_load_explicit(&histograms[i][j], memory_order_relaxed);
+    }
+    snapshot->histograms[i].max =
+        atomic_load_explicit(&histogram_max[i], memory_order_relaxed);
+  }
+}
+
+// Writes a histogram as [max, bucket 0, ...], leaving out the empty buckets
+// at the end
+static void write_histogram(JsonWriter *writer, const char *key,
+                            const uint32_t *buckets, const size_t count,
+                            const double max) {
+  size_t used = count;
+  while (used > 0 && buckets[used - 1] == 0)
+    used--;
+
+  json_writer_begin_array(writer, key);
+  json_writer_add_number(writer, NULL, max);
+  for (size_t i = 0; i < used; i++) {
+    json_writer_add_number(writer, NULL, buckets[i]);
+  }
+  json_writer_end_array(writer);
+}
+
+bool metrics_write_json(JsonWriter *writer) {
+  MetricsSnapshot snapshot;
+  ReadoutQueueStats queue;
+  SensorSchedulerStats scheduler;
+  PublishWindowStats window;
+  metrics_snapshot(&snapshot);
+  readout_queue_get_stats(&queue);
+  sensor_scheduler_get_stats(&scheduler);
+  publish_window_get_stats(&window);
+
+  json_writer_begin_object(writer, NULL);
+  json_writer_add_number(writer, "uptime", (double)(esp_timer_get_time() /
+                                                    1000000));
+
+  json_writer_begin_object(writer, "counters");
+  for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+    json_writer_add_number(writer, counter_names[i], snapshot.counters[i]);
+  }
+  json_writer_add_number(writer, "dropped", queue.dropped);
+  json_writer_add_number(writer, "coalesced", queue.coalesced);
+  json_writer_add_number(writer, "samples", scheduler.samples);
+  json_writer_add_number(writer, "skipped", scheduler.skipped);
+  json_writer_add_number(writer, "messages", window.published);
+  json_writer_add_number(writer, "acked", window.acked);
+  json_writer_add_number(writer, "lost", window.lost);
+  json_writer_end_object(writer);
+
+  json_writer_begin_object(writer, "gauges");
+  json_writer_add_number(writer, "queue_depth", queue.depth);
+  json_writer_add_number(writer, "in_flight", window.in_flight);
+  json_writer_add_number(writer, "log_pending", readout_log_pending());
+#if CONFIG_MQTT_CUSTOM_OUTBOX
+  OutboxPoolStats outbox;
+  outbox_pool_get_stats(&outbox);
+  json_writer_add_number(writer, "outbox_slots", outbox.in_use);
+  json_writer_add_number(writer, "outbox_peak", outbox.peak);
+  json_writer_add_number(writer, "outbox_heap_copies", outbox.heap_copies);
+#endif
+  json_writer_add_number(writer, "max_lateness_us",
+                         (double)scheduler.max_lateness_us);
+  json_writer_end_object(writer);
+
+  json_writer_begin_object(writer, "histograms");
+  for (size_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+    write_histogram(writer, histogram_names[i], snapshot.histograms[i].buckets,
+                    METRICS_HISTOGRAM_BUCKETS, snapshot.histograms[i].max);
+  }
+  // the publish window uses the same buckets, in milliseconds
+  write_histogram(writer, "puback_ms", window.latency_histogram,
+                  PUBLISH_LATENCY_BUCKETS,
+                  (double)(window.max_latency_us / 1000));
+  json_writer_end_object(writer);
+
+  json_writer_end_object(writer);
+  return !writer->overflow;
+}
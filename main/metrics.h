@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include "json_writer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Pipeline metrics: counters and fixed-bucket histograms that any task, or
+// the MQTT event handler, records into with a couple of relaxed atomic
+// operations and no locking. Everything counts up from boot, rates are left
+// to whoever reads the snapshots. The mqtt_manager task publishes a snapshot
+// every CONFIG_METRICS_PUBLISH_INTERVAL seconds on
+// "edlavp/<device-id>/metrics", together with the statistics the readout
+// queue, the sensor scheduler and the publish window keep themselves.
+
+typedef enum {
+  METRIC_READOUTS_QUEUED,    // readouts put on the readout queue
+  METRIC_READOUTS_RECEIVED,  // readouts taken off the readout queue
+  METRIC_READOUTS_UNSTREAMED, // readouts passed through the pipeline without
+                              // a stream, the stream table being full
+  METRIC_SENSOR_READS,       // DS18B20 probes (and mock sensors) read
+  METRIC_SENSOR_READ_ERRORS, // reads of those that failed
+  METRIC_READOUTS_PUBLISHED, // readouts handed to the MQTT client
+  METRIC_PUBLISH_FAILURES,   // readouts that failed to publish
+  METRIC_MQTT_CONNECTS,
+  METRIC_MQTT_DISCONNECTS,
+  METRIC_MQTT_ERRORS,
+  METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+  METRIC_CONVERSION_MS,      // DS18B20 conversion start to collect
+  METRIC_SENSOR_READ_US,     // reading back a single DS18B20 probe
+  METRIC_PUBLISH_LATENCY_MS, // sample time to handing it to the MQTT client
+  METRIC_HISTOGRAM_COUNT
+} MetricHistogram;
+
+// bucket 0 counts values of 0, bucket i values in [2^(i-1), 2^i), and the
+// last bucket everything larger
+#define METRICS_HISTOGRAM_BUCKETS 16
+
+typedef struct {
+  uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+  uint32_t max;
+} MetricsHistogramSnapshot;
+
+typedef struct {
+  uint32_t counters[METRIC_COUNTER_COUNT];
+  MetricsHistogramSnapshot histograms[METRIC_HISTOGRAM_COUNT];
+} MetricsSnapshot;
+
+void metrics_count(MetricCounter counter);
+void metrics_add(MetricCounter counter, uint32_t amount);
+void metrics_record(MetricHistogram histogram, uint32_t value);
+
+/**
+ * @brief Copies the current counters and histograms.
+ *
+ * Each value is read atomically, but the snapshot as a whole isn't: values
+ * recorded while it is taken may show up in some of it only.
+ */
+void metrics_snapshot(MetricsSnapshot *snapshot);
+
+/**
+ * @brief Writes a snapshot of every pipeline metric as a JSON object.
+ *
+ * Histograms are written as [max, bucket 0, bucket 1, ...] with the empty
+ * buckets at the end left out.
+ *
+ * @return false if the writer overflowed.
+ */
+bool metrics_write_json(JsonWriter *writer);
+
+#endif //_METRICS_H
@@ -9,11 +9,21 @@
 
 #include "mqtt_manager.h"
 
-#include "cJSON.h"
-#include "device_id.h"
+#include "deferred_log.h"
 #include "esp_netif.h"
-#include <inttypes.h>
+#include "json_writer.h"
+#include "metrics.h"
+#include "outbox_pool.h"
+#include "publish_context.h"
+#include "publish_window.h"
+#include "readout_aggregate.h"
+#include "readout_codec.h"
+#include "readout_log.h"
+#include "readout_pipeline.h"
+#include "sensor_descriptors.h"
+#include <stdatomic.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "esp_log.h"
 #include "mqtt_client.h"
@@ -25,26 +35,66 @@ static const char *TAG = "mqtt_manager";
 
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 
+// payloads are serialized here, esp-mqtt copies them into its outbox (a slot
+// of outbox_pool.c) when publishing so the buffer can be reused right away
+static char payload_buffer[CONFIG_MQTT_PAYLOAD_BUFFER_SIZE];
+
+#if CONFIG_MQTT_V5
+// Bumped by the event handler on every new connection, so the publishing
+// task knows to start over with the topic aliases
+static atomic_uint connection_count = 0;
+
+// The retained birth message, built once by mqtt_app_start()
+static char birth_buffer[CONFIG_MQTT_PAYLOAD_BUFFER_SIZE];
+static size_t birth_length = 0;
+
+// The publish properties are set on the client before every publish, so the
+// event handler must not send the birth message in between. The publishing
+// task raises publish_busy around the two calls, and if it was up the birth
+// message is left pending for the task to send right after.
+static atomic_bool publish_busy = false;
+static atomic_bool birth_pending = false;
+
+static void build_birth_message(void);
+static void publish_birth_message(void);
+#endif
+
 static void log_error_if_nonzero(const char *message, const int error_code) {
   if (error_code != 0) {
     ESP_LOGE(TAG, "Last error %s: 0x%x", message, error_code);
   }
 }
 
+// The publishing functions fail right away while the client is disconnected
+// instead of waiting for it, so the caller can keep the readouts in the log
+static bool mqtt_connected(void) {
+  return (system_get_bits() & SYS_BIT_MQTT_CONNECTED) != 0;
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
                                const int32_t event_id, void *event_data) {
-  ESP_LOGD(TAG,
-           "Event dispatched from event loop base=%s, event_id=%" PRIi32 "",
-           base, event_id);
+  DLOG(ESP_LOG_DEBUG, DLOG_MQTT_EVENT, (uint32_t)event_id);
   esp_mqtt_event_handle_t event = event_data;
   switch ((esp_mqtt_event_id_t)event_id) {
   case MQTT_EVENT_CONNECTED:
     ESP_LOGI(TAG, "Successfully connected to the MQTT broker.");
+    metrics_count(METRIC_MQTT_CONNECTS);
+#if CONFIG_MQTT_V5
+    atomic_fetch_add(&connection_count, 1);
+    // the handler runs with the client locked, so nothing can be published
+    // in between here
+    atomic_store(&birth_pending, true);
+    if (!atomic_load(&publish_busy) && atomic_exchange(&birth_pending, false))
+      publish_birth_message();
+#endif
+    publish_window_set_connected(true);
     system_set_bits(SYS_BIT_MQTT_CONNECTED);
     break;
 
   case MQTT_EVENT_DISCONNECTED:
     system_clear_bits(SYS_BIT_MQTT_CONNECTED);
+    publish_window_set_connected(false);
+    metrics_count(METRIC_MQTT_DISCONNECTS);
     ESP_LOGW(TAG, "Disconnected from MQTT broker... Will not publish anything "
                   "until reconnection.");
     break;
@@ -58,8 +108,13 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     break;
 
   case MQTT_EVENT_PUBLISHED:
-    ESP_LOGI(TAG, "Published a message to an MQTT topic: msg_id=%d",
-             event->msg_id);
+    DLOG(ESP_LOG_DEBUG, DLOG_MQTT_PUBLISHED, (uint32_t)event->msg_id);
+    publish_window_ack(event->msg_id);
+    break;
+
+  case MQTT_EVENT_DELETED:
+    // the client gave up on a message that sat in its outbox for too long
+    publish_window_lost(event->msg_id);
     break;
 
   case MQTT_EVENT_DATA:
@@ -70,6 +125,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
 
   case MQTT_EVENT_ERROR:
     ESP_LOGE(TAG, "MQTT_EVENT_ERROR");
+    metrics_count(METRIC_MQTT_ERRORS);
     if (event->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
       log_error_if_nonzero("reported from esp-tls",
                            event->error_handle->esp_tls_last_esp_err);
@@ -88,102 +144,877 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
   }
 }
 
+// The most the client's outbox may hold: a full pool of messages at their
+// largest. Since publishing stops once the window is full this is never
+// reached in normal operation, it keeps a stuck window from growing the
+// outbox (and, past the pool, the heap) without bound.
+#define MQTT_OUTBOX_LIMIT (OUTBOX_POOL_SLOTS * OUTBOX_POOL_SLOT_SIZE)
+
 void mqtt_app_start(void) {
   const esp_mqtt_client_config_t mqtt_cfg = {
       .broker.address.uri = CONFIG_MQTT_BROKER_URL,
       .credentials.username = CONFIG_MQTT_USERNAME,
-      .credentials.authentication.password = CONFIG_MQTT_PASSWORD};
+      .credentials.authentication.password = CONFIG_MQTT_PASSWORD,
+      .outbox.limit = MQTT_OUTBOX_LIMIT,
+#if CONFIG_MQTT_V5
+      .session.protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
+  };
 
   mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+#if CONFIG_MQTT_V5
+  build_birth_message();
+#endif
 
   ESP_ERROR_CHECK(esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID,
                                                  mqtt_event_handler, NULL));
+}
 
-  ESP_LOGI(TAG, "Waiting to connect to wifi first.");
-  system_wait_for_bits(SYS_BIT_GOT_IP | SYS_BIT_NTP_SYNCED, pdTRUE,
-                       portMAX_DELAY);
+// Starts the client once there is a network connection and a valid clock
+// (for the broker's certificate), waiting up to @p ticks_to_wait for them.
+// Returns whether it is started.
+static bool mqtt_start_when_ready(const TickType_t ticks_to_wait) {
+  static bool started = false;
+  if (started)
+    return true;
+
+  const EventBits_t ready = SYS_BIT_GOT_IP | SYS_BIT_TIME_VALID;
+  if ((system_wait_for_bits(ready, pdTRUE, ticks_to_wait) & ready) != ready)
+    return false;
   ESP_LOGI(TAG, "Will now attempt to connect to the MQTT broker.");
   ESP_ERROR_CHECK(esp_mqtt_client_start(mqtt_client));
+  started = true;
+  return true;
 }
 
-static void mqtt_publish_readout(const UniversalSingleReadout readout) {
-  system_wait_for_bits(SYS_BIT_MQTT_CONNECTED, pdTRUE, portMAX_DELAY);
-
-  cJSON *readout_obj = cJSON_CreateObject();
-  if (!readout_obj)
+#if CONFIG_IDF_TARGET_LINUX
+void mqtt_manager_set_link(const bool up) {
+  if (up) {
+    ESP_LOGW(TAG, "Simulated link is back up");
+    ESP_ERROR_CHECK(esp_mqtt_client_start(mqtt_client));
     return;
+  }
+  ESP_LOGW(TAG, "Simulated link is down");
+  ESP_ERROR_CHECK(esp_mqtt_client_stop(mqtt_client));
+  // stopping the client doesn't necessarily report a disconnection
+  system_clear_bits(SYS_BIT_MQTT_CONNECTED);
+  publish_window_set_connected(false);
+}
+#endif
+
+// Resolves the hardware address of the sensor a readout came from, 0 if the
+// sensor has none
+static uint64_t readout_address(const SensorDescriptor *descriptor,
+                                const UniversalSingleReadout *readout) {
+  if (descriptor->channel_address == NULL)
+    return 0;
+  return descriptor->channel_address(readout->channel);
+}
+
+#if CONFIG_MQTT_PUBLISH_JSON
+// State of the clock a readout was timestamped with
+static const char *readout_clock_state(const UniversalSingleReadout *readout) {
+  if (readout->flags & READOUT_FLAG_CLOCK_SYNCING)
+    return "syncing";
+  if (readout->flags & READOUT_FLAG_CLOCK_STALE)
+    return "stale";
+  return "synced";
+}
 
-  cJSON_AddNumberToObject(readout_obj, "value", readout.value);
-  cJSON_AddStringToObject(readout_obj, "sensor", readout.sensor_type);
-  cJSON_AddStringToObject(readout_obj, "unit", readout.unit);
+// Unix timestamp of a readout in seconds, with millisecond resolution
+static double readout_json_timestamp(const UniversalSingleReadout *readout) {
+  return (double)readout_time_to_unix_ms(readout) / 1000.0;
+}
 
-  cJSON *metadata = cJSON_CreateObject();
-  if (!metadata) {
-    ESP_LOGE(TAG, "Failed to build JSON string (OOM)");
+// Writes the readout object shared by the single and batch payloads. The
+// timestamp and clock state are only added here in batch mode (the clock
+// state only if it isn't "synced"), single readouts keep them in the metadata
+// object.
+static void write_readout_object(JsonWriter *writer, const char *key,
+                                 const PublishContext *context,
+                                 const UniversalSingleReadout *readout,
+                                 const bool with_timestamp) {
+  const uint64_t address = readout_address(context->descriptor, readout);
+
+  json_writer_begin_object(writer, key);
+  json_writer_add_number(writer, "value",
+                         readout_value_from_fixed(readout->value));
+  json_writer_add_members(writer, context->fields, context->fields_length);
+  if (address != 0) {
+    char address_string[17];
+    snprintf(address_string, sizeof(address_string), "%016llX", address);
+    json_writer_add_string(writer, "address", address_string);
+  }
+  const ReadoutSummary summary = readout_get_summary(readout);
+  if (readout->flags & READOUT_FLAG_AGGREGATE) {
+    json_writer_add_number(writer, "min", readout_min(readout, &summary));
+    json_writer_add_number(writer, "max", readout_max(readout, &summary));
+    json_writer_add_number(writer, "stddev",
+                           readout_spread_from_fixed(summary.stddev));
+    json_writer_add_number(writer, "samples", summary.samples);
+  }
+  if (summary.suppressed > 0) {
+    json_writer_add_number(writer, "suppressed", summary.suppressed);
+  }
+  if (with_timestamp) {
+    json_writer_add_number(writer, "timestamp",
+                           readout_json_timestamp(readout));
+    if (readout->flags &
+        (READOUT_FLAG_CLOCK_SYNCING | READOUT_FLAG_CLOCK_STALE)) {
+      json_writer_add_string(writer, "clock", readout_clock_state(readout));
+    }
+  }
+  json_writer_end_object(writer);
+}
+#endif
+
+#if CONFIG_MQTT_V5
+// Topic aliases (1 to CONFIG_MQTT_V5_TOPIC_ALIASES) handed out on the current
+// connection. An alias is registered with the broker by the first message
+// sent with both the topic and the alias, the ones after it can leave the
+// topic out.
+typedef struct {
+  const char *topic; // one of the topics in the publish contexts
+  bool registered;
+} TopicAlias;
+
+static TopicAlias topic_aliases[CONFIG_MQTT_V5_TOPIC_ALIASES];
+static size_t topic_alias_count = 0;
+static bool topic_aliases_enabled = true;
+static unsigned current_connection = 0;
+
+// Builds the retained birth message, which carries what every message used
+// to repeat: the device, and what its sensor topics hold
+static void build_birth_message(void) {
+  size_t device_length;
+  const char *device = publish_context_device_member(&device_length);
+
+  JsonWriter writer;
+  json_writer_init(&writer, birth_buffer, sizeof(birth_buffer));
+  json_writer_begin_object(&writer, NULL);
+  json_writer_add_members(&writer, device, device_length);
+  json_writer_begin_array(&writer, "sensors");
+  for (uint8_t id = 0; id < SENSOR_DESCRIPTOR_COUNT; id++) {
+    const PublishContext *context = publish_context_get(id);
+    json_writer_begin_object(&writer, NULL);
+    json_writer_add_string(&writer, "topic", context->descriptor->topic);
+    json_writer_add_members(&writer, context->fields, context->fields_length);
+    json_writer_end_object(&writer);
+  }
+  json_writer_end_array(&writer);
+  json_writer_end_object(&writer);
+  if (!json_writer_finish(&writer)) {
+    ESP_LOGE(TAG, "Birth message does not fit in the payload buffer");
     return;
   }
-  cJSON_AddNumberToObject(metadata, "timestamp", readout.timestamp);
-  cJSON_AddStringToObject(metadata, "device", get_device_id());
+  birth_length = writer.length;
+}
 
-  cJSON *full_json = cJSON_CreateObject();
-  if (!full_json) {
-    ESP_LOGE(TAG, "Failed to create JSON object");
+// Publishes the birth message, from the event handler on a new connection or
+// from the publishing task if it was busy at the time
+static void publish_birth_message(void) {
+  if (birth_length == 0)
     return;
+  // no expiry, new subscribers should always get it
+  const esp_mqtt5_publish_property_config_t property = {0};
+  esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+  if (esp_mqtt_client_publish(mqtt_client, publish_context_birth_topic(),
+                              birth_buffer, (int)birth_length, 1, 1) < 0) {
+    ESP_LOGE(TAG, "Failed to publish the birth message");
   }
-  cJSON_AddItemToObject(full_json, "metadata", metadata);
-  cJSON_AddItemToObject(full_json, "readout", readout_obj);
-
-  char *json_string = cJSON_PrintUnformatted(full_json);
-  cJSON_Delete(full_json);
+}
 
-  if (json_string == NULL) {
-    ESP_LOGE(TAG, "Failed to build JSON string (OOM)");
+// Starts over with the topic aliases when the client has reconnected since
+// the last publish
+static void check_connection(void) {
+  const unsigned connection = atomic_load(&connection_count);
+  if (connection == current_connection)
     return;
+  current_connection = connection;
+  topic_alias_count = 0;
+  topic_aliases_enabled = true;
+}
+
+// Gets the alias of a topic, handing out a new one if there is one left.
+// Returns NULL if the topic has none. Topics come from the publish contexts,
+// so they are told apart by address.
+static TopicAlias *get_topic_alias(const char *topic) {
+  if (!topic_aliases_enabled)
+    return NULL;
+  for (size_t i = 0; i < topic_alias_count; i++) {
+    if (topic_aliases[i].topic == topic)
+      return &topic_aliases[i];
   }
+  if (topic_alias_count == CONFIG_MQTT_V5_TOPIC_ALIASES)
+    return NULL;
+  TopicAlias *alias = &topic_aliases[topic_alias_count++];
+  alias->topic = topic;
+  alias->registered = false;
+  return alias;
+}
 
-  const char *device_id = get_device_id();
-  char topic[128]; // topic buffer
-  snprintf(topic, sizeof(topic), "edlavp/%s/sensor/%s", device_id,
-           readout.sensor_type);
+// Publishes with the MQTT 5 properties: the topic alias, and the message
+// expiry interval. Returns the msg_id, -1 on failure, or -2 if the outbox is
+// full.
+static int mqtt5_publish(const char *topic, const char *payload,
+                         const size_t length, const int qos,
+                         const int retain) {
+  check_connection();
+
+  // messages with QoS 1 and 2 may be re-sent from the outbox on a later
+  // connection, where the alias means nothing (or another topic), so only
+  // QoS 0 ones use one
+  TopicAlias *alias = qos == 0 ? get_topic_alias(topic) : NULL;
+  esp_mqtt5_publish_property_config_t property = {
+      .message_expiry_interval = CONFIG_MQTT_V5_MESSAGE_EXPIRY};
+  const char *publish_topic = topic;
+  if (alias != NULL) {
+    property.topic_alias = (uint16_t)(alias - topic_aliases + 1);
+    if (alias->registered)
+      publish_topic = "";
+  }
 
-  int msg_id;
-  int retry_counter = 0;
+  esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+  int msg_id = esp_mqtt_client_publish(mqtt_client, publish_topic, payload,
+                                       (int)length, qos, retain);
+  if (msg_id == -1 && alias != NULL && !mqtt_connected()) {
+    // not connected, nothing wrong with the alias
+    return msg_id;
+  }
+  if (msg_id == -1 && alias != NULL) {
+    // most likely more aliases than the broker's Topic Alias Maximum, go on
+    // without them on this connection
+    ESP_LOGW(TAG, "Publishing with a topic alias failed, disabling aliases "
+                  "until the next connection");
+    topic_aliases_enabled = false;
+    property.topic_alias = 0;
+    esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+    msg_id = esp_mqtt_client_publish(mqtt_client, topic, payload, (int)length,
+                                     qos, retain);
+  } else if (msg_id >= 0 && alias != NULL) {
+    alias->registered = true;
+  }
+  return msg_id;
+}
+#endif
+
+// Publishes a payload, through the MQTT 5 properties if enabled. Returns the
+// msg_id, -1 on failure, or -2 if the outbox is full.
+static int mqtt_client_publish(const char *topic, const char *payload,
+                               const size_t length, const int qos,
+                               const int retain) {
+#if CONFIG_MQTT_V5
+  atomic_store(&publish_busy, true);
+  const int msg_id = mqtt5_publish(topic, payload, length, qos, retain);
+  atomic_store(&publish_busy, false);
+  // the client connected while the properties were being set
+  if (atomic_exchange(&birth_pending, false))
+    publish_birth_message();
+  return msg_id;
+#else
+  return esp_mqtt_client_publish(mqtt_client, topic, payload, (int)length, qos,
+                                 retain);
+#endif
+}
 
-  do {
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, json_string,
-                                     (int)strlen(json_string), 1, 0);
-    retry_counter++;
-  } while (msg_id == -1 && retry_counter < 3);
+// Publishes a finished payload on one of the topics of a sensor's publish
+// context, at the sensor's QoS level. Returns false if it couldn't be
+// published.
+static bool mqtt_publish_payload(const PublishContext *context,
+                                 const char *topic, const char *payload,
+                                 const size_t length) {
+  const SensorDescriptor *descriptor = context->descriptor;
+
+  if (descriptor->qos == 0) {
+    // fast path: sent right away from this task, with no copy kept in the
+    // outbox and nothing to wait for
+    if (mqtt_client_publish(topic, payload, length, 0, descriptor->retain) <
+        0) {
+      ESP_LOGE(TAG, "Failed to publish MQTT message");
+      return false;
+    }
+    return true;
+  }
 
+  // at most CONFIG_MQTT_INFLIGHT_WINDOW messages wait for their PUBACK (or
+  // PUBCOMP)
+  if (!publish_window_wait_slot()) {
+    ESP_LOGW(TAG, "Disconnected while waiting to publish");
+    return false;
+  }
+  const int msg_id = mqtt_client_publish(topic, payload, length,
+                                         descriptor->qos, descriptor->retain);
+  if (msg_id == -2) {
+    ESP_LOGE(TAG, "MQTT outbox full (%d bytes), failed to publish message",
+             esp_mqtt_client_get_outbox_size(mqtt_client));
+    return false;
+  }
   if (msg_id == -1) {
-    ESP_LOGE(TAG, "Failed to publish MQTT message after %d attempts",
-             retry_counter);
+    ESP_LOGE(TAG, "Failed to publish MQTT message");
+    return false;
+  }
+  publish_window_track(msg_id);
+  return true;
+}
+
+#if CONFIG_MQTT_PUBLISH_BINARY
+/**
+ * @brief Publishes readouts as binary records (see readout_codec.h) on the
+ * "/bin" topic of their sensor type.
+ *
+ * The readouts are split over several messages if they don't all fit in the
+ * payload buffer.
+ *
+ * @param context The publish context of the sensor the readouts came from.
+ * @param readouts The readouts to publish, all of the same sensor.
+ * @param count Number of readouts in @p readouts.
+ * @return true if every payload was published.
+ */
+static bool mqtt_publish_binary(const PublishContext *context,
+                                const UniversalSingleReadout *const *readouts,
+                                const size_t count) {
+  uint8_t *buffer = (uint8_t *)payload_buffer;
+  bool ok = true;
+  ReadoutEncoder encoder;
+  readout_encoder_init(&encoder, buffer, sizeof(payload_buffer));
+
+  for (size_t i = 0; i < count; i++) {
+    const UniversalSingleReadout *readout = readouts[i];
+    const ReadoutSummary summary = readout_get_summary(readout);
+    ReadoutRecord record = {
+        .timestamp = readout_time_to_unix_ms(readout),
+        .value = (float)readout_value_from_fixed(readout->value),
+        .address = readout_address(context->descriptor, readout)};
+    if (readout->flags & READOUT_FLAG_AGGREGATE) {
+      record.flags = READOUT_CODEC_FLAG_AGGREGATE;
+      record.samples = summary.samples;
+      record.min = (float)readout_min(readout, &summary);
+      record.max = (float)readout_max(readout, &summary);
+      record.stddev = (float)readout_spread_from_fixed(summary.stddev);
+    }
+    if (readout->flags & READOUT_FLAG_CLOCK_SYNCING) {
+      record.flags |= READOUT_CODEC_FLAG_CLOCK_SYNCING;
+    }
+    if (readout->flags & READOUT_FLAG_CLOCK_STALE) {
+      record.flags |= READOUT_CODEC_FLAG_CLOCK_STALE;
+    }
+    if (summary.suppressed > 0) {
+      record.flags |= READOUT_CODEC_FLAG_SUPPRESSED;
+      record.suppressed = summary.suppressed;
+    }
+    if (!readout_encoder_append(&encoder, &record)) {
+      // payload full, send it and start a new one
+      ok &= mqtt_publish_payload(context, context->binary_topic,
+                                 payload_buffer, encoder.length);
+      readout_encoder_init(&encoder, buffer, sizeof(payload_buffer));
+      readout_encoder_append(&encoder, &record);
+    }
+  }
+
+  if (encoder.count > 0) {
+    ok &= mqtt_publish_payload(context, context->binary_topic, payload_buffer,
+                               encoder.length);
+  }
+  return ok;
+}
+#endif
+
+// Records the outcome of publishing readouts (@p count records, see
+// ReadoutSummary) in the pipeline metrics, along with how long ago they were
+// sampled if they made it out
+static void record_publish(const UniversalSingleReadout *records,
+                           const size_t count, const bool ok) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  const int64_t now_ms = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+  uint32_t readouts = 0;
+  for (size_t i = 0; i < count; i += readout_records(&records[i])) {
+    readouts++;
+    if (!ok)
+      continue;
+    const int64_t latency_ms = now_ms - readout_time_to_unix_ms(&records[i]);
+    metrics_record(METRIC_PUBLISH_LATENCY_MS,
+                   latency_ms <= 0            ? 0
+                   : latency_ms >= UINT32_MAX ? UINT32_MAX
+                                              : (uint32_t)latency_ms);
+  }
+  metrics_add(ok ? METRIC_READOUTS_PUBLISHED : METRIC_PUBLISH_FAILURES,
+              readouts);
+}
+
+#if CONFIG_READOUT_LOG_ENABLE
+static bool readout_log_ready = false;
+// the readouts being published are the log's, they stay in it until they
+// are acknowledged
+static bool draining_log = false;
+#else
+static const bool draining_log = false;
+#endif
+
+// Keeps readouts (@p count records) that couldn't be published in the log,
+// they are published again when it is drained. Without the log they are
+// lost.
+static void keep_unpublished(const UniversalSingleReadout *records,
+                             const size_t count) {
+#if CONFIG_READOUT_LOG_ENABLE
+  for (size_t i = 0; readout_log_ready && !draining_log && i < count;
+       i += readout_records(&records[i])) {
+    readout_log_append(&records[i]);
+  }
+#endif
+}
+
+// Starts a publish window unit for readouts (@p count records), see
+// publish_window_begin()
+static bool begin_unit(const UniversalSingleReadout *records,
+                       const size_t count) {
+  if (draining_log)
+    return publish_window_begin(NULL, 0);
+  return publish_window_begin(records, count);
+}
+
+#if !CONFIG_MQTT_BATCH_PUBLISHING
+// Publishes a single readout (followed by its summary record if it has one)
+// in every enabled encoding, holding on to it until the broker has
+// acknowledged it (see publish_window.h). Returns false if it couldn't be
+// published, the readout is kept in the log then.
+static bool mqtt_publish_readout(const UniversalSingleReadout *readout) {
+  bool ok = true;
+  const size_t records = readout_records(readout);
+  const PublishContext *context = publish_context_get(readout->descriptor);
+  if (context == NULL) {
+    ESP_LOGE(TAG, "Unknown sensor descriptor %d, dropping readout",
+             readout->descriptor);
+    return true;
+  }
+
+  if (!mqtt_connected() || !begin_unit(readout, records)) {
+    keep_unpublished(readout, records);
+    return false;
+  }
+
+#if CONFIG_MQTT_PUBLISH_JSON
+  JsonWriter writer;
+  json_writer_init(&writer, payload_buffer, sizeof(payload_buffer));
+
+  json_writer_begin_object(&writer, NULL);
+  json_writer_begin_object(&writer, "metadata");
+  json_writer_add_number(&writer, "timestamp", readout_json_timestamp(readout));
+#if !CONFIG_MQTT_V5
+  // with MQTT 5 the device is only named in the birth message
+  size_t device_length;
+  const char *device = publish_context_device_member(&device_length);
+  json_writer_add_members(&writer, device, device_length);
+#endif
+  json_writer_add_string(&writer, "clock", readout_clock_state(readout));
+  json_writer_end_object(&writer);
+  write_readout_object(&writer, "readout", context, readout, false);
+  json_writer_end_object(&writer);
+
+  if (json_writer_finish(&writer)) {
+    ok &= mqtt_publish_payload(context, context->topic, payload_buffer,
+                               writer.length);
+  } else {
+    ESP_LOGE(TAG, "Readout does not fit in the payload buffer, dropping it");
+  }
+#endif
+
+#if CONFIG_MQTT_PUBLISH_BINARY
+  const UniversalSingleReadout *readouts[] = {readout};
+  ok &= mqtt_publish_binary(context, readouts, 1);
+#endif
+
+  publish_window_end(ok);
+  record_publish(readout, records, ok);
+  if (!ok)
+    keep_unpublished(readout, records);
+  return ok;
+}
+#else
+#if CONFIG_MQTT_PUBLISH_JSON
+// Starts a batch payload, up to the opening of the "readouts" array
+static void begin_batch_payload(JsonWriter *writer) {
+  json_writer_init(writer, payload_buffer, sizeof(payload_buffer));
+  json_writer_begin_object(writer, NULL);
+#if !CONFIG_MQTT_V5
+  // with MQTT 5 the device is only named in the birth message
+  size_t device_length;
+  const char *device = publish_context_device_member(&device_length);
+  json_writer_begin_object(writer, "metadata");
+  json_writer_add_members(writer, device, device_length);
+  json_writer_end_object(writer);
+#endif
+  json_writer_begin_array(writer, "readouts");
+}
+
+// Closes and publishes a batch payload
+static bool finish_batch_payload(JsonWriter *writer,
+                                 const PublishContext *context) {
+  json_writer_end_array(writer);
+  json_writer_end_object(writer);
+  if (!json_writer_finish(writer))
+    return false;
+  return mqtt_publish_payload(context, context->topic, payload_buffer,
+                              writer->length);
+}
+
+/**
+ * @brief Publishes readouts as a JSON "readouts" array.
+ *
+ * The readouts are split over several messages if they don't all fit in the
+ * payload buffer.
+ *
+ * @param context The publish context of the sensor the readouts came from.
+ * @param readouts The readouts to publish, all of the same sensor.
+ * @param count Number of readouts in @p readouts.
+ * @return true if every payload was published.
+ */
+static bool
+mqtt_publish_json_batch(const PublishContext *context,
+                        const UniversalSingleReadout *const *readouts,
+                        const size_t count) {
+  // bytes needed to close the "readouts" array and the root object
+  static const size_t closing_length = 2;
+  JsonWriter writer;
+  size_t readouts_in_payload = 0;
+  bool ok = true;
+  begin_batch_payload(&writer);
+
+  for (size_t i = 0; i < count; i++) {
+    const JsonWriter checkpoint = writer;
+    write_readout_object(&writer, NULL, context, readouts[i], true);
+    if (writer.overflow || json_writer_remaining(&writer) < closing_length) {
+      writer = checkpoint;
+      if (readouts_in_payload == 0) {
+        ESP_LOGE(TAG, "Readout does not fit in the payload buffer, "
+                      "dropping it");
+        continue;
+      }
+      // payload full, send it and retry this readout in a new one
+      ok &= finish_batch_payload(&writer, context);
+      begin_batch_payload(&writer);
+      readouts_in_payload = 0;
+      i--;
+      continue;
+    }
+    readouts_in_payload++;
+  }
+
+  if (readouts_in_payload > 0) {
+    ok &= finish_batch_payload(&writer, context);
+  }
+  return ok;
+}
+#endif
+
+// Publishes the readouts of one sensor (@p count records) as a unit of the
+// publish window, keeping them in the log if that fails. Returns false if it
+// did.
+static bool mqtt_publish_group(const UniversalSingleReadout *records,
+                               const size_t count) {
+  const PublishContext *context = publish_context_get(records[0].descriptor);
+  if (context == NULL) {
+    ESP_LOGE(TAG, "Unknown sensor descriptor %d, dropping %d record(s)",
+             records[0].descriptor, (int)count);
+    return true;
+  }
+  if (!mqtt_connected() || !begin_unit(records, count)) {
+    keep_unpublished(records, count);
+    return false;
+  }
+
+  bool ok = true;
+  const UniversalSingleReadout *group[CONFIG_MQTT_BATCH_MAX_READOUTS];
+  size_t group_count = 0;
+  for (size_t i = 0; i < count; i += readout_records(&records[i])) {
+    group[group_count++] = &records[i];
+  }
+#if CONFIG_MQTT_PUBLISH_JSON
+  ok &= mqtt_publish_json_batch(context, group, group_count);
+#endif
+#if CONFIG_MQTT_PUBLISH_BINARY
+  ok &= mqtt_publish_binary(context, group, group_count);
+#endif
+
+  publish_window_end(ok);
+  record_publish(records, count, ok);
+  if (!ok)
+    keep_unpublished(records, count);
+  return ok;
+}
+
+/**
+ * @brief Publishes a batch of readouts, one message per sensor type.
+ *
+ * Every readout of the same sensor type is packed into a single payload, so
+ * each topic gets exactly one publish per batch (per enabled encoding). The
+ * readouts of a sensor type are kept in the log if they can't be published.
+ *
+ * @param batch The collected readouts, each followed by its summary record if
+ * it has one.
+ * @param count Number of records in @p batch.
+ * @return true if every payload was published.
+ */
+static bool mqtt_publish_batch(const UniversalSingleReadout *batch,
+                               const size_t count) {
+  // the batch reordered by sensor, so each one's readouts are contiguous
+  static UniversalSingleReadout grouped[CONFIG_MQTT_BATCH_MAX_READOUTS];
+  bool taken[CONFIG_MQTT_BATCH_MAX_READOUTS] = {false};
+  size_t grouped_count = 0;
+  bool ok = true;
+
+  for (size_t i = 0; i < count; i += readout_records(&batch[i])) {
+    if (taken[i])
+      continue;
+
+    // gather every readout of this sensor into the same group
+    const size_t group_start = grouped_count;
+    for (size_t j = i; j < count; j += readout_records(&batch[j])) {
+      if (!taken[j] && batch[j].descriptor == batch[i].descriptor) {
+        memcpy(&grouped[grouped_count], &batch[j],
+               readout_records(&batch[j]) * sizeof(batch[j]));
+        grouped_count += readout_records(&batch[j]);
+        taken[j] = true;
+      }
+    }
+    ok &= mqtt_publish_group(&grouped[group_start],
+                             grouped_count - group_start);
+  }
+  return ok;
+}
+#endif
+
+// how many readouts are taken off the readout queue at once
+#define READOUT_RECEIVE_CHUNK 8
+
+// Takes readouts off the readout queue like readout_queue_receive_batch(),
+// giving the ones taken before the first clock sync their UTC timestamps if
+// the clock is valid by now. Until it is, the client isn't started and they
+// can only go to the log, where they keep counting from boot.
+static size_t receive_readouts(UniversalSingleReadout *records,
+                               const size_t max_records,
+                               const TickType_t ticks_to_wait) {
+  const size_t count =
+      readout_queue_receive_batch(records, max_records, ticks_to_wait);
+  for (size_t i = 0; i < count; i += readout_records(&records[i])) {
+    readout_pipeline_resolve_time(&records[i]);
+  }
+  return count;
+}
+
+#if CONFIG_METRICS_PUBLISH_INTERVAL > 0
+// Publishes a metrics snapshot (QoS 0, a lost one is superseded by the next)
+// if one is due. Returns how long until the next one is.
+static TickType_t publish_metrics(void) {
+  static TickType_t last_publish = 0;
+  const TickType_t interval =
+      pdMS_TO_TICKS(CONFIG_METRICS_PUBLISH_INTERVAL * 1000UL);
+  const TickType_t elapsed = xTaskGetTickCount() - last_publish;
+  if (elapsed < interval)
+    return interval - elapsed;
+  last_publish = xTaskGetTickCount();
+  if (!mqtt_connected())
+    return interval; // skipped, the next one supersedes it anyway
+
+  JsonWriter writer;
+  json_writer_init(&writer, payload_buffer, sizeof(payload_buffer));
+  if (!metrics_write_json(&writer) || !json_writer_finish(&writer)) {
+    ESP_LOGE(TAG, "Metrics do not fit in the payload buffer");
+    return interval;
+  }
+  if (mqtt_client_publish(publish_context_metrics_topic(), payload_buffer,
+                          writer.length, 0, 0) < 0) {
+    ESP_LOGW(TAG, "Failed to publish the metrics");
+  }
+  return interval;
+}
+#else
+static TickType_t publish_metrics(void) { return portMAX_DELAY; }
+#endif
+
+// Publishes the readouts of messages that were lost again, or keeps them in
+// the log if that fails
+static void republish_lost(void) {
+  UniversalSingleReadout readouts[PUBLISH_UNIT_MAX_RECORDS];
+  size_t count;
+  while ((count = publish_window_take_lost(readouts,
+                                           PUBLISH_UNIT_MAX_RECORDS)) > 0) {
+    ESP_LOGW(TAG, "Publishing %d record(s) of a lost message again",
+             (int)count);
+#if CONFIG_MQTT_BATCH_PUBLISHING
+    mqtt_publish_batch(readouts, count);
+#else
+    mqtt_publish_readout(&readouts[0]);
+#endif
+  }
+}
+
+#if CONFIG_READOUT_LOG_ENABLE
+#if CONFIG_MQTT_BATCH_PUBLISHING
+#define LOG_DRAIN_CHUNK CONFIG_MQTT_BATCH_MAX_READOUTS
+#else
+#define LOG_DRAIN_CHUNK CONFIG_READOUT_LOG_DRAIN_BATCH
+#endif
+
+// Moves everything waiting in the readout queue into the log. Only the first
+// receive waits up to @p ticks_to_wait.
+static void spill_queue_to_log(TickType_t ticks_to_wait) {
+  UniversalSingleReadout readouts[READOUT_RECEIVE_CHUNK];
+  size_t count;
+  while ((count = receive_readouts(readouts, READOUT_RECEIVE_CHUNK,
+                                   ticks_to_wait)) > 0) {
+    for (size_t i = 0; i < count; i += readout_records(&readouts[i])) {
+      readout_log_append(&readouts[i]);
+    }
+    ticks_to_wait = 0;
+  }
+}
+
+// Publishes the oldest chunk of logged readouts. They stay in the log until
+// every message carrying them has been acknowledged, and are only consumed
+// then: if anything fails or is lost they are published again from the log,
+// in the same order. Returns false if the chunk couldn't be consumed.
+static bool drain_log_chunk(void) {
+  static UniversalSingleReadout chunk[LOG_DRAIN_CHUNK];
+  const TickType_t flush_timeout =
+      pdMS_TO_TICKS(CONFIG_MQTT_INFLIGHT_TIMEOUT * 1000UL);
+  if (!mqtt_connected())
+    return false;
+  // whatever else is still in flight would blur which messages were lost
+  if (!publish_window_flush(flush_timeout))
+    return false;
+  const size_t count = readout_log_peek(chunk, LOG_DRAIN_CHUNK);
+  if (count == 0)
+    return true;
+  // readouts logged before the first clock sync, the clock is valid now
+  for (size_t i = 0; i < count; i += readout_records(&chunk[i])) {
+    readout_pipeline_resolve_time(&chunk[i]);
   }
 
-  free(json_string);
+  PublishWindowStats before;
+  publish_window_get_stats(&before);
+  draining_log = true;
+#if CONFIG_MQTT_BATCH_PUBLISHING
+  // the groups go out by sensor, not in log order, so it's all or nothing
+  size_t published = mqtt_publish_batch(chunk, count) ? count : 0;
+#else
+  // the readouts up to the first failure can still be consumed
+  size_t published = 0;
+  while (published < count && mqtt_publish_readout(&chunk[published])) {
+    published += readout_records(&chunk[published]);
+  }
+#endif
+  draining_log = false;
+
+  if (published > 0 && !publish_window_flush(flush_timeout))
+    return false;
+  PublishWindowStats after;
+  publish_window_get_stats(&after);
+  if (after.lost != before.lost)
+    return false;
+  if (readout_log_consume(published) != ESP_OK)
+    return false;
+  return published == count;
 }
+#endif
 
 void mqtt_manager(void *pvParameters) {
   ESP_LOGI(TAG, "%s task started", TAG);
 
+#if CONFIG_READOUT_LOG_ENABLE
+  readout_log_ready = readout_log_init() == ESP_OK;
+#endif
+
+  // the client is only started from the loop, readouts go to the log until
+  // the clock is valid
   mqtt_app_start();
 
+#if CONFIG_MQTT_BATCH_PUBLISHING
+  static UniversalSingleReadout batch[CONFIG_MQTT_BATCH_MAX_READOUTS];
+  const TickType_t batch_window = pdMS_TO_TICKS(CONFIG_MQTT_BATCH_WINDOW_MS);
+#endif
+
   // ReSharper disable once CppDFAEndlessLoop
   while (1) {
-    system_wait_for_bits(SYS_BIT_MQTT_CONNECTED, pdTRUE, portMAX_DELAY);
-    UniversalSingleReadout readout;
-
-    while (readout_queue_receive(&readout, 0) == pdPASS) {
-      if (system_wait_for_bits(SYS_BIT_MQTT_CONNECTED, pdTRUE, 0) == 0) {
-        ESP_LOGW(TAG, "Lost MQTT connection while processing queue");
-        break;
+    const bool started = mqtt_start_when_ready(0);
+#if CONFIG_READOUT_LOG_ENABLE
+    if (readout_log_ready) {
+      if (!mqtt_connected()) {
+        // the broker is unreachable, keep the readouts in flash until it is
+        // back instead of letting the queue overflow
+        spill_queue_to_log(pdMS_TO_TICKS(100));
+        continue;
       }
 
-      mqtt_publish_readout(readout);
+      if (readout_log_count() > 0) {
+        // still catching up, newer readouts go behind the logged ones so
+        // everything is published in order
+        spill_queue_to_log(0);
+        publish_metrics();
+        if (!drain_log_chunk()) {
+          vTaskDelay(pdMS_TO_TICKS(100));
+        }
+        continue;
+      }
+    }
+#endif
+
+    if (!mqtt_connected()) {
+#if CONFIG_READOUT_LOG_ENABLE
+      if (readout_log_ready)
+        continue; // disconnected since the check above, spill right away
+#endif
+      // with nowhere else to keep them, the readouts wait in the ring
+      if (started) {
+        system_wait_for_bits(SYS_BIT_MQTT_CONNECTED, pdTRUE, portMAX_DELAY);
+      } else {
+        mqtt_start_when_ready(portMAX_DELAY);
+      }
+      continue;
+    }
+    republish_lost();
+    // wake up for the next metrics snapshot even if no readouts arrive
+    const TickType_t ticks_to_wait = publish_metrics();
+
+#if CONFIG_MQTT_BATCH_PUBLISHING
+    // sleep until readouts arrive, then keep collecting until the batch is
+    // full or the batch window (counted from the first readout) has passed
+    size_t count =
+        receive_readouts(batch, CONFIG_MQTT_BATCH_MAX_READOUTS, ticks_to_wait);
+    if (count == 0)
+      continue;
+
+    const TickType_t window_start = xTaskGetTickCount();
+    while (count < CONFIG_MQTT_BATCH_MAX_READOUTS) {
+      const TickType_t elapsed = xTaskGetTickCount() - window_start;
+      if (elapsed >= batch_window)
+        break;
+      const size_t received = receive_readouts(
+          &batch[count], CONFIG_MQTT_BATCH_MAX_READOUTS - count,
+          batch_window - elapsed);
+      if (received == 0)
+        break;
+      count += received;
+    }
 
-      // small delay between publishes to avoid overwhelming the broker
-      vTaskDelay(pdMS_TO_TICKS(50));
+    if (!mqtt_publish_batch(batch, count)) {
+      ESP_LOGW(TAG, "Failed to publish a batch of %d readout(s)", (int)count);
+    }
+#else
+    // sleep until readouts arrive, then take everything queued at once
+    UniversalSingleReadout readouts[READOUT_RECEIVE_CHUNK];
+    const size_t count =
+        receive_readouts(readouts, READOUT_RECEIVE_CHUNK, ticks_to_wait);
+
+    for (size_t i = 0; i < count; i += readout_records(&readouts[i])) {
+      if (mqtt_publish_readout(&readouts[i]))
+        continue;
+      // keep the rest in order behind the failed one, the log is drained on
+      // the next iteration
+      const size_t next = i + readout_records(&readouts[i]);
+      keep_unpublished(&readouts[next], count - next);
+      break;
     }
-    vTaskDelay(pdMS_TO_TICKS(100));
+#endif
   }
 }
\ No newline at end of file
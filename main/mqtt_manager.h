@@ -10,8 +10,20 @@
 #ifndef _MQTT_MANAGER_H
 #define _MQTT_MANAGER_H
 
+#include <stdbool.h>
+
 void mqtt_app_start();
 
 void mqtt_manager(void *pvParameters);
 
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Takes the connection to the broker down or brings it back up, to
+ * simulate link outages on the linux target (see sim_link.h).
+ *
+ * Must not be called before the mqtt_manager task has connected once.
+ */
+void mqtt_manager_set_link(bool up);
+#endif
+
 #endif //_MQTT_MANAGER_H
\ No newline at end of file
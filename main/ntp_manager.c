@@ -7,61 +7,356 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
+
 #include "ntp_manager.h"
 
 #include "esp_log.h"
-#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "system_state.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_attr.h"
+#include "esp_netif_sntp.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#endif
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
 
 static const char *TAG = "ntp_manager";
-static const char *NTP_SERVER = "pool.ntp.org";
-static const uint32_t SYNC_INTERVAL = CONFIG_TIMESYNC_INTERVAL;
+
+// only written before SYS_BIT_TIME_VALID is first set, and only read once it
+// is, so the event group orders the accesses
+static int64_t boot_time_us;
+
+bool ntp_manager_get_boot_time(int64_t *boot_time) {
+  if ((system_get_bits() & SYS_BIT_TIME_VALID) == 0)
+    return false;
+  *boot_time = boot_time_us;
+  return true;
+}
+
+static int64_t now_us(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+// Marks the clock as valid for the first time this boot, which is when the
+// boot time of readouts taken so far gets pinned down
+static void set_time_valid(void) {
+  if (system_get_bits() & SYS_BIT_TIME_VALID)
+    return;
+  boot_time_us = now_us() - esp_timer_get_time();
+  system_set_bits(SYS_BIT_TIME_VALID);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+// The linux target runs on the host's clock, which the host keeps synced, so
+// there is no SNTP client (nor a network interface for one) to start
+void ntp_manager_init(void) {
+  ESP_LOGI(TAG, "Running on the host clock, no NTP sync needed");
+  set_time_valid();
+}
+#else
+// lwIP doesn't accept sync intervals below 15 seconds
+#define MIN_SYNC_INTERVAL_S 15
+
+// A drift estimate beyond this is taken for a bad measurement: the ESP32's
+// crystal is specified to ±10 ppm, and temperature adds a few tens at most
+#define MAX_PLAUSIBLE_DRIFT_PPM 100.0
+
+// Time state kept in RTC memory, which survives every reset but a power loss.
+// The system clock itself is kept running across those resets by ESP-IDF,
+// this tells whether it can be trusted. It is cleared on any reset after
+// which it can't (see ntp_manager_init()).
+#define RETAINED_MAGIC 0x4E545032 // "NTP2"
+
+typedef struct {
+  uint32_t magic;
+  int64_t last_sync_us; // UTC of the last sync, microseconds since the epoch
+  float drift_ppm;      // see below
+  uint8_t drift_valid;
+  uint32_t crc; // covers everything before it
+} RetainedTime;
+
+static RTC_NOINIT_ATTR RetainedTime retained;
+
+// How fast the local oscillator runs compared to the NTP servers, in parts
+// per million (positive if it runs fast). Measured between syncs against
+// esp_timer, so slewing the clock doesn't affect it.
+static double drift_ppm = 0;
+static bool drift_valid = false;
+
+// the last sync, as handed over by the SNTP callback (which runs on the lwIP
+// task)
+typedef struct {
+  int64_t server_us; // server time, microseconds since the epoch
+  int64_t local_us;  // esp_timer_get_time() when it arrived
+} SyncSample;
+
+static portMUX_TYPE sync_lock = portMUX_INITIALIZER_UNLOCKED;
+static SyncSample pending_sync;
+static TaskHandle_t ntp_task = NULL;
+
+static uint32_t retained_crc(const RetainedTime *state) {
+  return esp_rom_crc32_le(0, (const uint8_t *)state,
+                          offsetof(RetainedTime, crc));
+}
+
+static void save_retained(const int64_t last_sync_us) {
+  memset(&retained, 0, sizeof(retained));
+  retained.magic = RETAINED_MAGIC;
+  retained.last_sync_us = last_sync_us;
+  retained.drift_ppm = (float)drift_ppm;
+  retained.drift_valid = drift_valid;
+  retained.crc = retained_crc(&retained);
+}
+
+// Forgets the retained state, so no later reset restores the clock from it
+static void clear_retained(void) { memset(&retained, 0, sizeof(retained)); }
+
+void ntp_manager_init(void) {
+  const esp_reset_reason_t reason = esp_reset_reason();
+  // the chip kept running off the same crystal, under the same conditions,
+  // so the drift measured before the reset still holds
+  const bool warm_reset =
+      reason == ESP_RST_SW || reason == ESP_RST_PANIC ||
+      reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+      reason == ESP_RST_WDT;
+  // the clock kept running through the sleep, but off the RTC slow clock,
+  // whose drift has nothing to do with the one measured
+  const bool deep_sleep = reason == ESP_RST_DEEPSLEEP;
+
+  if (!warm_reset && !deep_sleep) {
+    // after a power loss or a brownout neither the clock nor the RTC memory
+    // can be trusted
+    clear_retained();
+    ESP_LOGI(TAG, "No retained time, waiting for the first sync");
+    return;
+  }
+  if (retained.magic != RETAINED_MAGIC ||
+      retained.crc != retained_crc(&retained)) {
+    ESP_LOGI(TAG, "No retained time, waiting for the first sync");
+    return;
+  }
+
+  const int64_t elapsed_us = now_us() - retained.last_sync_us;
+  if (elapsed_us < 0) {
+    ESP_LOGW(TAG, "Retained time is ahead of the clock, ignoring it");
+    clear_retained();
+    return;
+  }
+
+  drift_ppm = retained.drift_ppm;
+  drift_valid = retained.drift_valid && !deep_sleep;
+  if (drift_valid && !(fabs(drift_ppm) <= MAX_PLAUSIBLE_DRIFT_PPM)) {
+    ESP_LOGW(TAG, "Retained drift of %.2f ppm is implausible, ignoring it",
+             drift_ppm);
+    drift_valid = false;
+  }
+  if (!drift_valid) {
+    // measured again from the next syncs on
+    drift_ppm = 0;
+    save_retained(retained.last_sync_us);
+  }
+
+  // the clock kept drifting since the last sync, take that back out
+  if (drift_valid) {
+    const int64_t correction_us = -(int64_t)(elapsed_us * drift_ppm / 1e6);
+    const int64_t corrected_us = now_us() + correction_us;
+    const struct timeval corrected = {
+        .tv_sec = (time_t)(corrected_us / 1000000),
+        .tv_usec = (suseconds_t)(corrected_us % 1000000)};
+    settimeofday(&corrected, NULL);
+  }
+
+  // without a drift estimate the error can't be bounded, so the readouts
+  // are flagged until the next sync
+  const double error_ms = fabs(drift_ppm) * (double)elapsed_us / 1e9;
+  if (!drift_valid || error_ms > CONFIG_TIMESYNC_MAX_ERROR_MS) {
+    system_set_bits(SYS_BIT_NTP_STALE);
+  }
+  set_time_valid();
+  ESP_LOGI(TAG,
+           "Restored the clock after a reset, last synced %lld s ago "
+           "(drift %.2f ppm, estimated error %.1f ms)",
+           elapsed_us / 1000000, drift_ppm, error_ms);
+}
+
+// Runs on the lwIP task for every successful sync, so it only hands the
+// sample over to the ntp_manager task
+static void sync_callback(struct timeval *tv) {
+  const SyncSample sample = {
+      .server_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec,
+      .local_us = esp_timer_get_time()};
+  portENTER_CRITICAL(&sync_lock);
+  pending_sync = sample;
+  portEXIT_CRITICAL(&sync_lock);
+  xTaskNotifyGive(ntp_task);
+}
+
+// Resync interval that keeps the drift below CONFIG_TIMESYNC_MAX_ERROR_MS
+// between syncs
+static uint32_t next_sync_interval(void) {
+  uint32_t interval = CONFIG_TIMESYNC_MIN_INTERVAL;
+  if (drift_valid) {
+    // the clock is off by |drift| microseconds more every second
+    const double limit = fabs(drift_ppm) > 0
+                             ? CONFIG_TIMESYNC_MAX_ERROR_MS * 1000.0 /
+                                   fabs(drift_ppm)
+                             : CONFIG_TIMESYNC_INTERVAL;
+    interval = limit >= CONFIG_TIMESYNC_INTERVAL ? CONFIG_TIMESYNC_INTERVAL
+                                                 : (uint32_t)limit;
+  }
+  if (interval < CONFIG_TIMESYNC_MIN_INTERVAL)
+    interval = CONFIG_TIMESYNC_MIN_INTERVAL;
+  if (interval < MIN_SYNC_INTERVAL_S)
+    interval = MIN_SYNC_INTERVAL_S;
+  return interval;
+}
+
+// Updates the drift estimate and the sync interval with the sync that just
+// landed. Returns the time until the next sync, in seconds.
+static uint32_t process_sync(void) {
+  static SyncSample last;
+  static bool have_last = false;
+
+  portENTER_CRITICAL(&sync_lock);
+  const SyncSample sample = pending_sync;
+  portEXIT_CRITICAL(&sync_lock);
+
+  if (!have_last) {
+    last = sample;
+    have_last = true;
+  } else {
+    const int64_t server_elapsed = sample.server_us - last.server_us;
+    const int64_t local_elapsed = sample.local_us - last.local_us;
+    // syncs close together (e.g. right after startup) only measure the
+    // servers' jitter, so they are left to add up
+    if (server_elapsed >= CONFIG_TIMESYNC_MIN_INTERVAL * 1000000LL / 2) {
+      const double measured = (double)(local_elapsed - server_elapsed) * 1e6 /
+                              (double)server_elapsed;
+      drift_ppm = drift_valid ? (drift_ppm + measured) / 2 : measured;
+      drift_valid = true;
+      last = sample;
+    }
+  }
+
+  save_retained(sample.server_us);
+
+  // lwIP has already scheduled the next sync with the interval in effect
+  // until now, a new one only applies from the sync after it
+  const uint32_t in_effect = sntp_get_sync_interval() / 1000UL;
+  const uint32_t interval = next_sync_interval();
+  if (interval == in_effect)
+    return interval;
+  sntp_set_sync_interval(interval * 1000UL);
+  if (interval > in_effect)
+    return in_effect;
+
+  // waiting out the longer interval would let the clock drift past
+  // CONFIG_TIMESYNC_MAX_ERROR_MS, so start over with the new one
+  sntp_restart();
+  return interval;
+}
+
+static void start_sntp(void) {
+  const char *servers[] = {CONFIG_TIMESYNC_SERVER_1, CONFIG_TIMESYNC_SERVER_2,
+                           CONFIG_TIMESYNC_SERVER_3};
+
+  esp_sntp_config_t config =
+      ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_TIMESYNC_SERVER_1);
+  config.smooth_sync = CONFIG_TIMESYNC_SMOOTH;
+  config.wait_for_sync = false;
+  config.sync_cb = sync_callback;
+  config.num_of_servers = 0;
+
+  const size_t max_servers = sizeof(config.servers) / sizeof(config.servers[0]);
+  for (size_t i = 0; i < sizeof(servers) / sizeof(servers[0]); i++) {
+    if (servers[i][0] == '\0')
+      continue;
+    if (config.num_of_servers == max_servers) {
+      ESP_LOGW(TAG, "Ignoring NTP server \"%s\", raise "
+                    "CONFIG_LWIP_SNTP_MAX_SERVERS to use it",
+               servers[i]);
+      continue;
+    }
+    ESP_LOGI(TAG, "Using NTP server \"%s\"", servers[i]);
+    config.servers[config.num_of_servers++] = servers[i];
+  }
+
+  ESP_ERROR_CHECK(esp_netif_sntp_init(&config));
+  // until there is a drift estimate, syncs come every
+  // CONFIG_TIMESYNC_MIN_INTERVAL
+  sntp_set_sync_interval(next_sync_interval() * 1000UL);
+}
 
 void ntp_manager(void *pvParameters) {
   ESP_LOGI(TAG, "%s task started", TAG);
+  ntp_task = xTaskGetCurrentTaskHandle();
 
-  ESP_LOGI(TAG, "SYNC_INTERVAL runtime value: %u", (unsigned)SYNC_INTERVAL);
+  ESP_LOGI(TAG, "Waiting to make sure ESP is connected to the internet");
+  system_wait_for_bits(SYS_BIT_GOT_IP, pdTRUE, portMAX_DELAY);
+
+  // the client stays up from here on and resyncs on its own, this task only
+  // keeps track of whether the syncs keep coming
+  start_sntp();
 
   static char strftime_buf[64];
   time_t now;
   struct tm timeinfo;
+  // the first sync is due right away
+  int64_t sync_due = esp_timer_get_time();
 
+  // ReSharper disable once CppDFAEndlessLoop
   while (1) {
-    ESP_LOGI(TAG, "Waiting to make sure ESP is connected to the internet");
-    system_wait_for_bits(SYS_BIT_GOT_IP, pdTRUE, portMAX_DELAY);
-    ESP_LOGI(TAG, "Will now attempt to sync time");
-
-    ESP_LOGV(TAG, "Cleared SYS_BIT_NTP_SYNCED before resyncing time");
-    system_clear_bits(SYS_BIT_NTP_SYNCED);
-
-    ESP_LOGI(TAG, "Attempting to resync time with \"%s\"", NTP_SERVER);
-    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(NTP_SERVER);
-    ESP_ERROR_CHECK(esp_netif_sntp_init(&config));
-    const esp_err_t ret = esp_netif_sntp_sync_wait(
-        pdMS_TO_TICKS(CONFIG_TIMESYNC_TIMEOUT * 1000UL));
-    esp_netif_sntp_deinit();
-
-    if (ret == ESP_OK) {
-      ESP_LOGI(TAG, "Time synced successfully.");
-      system_set_bits(SYS_BIT_NTP_SYNCED);
-      ESP_LOGV(TAG, "Set SYS_BIT_NTP_SYNCED.");
-    } else {
-      ESP_LOGE(TAG, "Failed to sync time in 10 seconds (err=%d)", ret);
-      ESP_LOGW(TAG, "Will try to sync again in 10 seconds.");
-      vTaskDelay(pdMS_TO_TICKS(CONFIG_TIMESYNC_ERROR_RETRY_COOLDOWN * 1000UL));
-      continue;
+    const int64_t until_due = sync_due - esp_timer_get_time();
+    bool synced =
+        ulTaskNotifyTake(pdTRUE, until_due > 0
+                                     ? pdMS_TO_TICKS(until_due / 1000)
+                                     : 0) > 0;
+
+    if (!synced) {
+      // the clock stays valid during the resync, sampling and publishing
+      // carry on with it and only note that a sync is in progress
+      system_set_bits(SYS_BIT_NTP_SYNCING);
+      synced = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(
+                                            CONFIG_TIMESYNC_TIMEOUT * 1000UL)) >
+               0;
     }
 
-    time(&now);
+    if (!synced) {
+      ESP_LOGE(TAG, "Time sync overdue by %d seconds, the clock is stale",
+               CONFIG_TIMESYNC_TIMEOUT);
+      system_set_bits(SYS_BIT_NTP_STALE);
+      system_clear_bits(SYS_BIT_NTP_SYNCING);
+      // the client keeps retrying on its own
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
 
+    const uint32_t interval = process_sync();
+    set_time_valid();
+    system_clear_bits(SYS_BIT_NTP_SYNCING | SYS_BIT_NTP_STALE);
+
+    time(&now);
     localtime_r(&now, &timeinfo);
     strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
-    ESP_LOGI(TAG, "The current date/time UTC is: %s", strftime_buf);
-
-    system_set_bits(SYS_BIT_NTP_SYNCED);
-    ESP_LOGV(TAG, "Set SYS_BIT_NTP_SYNCED again.");
-    ESP_LOGI(TAG, "Next NTP sync in: %d seconds", SYNC_INTERVAL);
+    ESP_LOGI(TAG, "Time synced, the current date/time UTC is: %s",
+             strftime_buf);
+    if (drift_valid) {
+      ESP_LOGI(TAG, "Clock drift: %.2f ppm, next NTP sync in %u seconds",
+               drift_ppm, (unsigned)interval);
+    } else {
+      ESP_LOGI(TAG, "Next NTP sync in %u seconds", (unsigned)interval);
+    }
 
-    vTaskDelay(pdMS_TO_TICKS(SYNC_INTERVAL * 1000UL));
+    sync_due = esp_timer_get_time() + (int64_t)interval * 1000000;
   }
-}
\ No newline at end of file
+}
+#endif
@@ -10,6 +10,52 @@
 #ifndef _NTP_MANAGER_H
 #define _NTP_MANAGER_H
 
+#include "sdkconfig.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Restores the clock after a warm reset (software reset, panic,
+ * watchdog, deep sleep), from the state retained in RTC memory at the last
+ * sync.
+ *
+ * The clock is corrected for the drift measured before the reset and
+ * SYS_BIT_TIME_VALID is set right away, with SYS_BIT_NTP_STALE as well if the
+ * estimated error is above CONFIG_TIMESYNC_MAX_ERROR_MS. The drift isn't
+ * reused after waking from deep sleep, or if it is implausibly large, and the
+ * clock is flagged stale until the next sync then. After a power-on or
+ * brownout reset the retained state is cleared and the first sync has to be
+ * waited for.
+ *
+ * On the linux target, which runs on the host's clock, SYS_BIT_TIME_VALID is
+ * set right away and there is no ntp_manager task.
+ *
+ * Should be called early in app_main(), after system_state_init() and before
+ * the sensors start.
+ */
+void ntp_manager_init(void);
+
+/**
+ * @brief The ntp_manager task.
+ *
+ * Starts an SNTP client that stays up for good, with the servers given by
+ * CONFIG_TIMESYNC_SERVER_1 to 3, and keeps track of its syncs. The drift of
+ * the oscillator is measured between syncs, and the sync interval stretched
+ * (between CONFIG_TIMESYNC_MIN_INTERVAL and CONFIG_TIMESYNC_INTERVAL) so the
+ * clock doesn't drift further than CONFIG_TIMESYNC_MAX_ERROR_MS in between.
+ */
+#if !CONFIG_IDF_TARGET_LINUX
 void ntp_manager(void *pvParameters);
+#endif
+
+/**
+ * @brief Gets the UTC time at which the device booted (esp_timer_get_time()
+ * was 0), in microseconds since the Unix epoch, as measured right after the
+ * first successful clock sync.
+ *
+ * @return false if the clock hasn't been synced yet.
+ */
+bool ntp_manager_get_boot_time(int64_t *boot_time);
 
 #endif //_NTP_MANAGER_H
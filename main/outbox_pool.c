@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+
+// The MQTT client's outbox, see outbox_pool.h. esp-mqtt calls these with its
+// client lock held, from the MQTT task and from esp_mqtt_client_publish(), so
+// only the statistics need to be atomic.
+
+#include "outbox_pool.h"
+
+#include "esp_log.h"
+#include "mqtt_outbox.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+static const char *TAG = "outbox_pool";
+
+typedef struct outbox_item {
+  uint8_t *buffer;
+  int len;
+  int msg_id;
+  int msg_type;
+  int msg_qos;
+  outbox_tick_t tick;
+  pending_state_t pending;
+  bool pooled; // buffer is a pool slot, otherwise the item is on the heap
+  STAILQ_ENTRY(outbox_item) next;
+} outbox_item_t;
+
+STAILQ_HEAD(outbox_list_t, outbox_item);
+
+struct outbox_t {
+  uint64_t size;
+  struct outbox_list_t list;
+};
+
+typedef struct {
+  outbox_item_t item;
+  bool in_use;
+  uint8_t buffer[OUTBOX_POOL_SLOT_SIZE];
+} OutboxSlot;
+
+static OutboxSlot slots[OUTBOX_POOL_SLOTS];
+static struct outbox_t outbox;
+static bool outbox_taken = false;
+
+static atomic_uint slots_in_use = 0;
+static atomic_uint slots_peak = 0;
+static atomic_uint heap_copies = 0;
+
+// Takes a free slot for a message of @p len bytes, or allocates the item
+// with its buffer on the heap if none is free or the message is too large
+static outbox_item_t *new_item(const size_t len) {
+  if (len <= OUTBOX_POOL_SLOT_SIZE) {
+    for (size_t i = 0; i < OUTBOX_POOL_SLOTS; i++) {
+      if (slots[i].in_use)
+        continue;
+      slots[i].in_use = true;
+      const unsigned in_use = atomic_fetch_add(&slots_in_use, 1) + 1;
+      if (in_use > atomic_load(&slots_peak))
+        atomic_store(&slots_peak, in_use);
+      outbox_item_t *item = &slots[i].item;
+      memset(item, 0, sizeof(*item));
+      item->buffer = slots[i].buffer;
+      item->pooled = true;
+      return item;
+    }
+  }
+
+  outbox_item_t *item = calloc(1, sizeof(outbox_item_t) + len);
+  if (item == NULL)
+    return NULL;
+  item->buffer = (uint8_t *)(item + 1);
+  if (atomic_fetch_add(&heap_copies, 1) == 0) {
+    ESP_LOGW(TAG, "Message of %u bytes copied to the heap, %u pool slots of "
+                  "%u bytes", (unsigned)len, (unsigned)OUTBOX_POOL_SLOTS,
+             (unsigned)OUTBOX_POOL_SLOT_SIZE);
+  }
+  return item;
+}
+
+static void free_item(outbox_item_t *item) {
+  if (!item->pooled) {
+    free(item);
+    return;
+  }
+  OutboxSlot *slot = (OutboxSlot *)((uint8_t *)item - offsetof(OutboxSlot, item));
+  slot->in_use = false;
+  atomic_fetch_sub(&slots_in_use, 1);
+}
+
+static void remove_item(outbox_handle_t handle, outbox_item_t *item) {
+  STAILQ_REMOVE(&handle->list, item, outbox_item, next);
+  handle->size -= (uint64_t)item->len;
+  free_item(item);
+}
+
+outbox_handle_t outbox_init(void) {
+  // there is only the one client
+  if (outbox_taken) {
+    ESP_LOGE(TAG, "The outbox is already in use by another MQTT client");
+    return NULL;
+  }
+  outbox_taken = true;
+  outbox.size = 0;
+  STAILQ_INIT(&outbox.list);
+  return &outbox;
+}
+
+outbox_item_handle_t outbox_enqueue(outbox_handle_t handle,
+                                    outbox_message_handle_t message,
+                                    outbox_tick_t tick) {
+  const size_t len = (size_t)message->len + (size_t)message->remaining_len;
+  outbox_item_t *item = new_item(len);
+  if (item == NULL) {
+    ESP_LOGE(TAG, "No memory for a message of %u bytes", (unsigned)len);
+    return NULL;
+  }
+  item->len = (int)len;
+  item->msg_id = message->msg_id;
+  item->msg_type = message->msg_type;
+  item->msg_qos = message->msg_qos;
+  item->tick = tick;
+  item->pending = QUEUED;
+  memcpy(item->buffer, message->data, (size_t)message->len);
+  if (message->remaining_data != NULL) {
+    memcpy(item->buffer + message->len, message->remaining_data,
+           (size_t)message->remaining_len);
+  }
+  STAILQ_INSERT_TAIL(&handle->list, item, next);
+  handle->size += len;
+  return item;
+}
+
+outbox_item_handle_t outbox_get(outbox_handle_t handle, int msg_id) {
+  outbox_item_t *item;
+  STAILQ_FOREACH(item, &handle->list, next) {
+    if (item->msg_id == msg_id)
+      return item;
+  }
+  return NULL;
+}
+
+outbox_item_handle_t outbox_dequeue(outbox_handle_t handle,
+                                    pending_state_t pending,
+                                    outbox_tick_t *tick) {
+  outbox_item_t *item;
+  STAILQ_FOREACH(item, &handle->list, next) {
+    if (item->pending == pending) {
+      if (tick != NULL)
+        *tick = item->tick;
+      return item;
+    }
+  }
+  return NULL;
+}
+
+uint8_t *outbox_item_get_data(outbox_item_handle_t item, size_t *len,
+                              uint16_t *msg_id, int *msg_type, int *qos) {
+  if (item == NULL)
+    return NULL;
+  *len = (size_t)item->len;
+  *msg_id = (uint16_t)item->msg_id;
+  *msg_type = item->msg_type;
+  *qos = item->msg_qos;
+  return item->buffer;
+}
+
+esp_err_t outbox_delete_item(outbox_handle_t handle,
+                             outbox_item_handle_t item_to_delete) {
+  outbox_item_t *item;
+  STAILQ_FOREACH(item, &handle->list, next) {
+    if (item == item_to_delete) {
+      remove_item(handle, item);
+      return ESP_OK;
+    }
+  }
+  return ESP_FAIL;
+}
+
+esp_err_t outbox_delete(outbox_handle_t handle, int msg_id, int msg_type) {
+  outbox_item_t *item;
+  STAILQ_FOREACH(item, &handle->list, next) {
+    if (item->msg_id == msg_id && (0xFF & item->msg_type) == (0xFF & msg_type)) {
+      remove_item(handle, item);
+      return ESP_OK;
+    }
+  }
+  return ESP_FAIL;
+}
+
+int outbox_delete_single_expired(outbox_handle_t handle,
+                                 outbox_tick_t current_tick,
+                                 outbox_tick_t timeout) {
+  outbox_item_t *item;
+  STAILQ_FOREACH(item, &handle->list, next) {
+    if (current_tick - item->tick > timeout) {
+      const int msg_id = item->msg_id;
+      remove_item(handle, item);
+      return msg_id;
+    }
+  }
+  return -1;
+}
+
+int outbox_delete_expired(outbox_handle_t handle, outbox_tick_t current_tick,
+                          outbox_tick_t timeout) {
+  int deleted = 0;
+  // not STAILQ_FOREACH_SAFE, glibc's sys/queue.h (the linux target) lacks it
+  outbox_item_t *item = STAILQ_FIRST(&handle->list);
+  while (item != NULL) {
+    outbox_item_t *following = STAILQ_NEXT(item, next);
+    if (current_tick - item->tick > timeout) {
+      remove_item(handle, item);
+      deleted++;
+    }
+    item = following;
+  }
+  return deleted;
+}
+
+esp_err_t outbox_set_pending(outbox_handle_t handle, int msg_id,
+                             pending_state_t pending) {
+  outbox_item_t *item = outbox_get(handle, msg_id);
+  if (item == NULL)
+    return ESP_FAIL;
+  item->pending = pending;
+  return ESP_OK;
+}
+
+pending_state_t outbox_item_get_pending(outbox_item_handle_t item) {
+  return item != NULL ? item->pending : QUEUED;
+}
+
+esp_err_t outbox_set_tick(outbox_handle_t handle, int msg_id,
+                          outbox_tick_t tick) {
+  outbox_item_t *item = outbox_get(handle, msg_id);
+  if (item == NULL)
+    return ESP_FAIL;
+  item->tick = tick;
+  return ESP_OK;
+}
+
+uint64_t outbox_get_size(outbox_handle_t handle) { return handle->size; }
+
+void outbox_delete_all_items(outbox_handle_t handle) {
+  outbox_item_t *item;
+  while ((item = STAILQ_FIRST(&handle->list)) != NULL) {
+    remove_item(handle, item);
+  }
+}
+
+void outbox_destroy(outbox_handle_t handle) {
+  outbox_delete_all_items(handle);
+  outbox_taken = false;
+}
+
+void outbox_pool_get_stats(OutboxPoolStats *stats) {
+  stats->in_use = atomic_load(&slots_in_use);
+  stats->peak = atomic_load(&slots_peak);
+  stats->heap_copies = atomic_load(&heap_copies);
+}
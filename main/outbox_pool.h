@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+
+#ifndef _OUTBOX_POOL_H
+#define _OUTBOX_POOL_H
+
+#include "publish_context.h"
+#include "sdkconfig.h"
+
+#include <stdint.h>
+
+// The MQTT client's outbox (CONFIG_MQTT_CUSTOM_OUTBOX), which holds every
+// QoS 1 and 2 message until its PUBACK (or PUBCOMP) arrives. Instead of
+// allocating a copy of each message on the heap, as esp-mqtt's own outbox
+// does, it copies them into slots of a static pool and hands a slot back as
+// soon as the message is acknowledged or given up on. The publish window caps
+// the messages in flight, so a slot for each of them, one for the birth
+// message and one spare are all the pool needs; a message that doesn't fit a
+// free slot is still taken, on the heap, and counted.
+//
+// outbox_pool.c is built into the MQTT client (see main/CMakeLists.txt), it
+// replaces esp-mqtt's mqtt_outbox.c.
+
+#define OUTBOX_POOL_SLOTS (CONFIG_MQTT_INFLIGHT_WINDOW + 2)
+
+// The largest header esp-mqtt encodes in front of a PUBLISH payload: the
+// fixed header (1 byte and up to 4 of remaining length), the topic's length
+// (2), the topic itself (up to PUBLISH_TOPIC_LENGTH) and the packet
+// identifier (2)
+#define OUTBOX_POOL_MQTT_HEADER_SIZE (1 + 4 + 2 + PUBLISH_TOPIC_LENGTH + 2)
+#if CONFIG_MQTT_V5
+// MQTT 5 adds the properties mqtt_manager.c sets on a publish: their length
+// (up to 4), the topic alias (3) and the message expiry interval (5)
+#define OUTBOX_POOL_HEADER_SIZE (OUTBOX_POOL_MQTT_HEADER_SIZE + 4 + 3 + 5)
+#else
+#define OUTBOX_POOL_HEADER_SIZE OUTBOX_POOL_MQTT_HEADER_SIZE
+#endif
+
+// A message at its largest, anything bigger is copied to the heap and counted
+// in heap_copies
+#define OUTBOX_POOL_SLOT_SIZE                                                  \
+  (CONFIG_MQTT_PAYLOAD_BUFFER_SIZE + OUTBOX_POOL_HEADER_SIZE)
+
+typedef struct {
+  uint32_t in_use;      // slots holding a message
+  uint32_t peak;        // most slots in use at once
+  uint32_t heap_copies; // messages that had to be copied to the heap
+} OutboxPoolStats;
+
+/**
+ * @brief Gets the pool's statistics.
+ *
+ * Safe to call from any task. Only available with CONFIG_MQTT_CUSTOM_OUTBOX,
+ * without it esp-mqtt's own outbox is used.
+ */
+void outbox_pool_get_stats(OutboxPoolStats *stats);
+
+#endif
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "publish_context.h"
+
+#include "device_id.h"
+#include "esp_log.h"
+#include "json_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "publish_context";
+
+static PublishContext contexts[SENSOR_DESCRIPTOR_COUNT];
+
+// "device":"EDLAVP-XXXXXXXXXXXX", plus the quotes and the colon
+static char device_member[DEVICE_ID_STRING_LENGTH + 16];
+static size_t device_member_length;
+
+static char birth_topic[PUBLISH_TOPIC_LENGTH];
+static char metrics_topic[PUBLISH_TOPIC_LENGTH];
+
+void publish_context_init(void) {
+  const char *device_id = get_device_id();
+  JsonWriter writer;
+
+  json_writer_init(&writer, device_member, sizeof(device_member));
+  json_writer_add_string(&writer, "device", device_id);
+  if (!json_writer_finish(&writer)) {
+    ESP_LOGE(TAG, "FATAL: Device member does not fit its buffer");
+    abort();
+  }
+  device_member_length = writer.length;
+
+  snprintf(birth_topic, sizeof(birth_topic), "edlavp/%s/birth", device_id);
+  snprintf(metrics_topic, sizeof(metrics_topic), "edlavp/%s/metrics",
+           device_id);
+
+  for (uint8_t id = 0; id < SENSOR_DESCRIPTOR_COUNT; id++) {
+    PublishContext *context = &contexts[id];
+    context->descriptor = sensor_descriptor_get(id);
+    snprintf(context->topic, sizeof(context->topic), "edlavp/%s/sensor/%s",
+             device_id, context->descriptor->topic);
+    snprintf(context->binary_topic, sizeof(context->binary_topic), "%s/bin",
+             context->topic);
+
+    json_writer_init(&writer, context->fields, sizeof(context->fields));
+    json_writer_add_string(&writer, "sensor", context->descriptor->sensor_type);
+    json_writer_add_string(&writer, "unit", context->descriptor->unit);
+    if (!json_writer_finish(&writer)) {
+      ESP_LOGE(TAG, "FATAL: Fields of sensor \"%s\" do not fit their buffer",
+               context->descriptor->sensor_type);
+      abort();
+    }
+    context->fields_length = writer.length;
+  }
+}
+
+const PublishContext *publish_context_get(const uint8_t descriptor) {
+  if (descriptor >= SENSOR_DESCRIPTOR_COUNT)
+    return NULL;
+  return &contexts[descriptor];
+}
+
+const char *publish_context_device_member(size_t *length) {
+  *length = device_member_length;
+  return device_member;
+}
+
+const char *publish_context_birth_topic(void) { return birth_topic; }
+
+const char *publish_context_metrics_topic(void) { return metrics_topic; }
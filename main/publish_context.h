@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _PUBLISH_CONTEXT_H
+#define _PUBLISH_CONTEXT_H
+
+#include "sensor_descriptors.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PUBLISH_TOPIC_LENGTH 128
+#define PUBLISH_FIELDS_LENGTH 96
+
+/**
+ * Everything about publishing a sensor's readouts that stays the same for
+ * the lifetime of the firmware, worked out once at startup so publishing
+ * only has to format what changes from readout to readout.
+ */
+typedef struct {
+  const SensorDescriptor *descriptor;
+  char topic[PUBLISH_TOPIC_LENGTH];        // "edlavp/<device-id>/sensor/<topic>"
+  char binary_topic[PUBLISH_TOPIC_LENGTH]; // the same with "/bin" appended
+  // the "sensor" and "unit" members of a readout object, serialized (see
+  // json_writer_add_members())
+  char fields[PUBLISH_FIELDS_LENGTH];
+  size_t fields_length;
+} PublishContext;
+
+/**
+ * @brief Builds the publish context of every sensor.
+ *
+ * Must be called once during startup, after device_id_init() and before the
+ * mqtt_manager task starts.
+ */
+void publish_context_init(void);
+
+/**
+ * @brief Gets the publish context of a sensor.
+ *
+ * @param descriptor The descriptor index stored in a readout.
+ * @return Pointer to the context, or NULL if @p descriptor is out of range.
+ */
+const PublishContext *publish_context_get(uint8_t descriptor);
+
+/**
+ * @brief Gets the "device" member of the metadata object, serialized.
+ *
+ * @param length Set to the length of the returned string.
+ */
+const char *publish_context_device_member(size_t *length);
+
+// Gets the topic of the MQTT 5 birth message, "edlavp/<device-id>/birth"
+const char *publish_context_birth_topic(void);
+
+// Gets the topic of the metrics snapshots, "edlavp/<device-id>/metrics"
+const char *publish_context_metrics_topic(void);
+
+#endif //_PUBLISH_CONTEXT_H
@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "publish_window.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include <string.h>
+
+static const char *TAG = "publish_window";
+
+#define INFLIGHT_TIMEOUT_US (CONFIG_MQTT_INFLIGHT_TIMEOUT * 1000000LL)
+
+typedef struct {
+  bool used;
+  bool sealed;  // publish_window_end() was called
+  bool resend;  // hand the readouts back if a message is lost
+  bool lost;    // one of its messages was lost
+  uint16_t pending; // messages still in flight
+  size_t count;
+  UniversalSingleReadout records[PUBLISH_UNIT_MAX_RECORDS];
+} PublishUnit;
+
+typedef struct {
+  bool used;
+  int msg_id;
+  uint8_t unit;
+  int64_t sent; // esp_timer_get_time() when it was published
+} InflightMessage;
+
+// guards everything below, the acks come in on the MQTT client's task
+static portMUX_TYPE window_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static PublishUnit units[CONFIG_MQTT_INFLIGHT_WINDOW];
+static InflightMessage messages[CONFIG_MQTT_INFLIGHT_WINDOW];
+static int current_unit = -1;
+static PublishWindowStats stats;
+
+// records of units that lost a message, waiting to be taken back
+#define LOST_RING_SIZE (CONFIG_MQTT_INFLIGHT_WINDOW * PUBLISH_UNIT_MAX_RECORDS)
+static UniversalSingleReadout lost_ring[LOST_RING_SIZE];
+static size_t lost_head = 0;  // next slot to write
+static size_t lost_count = 0; // records waiting
+static uint32_t lost_overflow = 0; // readouts dropped from a full lost_ring
+
+// Set by the publishing task before it waits for the window to move, so the
+// acks know to wake it up. As with the readout queue, a notification can be
+// left over from another wait, so waking up only means "check again".
+static TaskHandle_t waiting_task = NULL;
+static bool task_waiting = false;
+
+static bool connected = false;
+
+// Frees a unit once nothing of it is in flight anymore, moving its readouts
+// to lost_ring if they have to be handed back. Must be called with
+// window_lock held.
+static void settle_unit(const int index) {
+  PublishUnit *unit = &units[index];
+  if (!unit->used || !unit->sealed || unit->pending > 0)
+    return;
+  unit->used = false;
+  if (!unit->lost || !unit->resend)
+    return;
+
+  for (size_t i = 0; i < unit->count; i++) {
+    if (lost_count == LOST_RING_SIZE) {
+      // overwriting the oldest record, a summary left behind without its
+      // readout is skipped when taken back
+      if (!readout_is_summary(&lost_ring[lost_head]))
+        lost_overflow++;
+    } else {
+      lost_count++;
+    }
+    lost_ring[lost_head] = unit->records[i];
+    lost_head = (lost_head + 1) % LOST_RING_SIZE;
+  }
+}
+
+// Must be called with window_lock held
+static void release_message(InflightMessage *message, const bool acked,
+                            const int64_t now) {
+  PublishUnit *unit = &units[message->unit];
+  message->used = false;
+  stats.in_flight--;
+  if (acked) {
+    const int64_t latency = now - message->sent;
+    int64_t bound_ms = 1;
+    size_t bucket = 0;
+    while (bucket < PUBLISH_LATENCY_BUCKETS - 1 && latency >= bound_ms * 1000) {
+      bound_ms *= 2;
+      bucket++;
+    }
+    stats.latency_histogram[bucket]++;
+    if (latency > stats.max_latency_us)
+      stats.max_latency_us = latency;
+    stats.acked++;
+  } else {
+    unit->lost = true;
+    stats.lost++;
+  }
+  unit->pending--;
+  settle_unit(message->unit);
+}
+
+// Gives up on messages that went unacknowledged for too long, returns how
+// many. Must be called with window_lock held.
+static unsigned expire_overdue(const int64_t now) {
+  unsigned expired = 0;
+  for (size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++) {
+    if (messages[i].used && now - messages[i].sent >= INFLIGHT_TIMEOUT_US) {
+      release_message(&messages[i], false, now);
+      expired++;
+    }
+  }
+  return expired;
+}
+
+// Time until the oldest message in flight expires. Must be called with
+// window_lock held.
+static int64_t next_expiry(const int64_t now) {
+  int64_t next = INFLIGHT_TIMEOUT_US;
+  for (size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++) {
+    if (messages[i].used && messages[i].sent + INFLIGHT_TIMEOUT_US - now < next)
+      next = messages[i].sent + INFLIGHT_TIMEOUT_US - now;
+  }
+  return next;
+}
+
+static bool has_free_unit(void) {
+  for (size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++) {
+    if (!units[i].used)
+      return true;
+  }
+  return false;
+}
+
+static bool has_free_slot(void) {
+  for (size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++) {
+    if (!messages[i].used)
+      return true;
+  }
+  return false;
+}
+
+static bool is_empty(void) { return stats.in_flight == 0; }
+
+// Waits until @p ready returns true, for up to @p ticks_to_wait. Returns
+// false on timeout, or if the client isn't connected.
+static bool wait_for(bool (*ready)(void), TickType_t ticks_to_wait) {
+  TimeOut_t timeout;
+  vTaskSetTimeOutState(&timeout);
+
+  while (1) {
+    const int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&window_lock);
+    const unsigned expired = expire_overdue(now);
+    const bool is_ready = ready();
+    const bool is_connected = connected;
+    const int64_t until_expiry = next_expiry(now);
+    task_waiting = !is_ready && is_connected;
+    waiting_task = xTaskGetCurrentTaskHandle();
+    portEXIT_CRITICAL(&window_lock);
+
+    if (expired > 0) {
+      ESP_LOGW(TAG, "%u message(s) not acknowledged within %d seconds, "
+                    "giving up on them",
+               expired, CONFIG_MQTT_INFLIGHT_TIMEOUT);
+    }
+    if (is_ready)
+      return true;
+    if (!is_connected)
+      return false;
+    if (xTaskCheckForTimeOut(&timeout, &ticks_to_wait) == pdTRUE) {
+      portENTER_CRITICAL(&window_lock);
+      task_waiting = false;
+      portEXIT_CRITICAL(&window_lock);
+      return false;
+    }
+
+    // wake up in time to expire the oldest message
+    const TickType_t until_expiry_ticks =
+        pdMS_TO_TICKS(until_expiry / 1000) + 1;
+    ulTaskNotifyTake(pdTRUE, until_expiry_ticks < ticks_to_wait
+                                 ? until_expiry_ticks
+                                 : ticks_to_wait);
+  }
+}
+
+bool publish_window_begin(const UniversalSingleReadout *records,
+                          size_t count) {
+  if (count > PUBLISH_UNIT_MAX_RECORDS) {
+    ESP_LOGE(TAG, "Unit of %d records is too large, only tracking %d",
+             (int)count, PUBLISH_UNIT_MAX_RECORDS);
+    // only whole readouts, without a summary cut off
+    size_t kept = 0;
+    while (kept + readout_records(&records[kept]) <= PUBLISH_UNIT_MAX_RECORDS)
+      kept += readout_records(&records[kept]);
+    count = kept;
+  }
+
+  if (!wait_for(has_free_unit, portMAX_DELAY))
+    return false;
+
+  // only claiming the unit needs the lock, its readouts aren't looked at by
+  // anyone else before it is sealed
+  int claimed = -1;
+  portENTER_CRITICAL(&window_lock);
+  for (size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++) {
+    if (units[i].used)
+      continue;
+    units[i].used = true;
+    units[i].sealed = false;
+    units[i].resend = true;
+    units[i].lost = false;
+    units[i].pending = 0;
+    claimed = (int)i;
+    break;
+  }
+  portEXIT_CRITICAL(&window_lock);
+
+  if (count > 0)
+    memcpy(units[claimed].records, records, count * sizeof(*records));
+  units[claimed].count = count;
+  current_unit = claimed;
+  return true;
+}
+
+bool publish_window_wait_slot(void) {
+  return wait_for(has_free_slot, portMAX_DELAY);
+}
+
+void publish_window_track(const int msg_id) {
+  const int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&window_lock);
+  for (size_t i = 0; current_unit >= 0 && i < CONFIG_MQTT_INFLIGHT_WINDOW;
+       i++) {
+    if (messages[i].used)
+      continue;
+    messages[i].used = true;
+    messages[i].msg_id = msg_id;
+    messages[i].unit = (uint8_t)current_unit;
+    messages[i].sent = now;
+    units[current_unit].pending++;
+    stats.published++;
+    stats.in_flight++;
+    break;
+  }
+  portEXIT_CRITICAL(&window_lock);
+}
+
+void publish_window_end(const bool published) {
+  portENTER_CRITICAL(&window_lock);
+  if (current_unit >= 0) {
+    units[current_unit].sealed = true;
+    if (!published)
+      units[current_unit].resend = false;
+    settle_unit(current_unit);
+    current_unit = -1;
+  }
+  portEXIT_CRITICAL(&window_lock);
+}
+
+size_t publish_window_take_lost(UniversalSingleReadout *records,
+                                const size_t max_records) {
+  size_t count = 0;
+  portENTER_CRITICAL(&window_lock);
+  expire_overdue(esp_timer_get_time());
+  size_t tail = (lost_head + LOST_RING_SIZE - lost_count) % LOST_RING_SIZE;
+  while (lost_count > 0) {
+    if (readout_is_summary(&lost_ring[tail])) {
+      // its readout was overwritten
+      tail = (tail + 1) % LOST_RING_SIZE;
+      lost_count--;
+      continue;
+    }
+    const size_t length = readout_records(&lost_ring[tail]);
+    if (count + length > max_records)
+      break;
+    for (size_t i = 0; i < length; i++) {
+      records[count++] = lost_ring[tail];
+      tail = (tail + 1) % LOST_RING_SIZE;
+      lost_count--;
+    }
+  }
+  const uint32_t overflow = lost_overflow;
+  lost_overflow = 0;
+  portEXIT_CRITICAL(&window_lock);
+
+  if (overflow > 0) {
+    ESP_LOGE(TAG, "Too many lost messages, dropped %u of their readouts",
+             (unsigned)overflow);
+  }
+  return count;
+}
+
+bool publish_window_flush(const TickType_t ticks_to_wait) {
+  return wait_for(is_empty, ticks_to_wait);
+}
+
+// Finds the message with the given msg_id, acks for messages that were
+// already given up on are ignored. Must be called with window_lock held.
+static InflightMessage *find_message(const int msg_id) {
+  for (size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++) {
+    if (messages[i].used && messages[i].msg_id == msg_id)
+      return &messages[i];
+  }
+  return NULL;
+}
+
+static void settle_message(const int msg_id, const bool acked) {
+  bool wake = false;
+  portENTER_CRITICAL(&window_lock);
+  InflightMessage *message = find_message(msg_id);
+  if (message != NULL) {
+    release_message(message, acked, esp_timer_get_time());
+    wake = task_waiting;
+    task_waiting = false;
+  }
+  portEXIT_CRITICAL(&window_lock);
+
+  if (wake) {
+    xTaskNotifyGive(waiting_task);
+  }
+}
+
+void publish_window_ack(const int msg_id) { settle_message(msg_id, true); }
+
+void publish_window_lost(const int msg_id) {
+  ESP_LOGW(TAG, "Message %d was dropped by the MQTT client", msg_id);
+  settle_message(msg_id, false);
+}
+
+void publish_window_set_connected(const bool is_connected) {
+  bool wake;
+  portENTER_CRITICAL(&window_lock);
+  connected = is_connected;
+  wake = task_waiting;
+  task_waiting = false;
+  portEXIT_CRITICAL(&window_lock);
+
+  if (wake) {
+    xTaskNotifyGive(waiting_task);
+  }
+}
+
+void publish_window_get_stats(PublishWindowStats *out) {
+  portENTER_CRITICAL(&window_lock);
+  *out = stats;
+  portEXIT_CRITICAL(&window_lock);
+}
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _PUBLISH_WINDOW_H
+#define _PUBLISH_WINDOW_H
+
+#include "freertos/FreeRTOS.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Flow control and delivery tracking of the QoS 1 and 2 publishes. QoS 0
+// messages bypass it, there is nothing to wait for.
+//
+// At most CONFIG_MQTT_INFLIGHT_WINDOW messages are waiting for their PUBACK
+// (or PUBCOMP) at any time, and the readouts they carry are held here until
+// every message carrying them has been acknowledged. While the broker is away
+// the client keeps the messages in its outbox and re-sends them after
+// reconnecting, with the same msg_id. A message the client gives up on
+// (deleted from its outbox) or that isn't acknowledged within
+// CONFIG_MQTT_INFLIGHT_TIMEOUT seconds is lost, and the readouts it carried
+// are handed back through publish_window_take_lost() to be published again.
+//
+// The readouts published together (a single readout, or the readouts of one
+// sensor in a batch, each with its summary record if it has one) form a
+// unit, which may go out as several messages (one per encoding, or split
+// over payloads). Each readout is held in exactly one place: by the window
+// once its unit is published, or by the caller (in the readout log) if
+// publishing the unit failed. Readouts drained from the log stay there
+// instead, until their messages have been acknowledged.
+//
+// Everything but publish_window_ack(), publish_window_lost(),
+// publish_window_set_connected() and publish_window_get_stats() must be
+// called from the publishing task.
+
+#if CONFIG_MQTT_BATCH_PUBLISHING
+#define PUBLISH_UNIT_MAX_RECORDS CONFIG_MQTT_BATCH_MAX_READOUTS
+#else
+#define PUBLISH_UNIT_MAX_RECORDS 2 // a readout and its summary
+#endif
+
+// bucket 0 counts acks within 1 ms, bucket i within [2^(i-1), 2^i) ms, and
+// the last bucket everything slower
+#define PUBLISH_LATENCY_BUCKETS 16
+
+typedef struct {
+  uint32_t published; // messages handed to the client
+  uint32_t acked;     // messages acknowledged by the broker
+  uint32_t lost;      // messages given up on
+  uint32_t in_flight; // messages waiting for their PUBACK right now
+  int64_t max_latency_us;
+  uint32_t latency_histogram[PUBLISH_LATENCY_BUCKETS]; // publish to PUBACK
+} PublishWindowStats;
+
+/**
+ * @brief Starts a unit holding a copy of @p records (readouts, each
+ * followed by its summary record if it has one), waiting for a free unit
+ * first.
+ *
+ * @p records is NULL and @p count 0 for readouts the caller keeps until
+ * they are acknowledged, as the readout log does. Nothing is handed back
+ * for such a unit if a message is lost.
+ *
+ * @return false if the client disconnected while waiting, no unit was
+ * started then.
+ */
+bool publish_window_begin(const UniversalSingleReadout *records,
+                          size_t count);
+
+// Waits until another message may be published, returns false if the client
+// is or gets disconnected first
+bool publish_window_wait_slot(void);
+
+// Adds a message published for the current unit
+void publish_window_track(int msg_id);
+
+/**
+ * @brief Ends the current unit.
+ *
+ * @param published false if publishing failed, in which case the caller
+ * takes care of the readouts and the unit is dropped once its messages are
+ * settled.
+ */
+void publish_window_end(bool published);
+
+/**
+ * @brief Takes back readouts of units that lost a message, oldest first,
+ * along with their summary records.
+ *
+ * @return The number of records copied into @p records, 0 if there are
+ * none.
+ */
+size_t publish_window_take_lost(UniversalSingleReadout *records,
+                                size_t max_records);
+
+/**
+ * @brief Waits until no message is in flight anymore.
+ *
+ * @return false if some still were after @p ticks_to_wait, or when the client
+ * disconnected.
+ */
+bool publish_window_flush(TickType_t ticks_to_wait);
+
+// MQTT event handler side
+
+void publish_window_ack(int msg_id);
+void publish_window_lost(int msg_id);
+
+// Tells the window whether the client is connected. While it isn't, nothing
+// waits for acks that can't come in.
+void publish_window_set_connected(bool connected);
+
+// Gets the delivery statistics, safe to call from any task
+void publish_window_get_stats(PublishWindowStats *stats);
+
+#endif //_PUBLISH_WINDOW_H
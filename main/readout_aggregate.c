@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "readout_aggregate.h"
+
+#include <math.h>
+
+double readout_min(const UniversalSingleReadout *readout,
+                   const ReadoutSummary *summary) {
+  return readout_value_from_fixed(readout->value) -
+         readout_spread_from_fixed(summary->below);
+}
+
+double readout_max(const UniversalSingleReadout *readout,
+                   const ReadoutSummary *summary) {
+  return readout_value_from_fixed(readout->value) +
+         readout_spread_from_fixed(summary->above);
+}
+
+void readout_aggregate_merge(UniversalSingleReadout *into,
+                             ReadoutSummary *into_summary,
+                             const UniversalSingleReadout *other,
+                             const ReadoutSummary *other_summary) {
+  // a count of 0 can only come from a zeroed record, count it as one sample
+  const double n1 = into_summary->samples > 0 ? into_summary->samples : 1;
+  const double n2 = other_summary->samples > 0 ? other_summary->samples : 1;
+  const double n = n1 + n2;
+
+  const double mean1 = readout_value_from_fixed(into->value);
+  const double mean2 = readout_value_from_fixed(other->value);
+  const double mean = (n1 * mean1 + n2 * mean2) / n;
+
+  // parallel variance: each side's variance plus its mean's distance from
+  // the combined mean
+  const double sd1 = readout_spread_from_fixed(into_summary->stddev);
+  const double sd2 = readout_spread_from_fixed(other_summary->stddev);
+  const double variance =
+      (n1 * (sd1 * sd1 + (mean1 - mean) * (mean1 - mean)) +
+       n2 * (sd2 * sd2 + (mean2 - mean) * (mean2 - mean))) /
+      n;
+
+  const double min = fmin(readout_min(into, into_summary),
+                          readout_min(other, other_summary));
+  const double max = fmax(readout_max(into, into_summary),
+                          readout_max(other, other_summary));
+
+  // a readout from before the first clock sync can't be compared with one
+  // from after it, the merged one keeps the time (and time base) of @p into
+  const bool same_base =
+      ((into->flags ^ other->flags) & READOUT_FLAG_MONOTONIC) == 0;
+  if (same_base && readout_time_before(other, into)) {
+    into->timestamp = other->timestamp;
+    into->subsecond = other->subsecond;
+  }
+  into->value = readout_value_to_fixed(mean);
+  into->flags |= (other->flags & ~READOUT_FLAG_MONOTONIC) |
+                 READOUT_FLAG_AGGREGATE | READOUT_FLAG_SUMMARY;
+  into_summary->descriptor = READOUT_SUMMARY_DESCRIPTOR;
+  into_summary->samples = n >= UINT16_MAX ? UINT16_MAX : (uint16_t)n;
+  into_summary->suppressed =
+      readout_count_add(into_summary->suppressed, other_summary->suppressed);
+  // measured from the rounded mean, so min and max are only off by the
+  // rounding of the spread. That is redone on every merge, and so is the
+  // rounding of the mean and standard deviation: a readout merged N times
+  // drifts by about sqrt(N) rounding steps.
+  into_summary->below = readout_spread_to_fixed(
+      readout_value_from_fixed(into->value) - min);
+  into_summary->above = readout_spread_to_fixed(
+      max - readout_value_from_fixed(into->value));
+  into_summary->stddev = readout_spread_to_fixed(sqrt(variance));
+}
+
+void readout_accumulator_reset(ReadoutAccumulator *accumulator) {
+  accumulator->start = 0;
+  accumulator->start_subsecond = 0;
+  accumulator->count = 0;
+  accumulator->mean = 0;
+  accumulator->m2 = 0;
+  accumulator->min = INFINITY;
+  accumulator->max = -INFINITY;
+  accumulator->flags = 0;
+  accumulator->suppressed = 0;
+}
+
+void readout_accumulator_add(ReadoutAccumulator *accumulator,
+                             const UniversalSingleReadout *readout,
+                             const ReadoutSummary *summary) {
+  const double n_a = accumulator->count;
+  const double n_b = summary->samples > 0 ? summary->samples : 1;
+  const double n = n_a + n_b;
+  const double mean_b = readout_value_from_fixed(readout->value);
+  const double sd_b = readout_spread_from_fixed(summary->stddev);
+  const double delta = mean_b - accumulator->mean;
+
+  // for a single sample (n_b = 1, sd_b = 0) this is the plain Welford update
+  accumulator->mean += delta * n_b / n;
+  accumulator->m2 += sd_b * sd_b * n_b + delta * delta * n_a * n_b / n;
+  accumulator->min = fmin(accumulator->min, readout_min(readout, summary));
+  accumulator->max = fmax(accumulator->max, readout_max(readout, summary));
+
+  accumulator->flags |= readout->flags;
+  if (accumulator->count == 0 || readout->timestamp < accumulator->start ||
+      (readout->timestamp == accumulator->start &&
+       readout->subsecond < accumulator->start_subsecond)) {
+    accumulator->start = readout->timestamp;
+    accumulator->start_subsecond = readout->subsecond;
+  }
+  accumulator->count += (uint32_t)n_b;
+  accumulator->suppressed += summary->suppressed;
+}
+
+void readout_accumulator_summarize(const ReadoutAccumulator *accumulator,
+                                   UniversalSingleReadout *readout,
+                                   ReadoutSummary *summary) {
+  readout->timestamp = accumulator->start;
+  readout->subsecond = accumulator->start_subsecond;
+  readout->value = readout_value_to_fixed(accumulator->mean);
+  readout->flags |= accumulator->flags | READOUT_FLAG_AGGREGATE |
+                    READOUT_FLAG_SUMMARY;
+  summary->descriptor = READOUT_SUMMARY_DESCRIPTOR;
+  summary->samples = accumulator->count >= UINT16_MAX
+                         ? UINT16_MAX
+                         : (uint16_t)accumulator->count;
+  summary->suppressed = readout_count_add(0, accumulator->suppressed);
+
+  const double mean = readout_value_from_fixed(readout->value);
+  summary->below = readout_spread_to_fixed(mean - accumulator->min);
+  summary->above = readout_spread_to_fixed(accumulator->max - mean);
+  summary->stddev =
+      readout_spread_to_fixed(sqrt(accumulator->m2 / accumulator->count));
+}
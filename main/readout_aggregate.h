@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _READOUT_AGGREGATE_H
+#define _READOUT_AGGREGATE_H
+
+#include "types.h"
+
+// Lowest and highest sample a readout with the given summary (see
+// readout_get_summary()) stands for. For a single sample both are the value
+// itself.
+double readout_min(const UniversalSingleReadout *readout,
+                   const ReadoutSummary *summary);
+double readout_max(const UniversalSingleReadout *readout,
+                   const ReadoutSummary *summary);
+
+/**
+ * @brief Folds @p other into @p into, leaving an aggregate of both.
+ *
+ * Each readout comes with its summary, see readout_get_summary(). Either one
+ * may be a single sample or an aggregate already, the result is an aggregate
+ * with READOUT_FLAG_SUMMARY set, to be stored along with @p into_summary. The
+ * sample
+ * counts, means, extremes and variances are combined exactly, but the result
+ * is rounded to the fixed-point precision of the record again, so repeated
+ * merges drift by about the square root of their number in rounding steps.
+ * The result keeps the older timestamp. Both readouts must come from the same
+ * sensor channel.
+ */
+void readout_aggregate_merge(UniversalSingleReadout *into,
+                             ReadoutSummary *into_summary,
+                             const UniversalSingleReadout *other,
+                             const ReadoutSummary *other_summary);
+
+/**
+ * @brief Running statistics over a stream of readouts.
+ *
+ * Uses Welford's streaming mean/variance, generalized to also take in
+ * aggregates (Chan et al.), so it never needs to hold the samples and stays
+ * numerically stable over long windows.
+ */
+typedef struct {
+  uint32_t start; // timestamp of the oldest readout added
+  uint8_t start_subsecond;
+  uint32_t count; // number of samples added
+  double mean;
+  double m2; // sum of squared distances from the mean
+  double min;
+  double max;
+  uint8_t flags; // READOUT_FLAG_* of every readout added, or-ed together
+  uint32_t suppressed; // readouts suppressed before the ones added
+} ReadoutAccumulator;
+
+void readout_accumulator_reset(ReadoutAccumulator *accumulator);
+
+// Adds a readout (a single sample or an aggregate) with its summary to the
+// statistics
+void readout_accumulator_add(ReadoutAccumulator *accumulator,
+                             const UniversalSingleReadout *readout,
+                             const ReadoutSummary *summary);
+
+/**
+ * @brief Fills in an aggregate readout and its summary.
+ *
+ * Sets the timestamp (to the oldest readout added), value and flags of
+ * @p readout, and the sample and suppressed counts and spread of
+ * @p summary. The descriptor and channel are left to the caller. Must not be
+ * called on an empty accumulator.
+ */
+void readout_accumulator_summarize(const ReadoutAccumulator *accumulator,
+                                   UniversalSingleReadout *readout,
+                                   ReadoutSummary *summary);
+
+#endif //_READOUT_AGGREGATE_H
@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include "readout_codec.h"
+
+#include <string.h>
+
+// the fields are written byte by byte so the output doesn't depend on the
+// endianness or struct packing of the machine doing the encoding
+
+static void put_u16(uint8_t *dst, const uint16_t value) {
+  dst[0] = (uint8_t)value;
+  dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *dst, const uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    dst[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static void put_u64(uint8_t *dst, const uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    dst[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static uint16_t get_u16(const uint8_t *src) {
+  return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *src) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value |= (uint32_t)src[i] << (8 * i);
+  }
+  return value;
+}
+
+static uint64_t get_u64(const uint8_t *src) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= (uint64_t)src[i] << (8 * i);
+  }
+  return value;
+}
+
+bool readout_encoder_init(ReadoutEncoder *encoder, uint8_t *buffer,
+                          const size_t capacity) {
+  encoder->buffer = buffer;
+  encoder->capacity = capacity;
+  encoder->length = 0;
+  encoder->count = 0;
+
+  if (capacity < READOUT_CODEC_HEADER_SIZE)
+    return false;
+
+  buffer[0] = READOUT_CODEC_MAGIC;
+  buffer[1] = READOUT_CODEC_VERSION;
+  put_u16(&buffer[2], 0);
+  encoder->length = READOUT_CODEC_HEADER_SIZE;
+  return true;
+}
+
+static void put_f32(uint8_t *dst, const float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put_u32(dst, bits);
+}
+
+static float get_f32(const uint8_t *src) {
+  const uint32_t bits = get_u32(src);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static size_t record_size(const uint8_t flags) {
+  size_t size = READOUT_CODEC_RECORD_SIZE;
+  if (flags & READOUT_CODEC_FLAG_AGGREGATE)
+    size += READOUT_CODEC_AGGREGATE_SIZE;
+  if (flags & READOUT_CODEC_FLAG_SUPPRESSED)
+    size += READOUT_CODEC_SUPPRESSED_SIZE;
+  return size;
+}
+
+bool readout_encoder_append(ReadoutEncoder *encoder,
+                            const ReadoutRecord *record) {
+  const size_t size = record_size(record->flags);
+  if (encoder->length == 0 || encoder->count == UINT16_MAX ||
+      encoder->capacity - encoder->length < size)
+    return false;
+
+  uint8_t *dst = encoder->buffer + encoder->length;
+  put_u64(&dst[0], (uint64_t)record->timestamp);
+  put_f32(&dst[8], record->value);
+  put_u64(&dst[12], record->address);
+  dst[20] = record->flags;
+  dst += READOUT_CODEC_RECORD_SIZE;
+  if (record->flags & READOUT_CODEC_FLAG_AGGREGATE) {
+    put_u16(&dst[0], record->samples);
+    put_f32(&dst[2], record->min);
+    put_f32(&dst[6], record->max);
+    put_f32(&dst[10], record->stddev);
+    dst += READOUT_CODEC_AGGREGATE_SIZE;
+  }
+  if (record->flags & READOUT_CODEC_FLAG_SUPPRESSED) {
+    put_u16(&dst[0], record->suppressed);
+  }
+
+  encoder->length += size;
+  encoder->count++;
+  put_u16(&encoder->buffer[2], encoder->count);
+  return true;
+}
+
+int readout_decode(const uint8_t *payload, const size_t length,
+                   ReadoutRecord *records, const size_t max_records) {
+  if (length < READOUT_CODEC_HEADER_SIZE ||
+      payload[0] != READOUT_CODEC_MAGIC ||
+      payload[1] < READOUT_CODEC_MIN_VERSION ||
+      payload[1] > READOUT_CODEC_VERSION)
+    return -1;
+
+  const uint8_t version = payload[1];
+  // version 1 records have no flags byte, and are otherwise the first 20
+  // bytes of a later record
+  const size_t fixed_size =
+      version == 1 ? READOUT_CODEC_V1_RECORD_SIZE : READOUT_CODEC_RECORD_SIZE;
+  // versions 1 and 2 have timestamps in whole seconds
+  const int64_t timestamp_scale = version < 3 ? 1000 : 1;
+  const uint16_t count = get_u16(&payload[2]);
+  size_t offset = READOUT_CODEC_HEADER_SIZE;
+
+  // records vary in size, so all of them are walked to validate the length
+  for (size_t i = 0; i < count; i++) {
+    if (length - offset < fixed_size)
+      return -1;
+    const uint8_t *src = payload + offset;
+    const uint8_t flags = version == 1 ? 0 : src[20];
+    const size_t size = version == 1 ? fixed_size : record_size(flags);
+    if (length - offset < size)
+      return -1;
+    offset += size;
+
+    if (i >= max_records)
+      continue;
+    ReadoutRecord *record = &records[i];
+    memset(record, 0, sizeof(*record));
+    record->timestamp = (int64_t)get_u64(&src[0]) * timestamp_scale;
+    record->value = get_f32(&src[8]);
+    record->address = get_u64(&src[12]);
+    record->flags = flags;
+    src += fixed_size;
+    if (record->flags & READOUT_CODEC_FLAG_AGGREGATE) {
+      record->samples = get_u16(&src[0]);
+      record->min = get_f32(&src[2]);
+      record->max = get_f32(&src[6]);
+      record->stddev = get_f32(&src[10]);
+      src += READOUT_CODEC_AGGREGATE_SIZE;
+    } else {
+      record->samples = 1;
+      record->min = record->value;
+      record->max = record->value;
+    }
+    if (record->flags & READOUT_CODEC_FLAG_SUPPRESSED) {
+      record->suppressed = get_u16(&src[0]);
+    }
+  }
+
+  if (offset != length)
+    return -1;
+  return count;
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef _READOUT_CODEC_H
+#define _READOUT_CODEC_H
+
+// Compact binary encoding of readouts, published on the "<topic>/bin" topics.
+//
+// This file and readout_codec.c only depend on the C standard library, so
+// they can be built as-is on the ingest side to decode payloads.
+//
+// Layout (version 3), all fields little-endian:
+//
+//   header, 4 bytes:
+//     offset 0  u8   magic, always 0xED
+//     offset 1  u8   version, currently 3
+//     offset 2  u16  number of records that follow
+//
+//   record, 21 bytes, followed by the optional parts given by its flags:
+//     offset 0  i64  timestamp, milliseconds since the Unix epoch (UTC)
+//     offset 8  f32  value (the mean for aggregates), IEEE 754 single
+//     offset 12 u64  probe address, 0 if not applicable
+//     offset 20 u8   flags, bit 0 set for an aggregate, bit 1 set if
+//                    readouts were suppressed before this one, bit 2 set
+//                    if the clock was being resynced, bit 3 set if the
+//                    last clock sync had failed
+//   aggregates only, 14 bytes:
+//     +0  u16  number of samples
+//     +2  f32  minimum
+//     +6  f32  maximum
+//     +10 f32  population standard deviation
+//   with suppressed readouts only (after the aggregate part), 2 bytes:
+//     +0  u16  number of readouts suppressed by the deadband since the
+//              previous record of this sensor
+//
+// Version 2 had the same layout with timestamps in whole seconds. Version 1
+// had no flags byte either, every record was a single 20-byte sample with
+// its timestamp in whole seconds. Both are still decoded, with the
+// timestamps converted to milliseconds.
+//
+// The sensor type (and so the unit) is given by the topic the payload was
+// published on.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define READOUT_CODEC_MAGIC 0xED
+#define READOUT_CODEC_VERSION 3
+#define READOUT_CODEC_MIN_VERSION 1
+#define READOUT_CODEC_HEADER_SIZE 4
+#define READOUT_CODEC_RECORD_SIZE 21
+#define READOUT_CODEC_AGGREGATE_SIZE 14
+#define READOUT_CODEC_SUPPRESSED_SIZE 2
+#define READOUT_CODEC_V1_RECORD_SIZE 20
+
+#define READOUT_CODEC_FLAG_AGGREGATE (1 << 0)
+#define READOUT_CODEC_FLAG_SUPPRESSED (1 << 1)
+#define READOUT_CODEC_FLAG_CLOCK_SYNCING (1 << 2)
+#define READOUT_CODEC_FLAG_CLOCK_STALE (1 << 3)
+
+typedef struct {
+  int64_t timestamp; // milliseconds since the Unix epoch
+  float value;
+  uint64_t address;
+  uint8_t flags;
+  // only meaningful with READOUT_CODEC_FLAG_AGGREGATE
+  uint16_t samples;
+  float min;
+  float max;
+  float stddev;
+  // only meaningful with READOUT_CODEC_FLAG_SUPPRESSED
+  uint16_t suppressed;
+} ReadoutRecord;
+
+typedef struct {
+  uint8_t *buffer;
+  size_t capacity;
+  size_t length;
+  uint16_t count;
+} ReadoutEncoder;
+
+/**
+ * @brief Starts a new payload in @p buffer by writing the header.
+ *
+ * @return false if the buffer can't even hold the header.
+ */
+bool readout_encoder_init(ReadoutEncoder *encoder, uint8_t *buffer,
+                          size_t capacity);
+
+/**
+ * @brief Appends a record to the payload and updates the record count in the
+ * header.
+ *
+ * @return false if the payload is full, in which case nothing is written.
+ */
+bool readout_encoder_append(ReadoutEncoder *encoder,
+                            const ReadoutRecord *record);
+
+/**
+ * @brief Decodes a payload of any version from READOUT_CODEC_MIN_VERSION to
+ * READOUT_CODEC_VERSION.
+ *
+ * @param payload The received payload.
+ * @param length Length of @p payload in bytes.
+ * @param records Array to store the decoded records in.
+ * @param max_records Capacity of @p records.
+ * @return The number of records in the payload (which may be larger than
+ * @p max_records, only the first @p max_records are stored), or -1 if the
+ * payload is malformed or of an unknown version.
+ */
+int readout_decode(const uint8_t *payload, size_t length,
+                   ReadoutRecord *records, size_t max_records);
+
+#endif //_READOUT_CODEC_H
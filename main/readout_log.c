@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include "readout_log.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "sdkconfig.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#if CONFIG_READOUT_LOG_ENABLE
+static const char *TAG = "readout_log";
+
+// Every slot holds one readout record and is written exactly once per lap of
+// the ring. A slot's position is derived from its sequence number
+// (sequence % slot_count), so the state of the whole log can be rebuilt from
+// the sequence numbers alone. Consumed records are marked by clearing the
+// state word of the last slot of each consumed batch, which NOR flash allows
+// without an erase. A readout with a summary takes two consecutive slots
+// (see ReadoutSummary).
+
+#define LOG_SLOT_ERASED 0xFFFFFFFF
+#define LOG_SLOT_WRITTEN 0xA5A5A5A5
+#define LOG_SLOT_CONSUMED 0x00000000
+
+typedef struct {
+  uint32_t sequence;
+  uint32_t state;
+  UniversalSingleReadout record; // a readout or a summary
+  uint32_t crc; // covers everything after the state word
+} LogSlot;
+
+#ifdef READOUT_LOG_SLOT_SIZE
+// READOUT_LOG_SLOT_SIZE comes from main/CMakeLists.txt (build report)
+_Static_assert(sizeof(LogSlot) == READOUT_LOG_SLOT_SIZE,
+               "LogSlot size doesn't match the build report");
+#endif
+
+#define LOG_SLOT_CRC_OFFSET offsetof(LogSlot, record)
+#define LOG_SLOT_CRC_LENGTH (offsetof(LogSlot, crc) - LOG_SLOT_CRC_OFFSET)
+
+static const esp_partition_t *partition = NULL;
+static uint32_t slot_count;
+static uint32_t slots_per_sector;
+
+static uint32_t next_sequence = 0; // sequence of the next slot to write
+static uint32_t tail_sequence = 0; // sequence of the oldest unconsumed slot
+// sequence of the first slot written since boot. Readouts from before the
+// first clock sync only count from the boot they were taken in, so the ones
+// written before it can't be resolved anymore.
+static uint32_t boot_sequence = 0;
+
+// readout_log_count() for the other tasks, updated whenever it changes
+static atomic_uint pending = 0;
+
+// sequences of the records handed out by the last peek
+static uint32_t peeked_sequence[READOUT_LOG_MAX_PEEK];
+static size_t peeked_count = 0;
+
+static void update_pending(void) {
+  atomic_store_explicit(&pending, next_sequence - tail_sequence,
+                        memory_order_relaxed);
+}
+
+static uint32_t slot_crc(const LogSlot *slot) {
+  return esp_rom_crc32_le(0, (const uint8_t *)slot + LOG_SLOT_CRC_OFFSET,
+                          LOG_SLOT_CRC_LENGTH);
+}
+
+// Slots don't straddle sectors, whatever is left at the end of each sector
+// stays unused
+static size_t slot_offset(const uint32_t sequence) {
+  const uint32_t slot = sequence % slot_count;
+  return (size_t)(slot / slots_per_sector) * partition->erase_size +
+         (size_t)(slot % slots_per_sector) * sizeof(LogSlot);
+}
+
+// Reads the slot that should hold @p sequence, returns false if it doesn't
+// (erased, overwritten, or corrupted)
+static bool read_slot(const uint32_t sequence, LogSlot *slot) {
+  if (esp_partition_read(partition, slot_offset(sequence), slot,
+                         sizeof(LogSlot)) != ESP_OK)
+    return false;
+  return slot->sequence == sequence && slot->state != LOG_SLOT_ERASED &&
+         slot->crc == slot_crc(slot);
+}
+
+esp_err_t readout_log_init(void) {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                       ESP_PARTITION_SUBTYPE_ANY,
+                                       CONFIG_READOUT_LOG_PARTITION_LABEL);
+  if (partition == NULL) {
+    ESP_LOGE(TAG, "No \"%s\" partition found, the readout log is disabled",
+             CONFIG_READOUT_LOG_PARTITION_LABEL);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  slots_per_sector = partition->erase_size / sizeof(LogSlot);
+  slot_count =
+      (partition->size / partition->erase_size) * slots_per_sector;
+
+  // scan every slot to find the newest written one and the newest consumed
+  // one, the rest of the state follows from their sequence numbers
+  bool found_written = false;
+  bool found_consumed = false;
+  uint32_t newest_written = 0;
+  uint32_t oldest_written = 0;
+  uint32_t newest_consumed = 0;
+
+  for (uint32_t i = 0; i < slot_count; i++) {
+    LogSlot slot;
+    if (esp_partition_read(partition, slot_offset(i), &slot,
+                           sizeof(LogSlot)) != ESP_OK ||
+        slot.state == LOG_SLOT_ERASED || slot.sequence % slot_count != i ||
+        slot.crc != slot_crc(&slot))
+      continue;
+
+    if (!found_written || slot.sequence > newest_written)
+      newest_written = slot.sequence;
+    if (!found_written || slot.sequence < oldest_written)
+      oldest_written = slot.sequence;
+    found_written = true;
+
+    if (slot.state == LOG_SLOT_CONSUMED &&
+        (!found_consumed || slot.sequence > newest_consumed)) {
+      newest_consumed = slot.sequence;
+      found_consumed = true;
+    }
+  }
+
+  next_sequence = 0;
+  tail_sequence = 0;
+  peeked_count = 0;
+  if (found_written) {
+    next_sequence = newest_written + 1;
+    tail_sequence = oldest_written;
+    if (found_consumed && newest_consumed + 1 > tail_sequence)
+      tail_sequence = newest_consumed + 1;
+  }
+  boot_sequence = next_sequence;
+  update_pending();
+
+  ESP_LOGI(TAG, "Readout log ready: %u slots, %u record(s) pending",
+           (unsigned)slot_count, (unsigned)readout_log_count());
+  return ESP_OK;
+}
+
+// Writes one record into the slot at the head of the log
+static esp_err_t append_record(const UniversalSingleReadout *record) {
+  // entering a new sector, erase it first and drop whatever was still
+  // unconsumed in it from the previous lap
+  if (next_sequence % slots_per_sector == 0) {
+    const esp_err_t ret = esp_partition_erase_range(
+        partition, slot_offset(next_sequence), partition->erase_size);
+    if (ret != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to erase log sector (%s)", esp_err_to_name(ret));
+      return ret;
+    }
+
+    if (next_sequence >= slot_count) {
+      const uint32_t first_surviving =
+          next_sequence - slot_count + slots_per_sector;
+      if (tail_sequence < first_surviving) {
+        ESP_LOGW(TAG, "Readout log full, dropped %u oldest record(s)",
+                 (unsigned)(first_surviving - tail_sequence));
+        tail_sequence = first_surviving;
+      }
+    }
+  }
+
+  LogSlot slot;
+  memset(&slot, 0, sizeof(slot));
+  slot.sequence = next_sequence;
+  slot.state = LOG_SLOT_WRITTEN;
+  slot.record = *record;
+  slot.crc = slot_crc(&slot);
+
+  // the sequence is used up even if the write fails, a half-written slot is
+  // rejected by its CRC later on
+  const esp_err_t ret = esp_partition_write(
+      partition, slot_offset(next_sequence), &slot, sizeof(slot));
+  next_sequence++;
+  update_pending();
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write log slot (%s)", esp_err_to_name(ret));
+  }
+  return ret;
+}
+
+esp_err_t readout_log_append(const UniversalSingleReadout *readout) {
+  if (partition == NULL)
+    return ESP_ERR_INVALID_STATE;
+
+  esp_err_t ret = ESP_OK;
+  for (size_t i = 0; i < readout_records(readout) && ret == ESP_OK; i++) {
+    ret = append_record(&readout[i]);
+  }
+  return ret;
+}
+
+// Drops the records up to @p sequence for good if nothing before them is
+// waiting to be consumed
+static void skip_records(const uint32_t sequence, const size_t peeked) {
+  if (peeked == 0)
+    tail_sequence = sequence + 1;
+}
+
+size_t readout_log_peek(UniversalSingleReadout *records,
+                        const size_t max_records) {
+  peeked_count = 0;
+  if (partition == NULL)
+    return 0;
+
+  const size_t max_peek =
+      max_records < READOUT_LOG_MAX_PEEK ? max_records : READOUT_LOG_MAX_PEEK;
+  for (uint32_t sequence = tail_sequence;
+       sequence != next_sequence && peeked_count < max_peek; sequence++) {
+    LogSlot slot;
+    if (!read_slot(sequence, &slot)) {
+      ESP_LOGW(TAG, "Skipping unreadable log slot %u", (unsigned)sequence);
+      skip_records(sequence, peeked_count);
+      continue;
+    }
+    if (readout_is_summary(&slot.record)) {
+      // its readout was dropped or unreadable
+      skip_records(sequence, peeked_count);
+      continue;
+    }
+
+    LogSlot summary_slot;
+    const bool has_summary = slot.record.flags & READOUT_FLAG_SUMMARY;
+    if (has_summary) {
+      // both are appended in one go, so a missing summary was lost to a
+      // reset or a failed write
+      if (sequence + 1 == next_sequence ||
+          !read_slot(sequence + 1, &summary_slot) ||
+          !readout_is_summary(&summary_slot.record)) {
+        ESP_LOGW(TAG, "Skipping log slot %u, its summary is unreadable",
+                 (unsigned)sequence);
+        skip_records(sequence, peeked_count);
+        continue;
+      }
+      if (peeked_count + 2 > max_peek)
+        break;
+    }
+
+    if ((slot.record.flags & READOUT_FLAG_MONOTONIC) &&
+        sequence < boot_sequence) {
+      ESP_LOGW(TAG, "Dropping a readout with a time-since-boot timestamp "
+                    "from before the last reset");
+      if (has_summary)
+        sequence++;
+      skip_records(sequence, peeked_count);
+      continue;
+    }
+
+    peeked_sequence[peeked_count] = sequence;
+    records[peeked_count++] = slot.record;
+    if (has_summary) {
+      sequence++;
+      peeked_sequence[peeked_count] = sequence;
+      records[peeked_count++] = summary_slot.record;
+    }
+  }
+  update_pending(); // unreadable slots may have been dropped
+
+  return peeked_count;
+}
+
+esp_err_t readout_log_consume(const size_t count) {
+  if (partition == NULL)
+    return ESP_ERR_INVALID_STATE;
+  if (count == 0)
+    return ESP_OK;
+  if (count > peeked_count)
+    return ESP_ERR_INVALID_ARG;
+
+  // marking only the last consumed slot is enough, everything before it is
+  // consumed as well
+  const uint32_t last = peeked_sequence[count - 1];
+  const uint32_t consumed = LOG_SLOT_CONSUMED;
+  const esp_err_t ret =
+      esp_partition_write(partition, slot_offset(last) + offsetof(LogSlot, state),
+                          &consumed, sizeof(consumed));
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to mark log slot as consumed (%s)",
+             esp_err_to_name(ret));
+    return ret;
+  }
+
+  tail_sequence = last + 1;
+  update_pending();
+  // the remaining peeked readouts must be peeked again
+  peeked_count = 0;
+  return ESP_OK;
+}
+
+uint32_t readout_log_count(void) { return next_sequence - tail_sequence; }
+
+uint32_t readout_log_pending(void) {
+  return atomic_load_explicit(&pending, memory_order_relaxed);
+}
+#else
+// CONFIG_READOUT_LOG_PARTITION_LABEL only exists with the log on. Without it
+// there is nothing to keep readouts in, and nothing ever waits in it.
+esp_err_t readout_log_init(void) { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t readout_log_append(const UniversalSingleReadout *readout) {
+  return ESP_ERR_INVALID_STATE;
+}
+
+size_t readout_log_peek(UniversalSingleReadout *records,
+                        const size_t max_records) {
+  return 0;
+}
+
+esp_err_t readout_log_consume(const size_t count) {
+  return count == 0 ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+uint32_t readout_log_count(void) { return 0; }
+
+uint32_t readout_log_pending(void) { return 0; }
+#endif
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef _READOUT_LOG_H
+#define _READOUT_LOG_H
+
+#include "esp_err.h"
+#include "types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the most records a single readout_log_peek() call can return
+#define READOUT_LOG_MAX_PEEK 32
+
+/**
+ * @brief Opens the readout log partition and recovers its state.
+ *
+ * The log is a ring of fixed-size slots spread over the whole partition, so
+ * the flash wears evenly. Its state (what has been written and what has
+ * already been consumed) is rebuilt from the slots themselves, so it survives
+ * reboots. Must be called before any other readout_log function, and all of
+ * them must be called from the same task.
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no readout log
+ * partition.
+ */
+esp_err_t readout_log_init(void);
+
+/**
+ * @brief Appends a readout at the head of the log.
+ *
+ * When the log is full, the oldest sector of records is dropped to make room.
+ *
+ * @param readout The readout to store, followed by its summary record if it
+ * has one (see ReadoutSummary).
+ * @return ESP_OK on success, an esp_partition error otherwise.
+ */
+esp_err_t readout_log_append(const UniversalSingleReadout *readout);
+
+/**
+ * @brief Reads the oldest readouts without consuming them.
+ *
+ * A readout with a summary comes with its summary record right behind it,
+ * the two are never split.
+ *
+ * @param records Array to store the records in.
+ * @param max_records Capacity of @p records, at least 2. No more than
+ * READOUT_LOG_MAX_PEEK are read.
+ * @return The number of records stored in @p records.
+ */
+size_t readout_log_peek(UniversalSingleReadout *records, size_t max_records);
+
+/**
+ * @brief Consumes the first @p count records returned by the last
+ * readout_log_peek() call.
+ *
+ * @param count Number of records to consume.
+ * @return ESP_OK on success, an esp_partition error otherwise.
+ */
+esp_err_t readout_log_consume(size_t count);
+
+/**
+ * @brief Gets the number of records waiting in the log.
+ */
+uint32_t readout_log_count(void);
+
+/**
+ * @brief Gets the number of records waiting in the log like
+ * readout_log_count(), but can be called from any task.
+ */
+uint32_t readout_log_pending(void);
+
+#endif //_READOUT_LOG_H
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "readout_pipeline.h"
+
+#include "deferred_log.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "ntp_manager.h"
+#include "readout_aggregate.h"
+#include "sensor_descriptors.h"
+#include "system_state.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+// Queues a readout, along with its summary record if it has one
+static void pipeline_queue(const UniversalSingleReadout *readout) {
+  if (readout_queue_send(readout) != pdPASS) {
+    DLOG(ESP_LOG_WARN, DLOG_QUEUE_FULL, readout->descriptor, readout->channel);
+  }
+}
+
+#if CONFIG_READOUT_PIPELINE_STREAMS
+static const char *TAG = "readout_pipeline";
+
+// pipeline state of one sensor channel
+typedef struct {
+  bool used;
+  uint8_t descriptor;
+  uint8_t channel;
+#if !CONFIG_READOUT_AGGREGATION_OFF
+  uint32_t window_end; // timestamp at which the current window closes
+  ReadoutAccumulator accumulator;
+#endif
+#if CONFIG_READOUT_DEADBAND
+  bool passed;             // whether any readout has passed the deadband yet
+  int32_t passed_value;    // value of the last readout that passed
+  uint32_t passed_time;    // timestamp of the last readout that passed
+  uint32_t suppressed;     // readouts suppressed since then
+#endif
+} PipelineStream;
+
+static PipelineStream streams[CONFIG_READOUT_PIPELINE_MAX_STREAMS];
+
+// Gets the stream of the readout's channel, claiming a free one for a channel
+// seen for the first time. Returns NULL if all of them are taken, which is
+// only logged the first time and counted in the metrics after that.
+static PipelineStream *find_stream(const UniversalSingleReadout *readout) {
+  static bool warned = false;
+  PipelineStream *free_stream = NULL;
+  for (size_t i = 0; i < CONFIG_READOUT_PIPELINE_MAX_STREAMS; i++) {
+    if (!streams[i].used) {
+      if (free_stream == NULL)
+        free_stream = &streams[i];
+    } else if (streams[i].descriptor == readout->descriptor &&
+               streams[i].channel == readout->channel) {
+      return &streams[i];
+    }
+  }
+
+  if (free_stream == NULL) {
+    if (!warned) {
+      ESP_LOGW(TAG, "No pipeline stream left for sensor %d channel %d, "
+                    "passing its readouts through (raise "
+                    "CONFIG_READOUT_PIPELINE_MAX_STREAMS)",
+               readout->descriptor, readout->channel);
+      warned = true;
+    }
+    metrics_count(METRIC_READOUTS_UNSTREAMED);
+    return NULL;
+  }
+
+  free_stream->used = true;
+  free_stream->descriptor = readout->descriptor;
+  free_stream->channel = readout->channel;
+#if !CONFIG_READOUT_AGGREGATION_OFF
+  readout_accumulator_reset(&free_stream->accumulator);
+#endif
+#if CONFIG_READOUT_DEADBAND
+  free_stream->passed = false;
+  free_stream->suppressed = 0;
+#endif
+  return free_stream;
+}
+#endif
+
+// Last stage, only lets single readouts through if they moved far enough
+// from the last one that passed, or if the heartbeat interval ran out.
+// Aggregates always pass.
+static void deadband_stage(const SensorDescriptor *descriptor,
+                           const UniversalSingleReadout *readout) {
+#if CONFIG_READOUT_DEADBAND
+  PipelineStream *stream;
+  if (descriptor != NULL && descriptor->deadband > 0 &&
+      !(readout->flags & READOUT_FLAG_AGGREGATE) &&
+      (stream = find_stream(readout)) != NULL) {
+    const int64_t change = (int64_t)readout->value - stream->passed_value;
+    const uint32_t silence = readout->timestamp - stream->passed_time;
+    if (stream->passed && change <= descriptor->deadband &&
+        change >= -(int64_t)descriptor->deadband &&
+        (descriptor->heartbeat == 0 || silence < descriptor->heartbeat)) {
+      stream->suppressed++;
+      return;
+    }
+
+    // the readout carries the number of readouts suppressed before it, in
+    // a summary only if there were any
+    UniversalSingleReadout passed[2] = {*readout};
+    if (stream->suppressed > 0) {
+      const ReadoutSummary summary = {
+          .samples = 1,
+          .suppressed = readout_count_add(0, stream->suppressed)};
+      readout_set_summary(passed, &summary);
+    }
+
+    stream->passed = true;
+    stream->passed_value = readout->value;
+    stream->passed_time = readout->timestamp;
+    stream->suppressed = 0;
+    pipeline_queue(passed);
+    return;
+  }
+#endif
+
+  pipeline_queue(readout);
+}
+
+// First stage, summarizes readouts over tumbling windows
+static void aggregation_stage(const SensorDescriptor *descriptor,
+                              const UniversalSingleReadout *readout) {
+#if !CONFIG_READOUT_AGGREGATION_OFF
+  if (descriptor != NULL && descriptor->aggregation_window > 0) {
+    PipelineStream *stream = find_stream(readout);
+    if (stream == NULL) {
+      // there is no stream for the deadband stage either
+      pipeline_queue(readout);
+      return;
+    }
+#if CONFIG_READOUT_AGGREGATION_RAW_AND_SUMMARY
+    deadband_stage(descriptor, readout);
+#endif
+
+    // the readout is past the current window (or the clock got synced since
+    // the window started), close it first
+    if (stream->accumulator.count > 0 &&
+        (readout->timestamp >= stream->window_end ||
+         ((readout->flags ^ stream->accumulator.flags) &
+          READOUT_FLAG_MONOTONIC))) {
+      UniversalSingleReadout aggregate[2] = {
+          {.descriptor = stream->descriptor, .channel = stream->channel}};
+      ReadoutSummary summary = {0};
+      readout_accumulator_summarize(&stream->accumulator, &aggregate[0],
+                                    &summary);
+      readout_set_summary(aggregate, &summary);
+      // timestamped with the start of its window rather than with its
+      // oldest readout, so the aggregates of a channel line up
+      aggregate[0].timestamp =
+          stream->window_end - descriptor->aggregation_window;
+      aggregate[0].subsecond = 0;
+      readout_accumulator_reset(&stream->accumulator);
+      deadband_stage(descriptor, aggregate);
+    }
+
+    if (stream->accumulator.count == 0) {
+      const uint32_t window = descriptor->aggregation_window;
+      stream->window_end =
+          readout->timestamp - readout->timestamp % window + window;
+    }
+    const ReadoutSummary summary = readout_get_summary(readout);
+    readout_accumulator_add(&stream->accumulator, readout, &summary);
+    return;
+  }
+#endif
+
+  deadband_stage(descriptor, readout);
+}
+
+ReadoutTime readout_pipeline_now(void) {
+  if ((system_get_bits() & SYS_BIT_TIME_VALID) == 0)
+    return readout_time_from_us(esp_timer_get_time(), READOUT_FLAG_MONOTONIC);
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return readout_time_from_us(
+      ((int64_t)now.tv_sec - READOUT_EPOCH_BASE) * 1000000 + now.tv_usec, 0);
+}
+
+bool readout_pipeline_resolve_time(UniversalSingleReadout *readout) {
+  if ((readout->flags & READOUT_FLAG_MONOTONIC) == 0)
+    return true;
+
+  int64_t boot_time_us;
+  if (!ntp_manager_get_boot_time(&boot_time_us))
+    return false;
+
+  const ReadoutTime resolved = readout_time_from_us(
+      readout_time_to_us(readout) + boot_time_us -
+          READOUT_EPOCH_BASE * 1000000,
+      0);
+  readout_set_time(readout, &resolved);
+  return true;
+}
+
+void readout_pipeline_submit(const UniversalSingleReadout *readout) {
+  // note the state of the clock the readout was timestamped with, readouts
+  // from before the first sync don't have one yet
+  UniversalSingleReadout stamped = *readout;
+  const EventBits_t bits = system_get_bits();
+  if ((stamped.flags & READOUT_FLAG_MONOTONIC) == 0) {
+    if (bits & SYS_BIT_NTP_SYNCING)
+      stamped.flags |= READOUT_FLAG_CLOCK_SYNCING;
+    if (bits & SYS_BIT_NTP_STALE)
+      stamped.flags |= READOUT_FLAG_CLOCK_STALE;
+  }
+
+  aggregation_stage(sensor_descriptor_get(stamped.descriptor), &stamped);
+}
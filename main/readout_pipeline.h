@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _READOUT_PIPELINE_H
+#define _READOUT_PIPELINE_H
+
+#include "types.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Hands a fresh readout (a single sample, without a summary) to the
+ * pipeline that sits between the sensor drivers and the readout queue.
+ *
+ * Depending on the configuration, the readout goes through these stages
+ * before it is queued for publishing:
+ *
+ *   - aggregation: readouts are summarized per sensor channel over tumbling
+ *     windows (aligned to multiples of the window length) of the length given
+ *     by the sensor's descriptor. A window's aggregate is queued, with its
+ *     summary record, once the first readout past its end arrives.
+ *     Optionally the raw readouts are queued as well.
+ *   - deadband (report-by-exception): a single readout is only queued if its
+ *     value moved by more than the sensor's deadband since the last one that
+ *     was, or if the sensor's heartbeat interval has passed since then. If
+ *     any were suppressed before it, the queued readout carries their number
+ *     in a summary record. Aggregates always pass.
+ *
+ * Suppressed readouts are dropped right here, so they never reach the queue,
+ * the serializers or the MQTT outbox.
+ *
+ * The readout is also flagged with the state of the clock (see
+ * READOUT_FLAG_CLOCK_SYNCING and READOUT_FLAG_CLOCK_STALE) on the way in,
+ * unless it was taken before the clock was first synced.
+ *
+ * Must only be called from the task that produces readouts, since the
+ * readout queue has a single producer.
+ */
+void readout_pipeline_submit(const UniversalSingleReadout *readout);
+
+/**
+ * @brief Gets the timestamp for a readout taken right now.
+ *
+ * Before the clock has been synced for the first time, this is the time since
+ * boot, flagged with READOUT_FLAG_MONOTONIC, so sampling doesn't have to wait
+ * for the first sync. Such readouts are kept in the readout log (or the
+ * readout queue without one) until the clock is synced, and get their
+ * timestamps rewritten to UTC with readout_pipeline_resolve_time() before
+ * they are published.
+ */
+ReadoutTime readout_pipeline_now(void);
+
+/**
+ * @brief Rewrites the timestamp of a readout taken before the first clock
+ * sync to UTC, using the offset between the boot time and the clock measured
+ * at that sync. Other readouts are left as they are.
+ *
+ * @return false if the clock still hasn't been synced, in which case the
+ * readout is left as it is.
+ */
+bool readout_pipeline_resolve_time(UniversalSingleReadout *readout);
+
+#endif //_READOUT_PIPELINE_H
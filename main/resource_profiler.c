@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "resource_profiler.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if CONFIG_RESOURCE_PROFILER_INTERVAL > 0
+static const char *TAG = "resource_profiler";
+
+// the most tasks sampled at once, the rest are left out of the report
+#define PROFILER_MAX_TASKS 24
+// recommended stack sizes are rounded up to this many bytes
+#define PROFILER_STACK_GRANULARITY 256
+
+typedef struct {
+  const char *task;   // FreeRTOS task name
+  const char *option; // Kconfig option setting its stack size
+  uint32_t size;      // configured stack size, in bytes
+  uint32_t recommended; // last recommendation logged, 0 if none yet
+} StackOption;
+
+static StackOption stack_options[] = {
+    {"main", "ESP_MAIN_TASK_STACK_SIZE", CONFIG_ESP_MAIN_TASK_STACK_SIZE, 0},
+    {"ntp_manager", "NTP_MANAGER_STACK_SIZE", CONFIG_NTP_MANAGER_STACK_SIZE,
+     0},
+    {"sensor_scheduler", "SENSOR_SCHEDULER_STACK_SIZE",
+     CONFIG_SENSOR_SCHEDULER_STACK_SIZE, 0},
+    {"mqtt_manager", "MQTT_MANAGER_STACK_SIZE", CONFIG_MQTT_MANAGER_STACK_SIZE,
+     0},
+    {"sys_evt", "ESP_SYSTEM_EVENT_TASK_STACK_SIZE",
+     CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE, 0},
+    {"tiT", "LWIP_TCPIP_TASK_STACK_SIZE", CONFIG_LWIP_TCPIP_TASK_STACK_SIZE, 0},
+    {"esp_timer", "ESP_TIMER_TASK_STACK_SIZE", CONFIG_ESP_TIMER_TASK_STACK_SIZE,
+     0},
+#if CONFIG_DEFERRED_LOG
+    {"deferred_log", "DEFERRED_LOG_STACK_SIZE", CONFIG_DEFERRED_LOG_STACK_SIZE,
+     0},
+#endif
+};
+
+#define STACK_OPTION_COUNT (sizeof(stack_options) / sizeof(stack_options[0]))
+
+// Logs the heap: what is free now, the least that has ever been free, and the
+// largest block that could still be allocated in one piece
+static void sample_heap(void) {
+  const size_t total = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+  const size_t free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  const size_t minimum = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+  const size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+  // share of the free heap that can't be had in one piece
+  const unsigned fragmentation =
+      free == 0 ? 0 : (unsigned)(100 - largest * 100 / free);
+
+  ESP_LOGI(TAG,
+           "Heap: %u/%u bytes free, %u minimum ever, largest block %u "
+           "(%u%% fragmented)",
+           (unsigned)free, (unsigned)total, (unsigned)minimum,
+           (unsigned)largest, fragmentation);
+}
+
+// Logs a new recommended stack size for a task, if it differs from the last
+// one logged
+static void recommend_stack_size(const char *task,
+                                 const uint32_t high_water_mark) {
+  for (size_t i = 0; i < STACK_OPTION_COUNT; i++) {
+    StackOption *option = &stack_options[i];
+    if (strcmp(option->task, task) != 0)
+      continue;
+
+    const uint32_t used = option->size > high_water_mark
+                              ? option->size - high_water_mark
+                              : option->size;
+    uint32_t recommended =
+        used + used * CONFIG_RESOURCE_PROFILER_STACK_MARGIN / 100;
+    recommended = (recommended + PROFILER_STACK_GRANULARITY - 1) /
+                  PROFILER_STACK_GRANULARITY * PROFILER_STACK_GRANULARITY;
+    if (recommended == option->recommended)
+      return;
+    option->recommended = recommended;
+
+    ESP_LOGI(TAG, "%s: peak stack use %u of %u bytes, recommended CONFIG_%s=%u",
+             task, (unsigned)used, (unsigned)option->size, option->option,
+             (unsigned)recommended);
+    return;
+  }
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t tasks[PROFILER_MAX_TASKS];
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// run time counters of the previous sample, by task number
+typedef struct {
+  UBaseType_t number;
+  uint32_t run_time;
+} TaskRunTime;
+
+static TaskRunTime previous_run_times[PROFILER_MAX_TASKS];
+static size_t previous_count = 0;
+static uint32_t previous_total_run_time = 0;
+
+// Gets a task's run time counter at the previous sample, 0 if it's new
+static uint32_t previous_run_time(const UBaseType_t number) {
+  for (size_t i = 0; i < previous_count; i++) {
+    if (previous_run_times[i].number == number)
+      return previous_run_times[i].run_time;
+  }
+  return 0;
+}
+#endif
+
+// Logs every task's stack high water mark and CPU share since the last
+// sample
+static void sample_tasks(void) {
+  uint32_t total_run_time = 0;
+  const UBaseType_t count =
+      uxTaskGetSystemState(tasks, PROFILER_MAX_TASKS, &total_run_time);
+  if (count == 0) {
+    ESP_LOGW(TAG, "More than %d tasks, skipping the task sample",
+             PROFILER_MAX_TASKS);
+    return;
+  }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+  // the run time counters are summed over every core
+  const uint32_t elapsed =
+      (total_run_time - previous_total_run_time) * portNUM_PROCESSORS;
+#endif
+
+  for (UBaseType_t i = 0; i < count; i++) {
+    const TaskStatus_t *task = &tasks[i];
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    const uint32_t run_time =
+        task->ulRunTimeCounter - previous_run_time(task->xTaskNumber);
+    const unsigned cpu =
+        elapsed == 0 ? 0 : (unsigned)((uint64_t)run_time * 100 / elapsed);
+    ESP_LOGI(TAG, "%-16s stack %5u bytes free, %3u%% CPU", task->pcTaskName,
+             (unsigned)task->usStackHighWaterMark, cpu);
+    previous_run_times[i].number = task->xTaskNumber;
+    previous_run_times[i].run_time = task->ulRunTimeCounter;
+#else
+    ESP_LOGI(TAG, "%-16s stack %5u bytes free", task->pcTaskName,
+             (unsigned)task->usStackHighWaterMark);
+#endif
+    recommend_stack_size(task->pcTaskName, task->usStackHighWaterMark);
+  }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+  previous_count = count;
+  previous_total_run_time = total_run_time;
+#endif
+}
+#else
+// Without the trace facility only this firmware's own tasks can be looked
+// up, and only their stacks
+static void sample_tasks(void) {
+  for (size_t i = 0; i < STACK_OPTION_COUNT; i++) {
+    const TaskHandle_t handle = xTaskGetHandle(stack_options[i].task);
+    if (handle == NULL)
+      continue;
+    const uint32_t high_water_mark = uxTaskGetStackHighWaterMark(handle);
+    ESP_LOGI(TAG, "%-16s stack %5u bytes free", stack_options[i].task,
+             (unsigned)high_water_mark);
+    recommend_stack_size(stack_options[i].task, high_water_mark);
+  }
+}
+#endif
+
+void resource_profiler_run(void) {
+  // ReSharper disable once CppDFAEndlessLoop
+  while (1) {
+    sample_heap();
+    sample_tasks();
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_RESOURCE_PROFILER_INTERVAL * 1000UL));
+  }
+}
+#else
+// CONFIG_RESOURCE_PROFILER_STACK_MARGIN only exists with the profiler on
+void resource_profiler_run(void) {}
+#endif
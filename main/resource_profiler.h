@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _RESOURCE_PROFILER_H
+#define _RESOURCE_PROFILER_H
+
+/**
+ * @brief Samples the heap and every task's stack and CPU use every
+ * CONFIG_RESOURCE_PROFILER_INTERVAL seconds, forever.
+ *
+ * Meant to be called at the end of app_main(), so the profiler runs on the
+ * main task instead of taking a stack of its own. Each sample logs the free,
+ * minimum-ever free and largest free block of the heap, and per task the
+ * stack high water mark and the share of CPU time since the last sample. The
+ * stack sizes this firmware configures are compared against their peak use,
+ * and a recommended size (peak use plus CONFIG_RESOURCE_PROFILER_STACK_MARGIN
+ * percent) is logged whenever it changes.
+ *
+ * Returns right away if CONFIG_RESOURCE_PROFILER_INTERVAL is 0.
+ */
+void resource_profiler_run(void);
+
+#endif //_RESOURCE_PROFILER_H
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include "sensor_descriptors.h"
+
+#include "sdkconfig.h"
+#include "types.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "sensor_manager_ds18b20.h"
+#endif
+
+#include <stddef.h>
+
+#if CONFIG_READOUT_AGGREGATION_OFF
+#define DS18B20_AGGREGATION_WINDOW 0
+#else
+#define DS18B20_AGGREGATION_WINDOW CONFIG_SOFTWARE_DS18B20_AGGREGATION_WINDOW
+#endif
+
+#if CONFIG_READOUT_DEADBAND
+// the deadband is configured in thousandths of a degree
+#define DS18B20_DEADBAND                                                       \
+  (CONFIG_SOFTWARE_DS18B20_DEADBAND * (READOUT_VALUE_SCALE / 1000))
+#define DS18B20_HEARTBEAT CONFIG_SOFTWARE_DS18B20_HEARTBEAT
+#else
+#define DS18B20_DEADBAND 0
+#define DS18B20_HEARTBEAT 0
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX
+// there is no 1-Wire bus on the linux target, nor any probe addresses
+#define DS18B20_CHANNEL_ADDRESS NULL
+#else
+#define DS18B20_CHANNEL_ADDRESS sensor_manager_ds18b20_get_address
+#endif
+
+#if CONFIG_SOFTWARE_DS18B20_MQTT_RETAIN
+#define DS18B20_RETAIN true
+#else
+#define DS18B20_RETAIN false
+#endif
+
+#if CONFIG_SENSOR_MOCK_ENABLE
+#define MOCK_QOS CONFIG_SENSOR_MOCK_MQTT_QOS
+#else
+#define MOCK_QOS 0
+#endif
+
+static const SensorDescriptor descriptors[SENSOR_DESCRIPTOR_COUNT] = {
+    [SENSOR_DESCRIPTOR_DS18B20] = {.sensor_type = "ds18b20",
+                                   .unit = "C",
+                                   .topic = "ds18b20",
+                                   .channel_address = DS18B20_CHANNEL_ADDRESS,
+                                   .aggregation_window =
+                                       DS18B20_AGGREGATION_WINDOW,
+                                   .deadband = DS18B20_DEADBAND,
+                                   .heartbeat = DS18B20_HEARTBEAT,
+                                   .qos = CONFIG_SOFTWARE_DS18B20_MQTT_QOS,
+                                   .retain = DS18B20_RETAIN},
+    // synthetic readouts of sensor_driver_mock.c
+    [SENSOR_DESCRIPTOR_MOCK] = {.sensor_type = "mock",
+                                .unit = "C",
+                                .topic = "mock",
+                                .qos = MOCK_QOS},
+};
+
+const SensorDescriptor *sensor_descriptor_get(const uint8_t id) {
+  if (id >= SENSOR_DESCRIPTOR_COUNT)
+    return NULL;
+  return &descriptors[id];
+}
\ No newline at end of file
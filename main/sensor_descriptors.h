@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef _SENSOR_DESCRIPTORS_H
+#define _SENSOR_DESCRIPTORS_H
+
+#include "types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// indexes into the descriptor table, stored in UniversalSingleReadout
+typedef enum {
+  SENSOR_DESCRIPTOR_DS18B20 = 0,
+  SENSOR_DESCRIPTOR_MOCK,
+  SENSOR_DESCRIPTOR_COUNT
+} SensorDescriptorId;
+
+_Static_assert(SENSOR_DESCRIPTOR_COUNT <= READOUT_SUMMARY_DESCRIPTOR,
+               "a sensor descriptor index would read as a summary record");
+
+typedef struct {
+  const char *sensor_type; // "sensor" field of the payload
+  const char *unit;        // "unit" field of the payload
+  const char *topic;       // published on "edlavp/<device-id>/sensor/<topic>"
+  // resolves a readout channel to the hardware address of the sensor, NULL
+  // if the sensor has none
+  uint64_t (*channel_address)(uint8_t channel);
+  // length of the aggregation windows in seconds, 0 to pass readouts through
+  // as they are (see readout_pipeline.h)
+  uint32_t aggregation_window;
+  // smallest change of the value (fixed point, see READOUT_VALUE_SCALE) that
+  // is published, 0 to publish every readout
+  int32_t deadband;
+  // longest time in seconds without a published readout while the value
+  // stays within the deadband, 0 for no limit
+  uint32_t heartbeat;
+  // MQTT QoS level (0, 1 or 2) of the sensor's messages. QoS 0 messages are
+  // sent right away without a copy in the outbox, and aren't redelivered.
+  uint8_t qos;
+  bool retain; // publish with the retain flag set
+} SensorDescriptor;
+
+/**
+ * @brief Gets the descriptor of a sensor.
+ *
+ * @param id The descriptor index stored in a readout.
+ * @return Pointer to the descriptor, or NULL if @p id is out of range.
+ */
+const SensorDescriptor *sensor_descriptor_get(uint8_t id);
+
+#endif //_SENSOR_DESCRIPTORS_H
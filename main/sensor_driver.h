@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _SENSOR_DRIVER_H
+#define _SENSOR_DRIVER_H
+
+#include "esp_err.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct SensorDriver SensorDriver;
+
+/**
+ * Interface between a sensor driver and the sensor scheduler.
+ *
+ * The scheduler calls start_sample() once every @c interval_ms, and collect()
+ * once the delay returned by start_sample() has passed. Neither of them may
+ * block for long, since every sensor shares the scheduler task. A driver
+ * that needs time between starting a measurement and reading it back (e.g.
+ * a DS18B20 conversion) returns that time from start_sample() instead of
+ * waiting for it.
+ *
+ * All calls happen on the scheduler task.
+ */
+struct SensorDriver {
+  const char *name;     // used in logs
+  uint8_t descriptor;   // descriptor of the readouts it produces
+  uint32_t interval_ms; // time between the starts of two samples
+  void *context;        // driver data, lets one driver back several instances
+
+  // Sets up the hardware. A driver that fails to initialize isn't scheduled.
+  esp_err_t (*init)(const SensorDriver *driver);
+  // Starts a sample and stores how long to wait (in milliseconds, from when
+  // it returns) before its result can be collected. The readouts should be
+  // timestamped with readout_pipeline_now() as of this call, which works
+  // before the clock has been synced as well.
+  esp_err_t (*start_sample)(const SensorDriver *driver,
+                            uint32_t *collect_delay_ms);
+  // Reads the result of the last sample and submits the readouts to the
+  // readout pipeline. A driver with a lot to read back (e.g. a bus full of
+  // probes) can do it a piece at a time: returning true has collect() called
+  // again right after the other events that are due.
+  bool (*collect)(const SensorDriver *driver);
+};
+
+#endif //_SENSOR_DRIVER_H
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "sensor_driver_mock.h"
+
+#include "metrics.h"
+#include "readout_pipeline.h"
+#include "sensor_descriptors.h"
+#include "sensor_driver.h"
+#include "sensor_scheduler.h"
+#include "types.h"
+
+#include <math.h>
+
+#if CONFIG_SENSOR_MOCK_ENABLE
+// period of the simulated signal, in seconds
+#define MOCK_SIGNAL_PERIOD 600
+
+// a compressed scenario samples faster, see CONFIG_SIM_TIME_SCALE
+#ifdef CONFIG_SIM_TIME_SCALE
+#define MOCK_TIME_SCALE CONFIG_SIM_TIME_SCALE
+#else
+#define MOCK_TIME_SCALE 1
+#endif
+#define MOCK_INTERVAL_MS                                                       \
+  (CONFIG_SENSOR_MOCK_INTERVAL_MS / MOCK_TIME_SCALE > 0                        \
+       ? CONFIG_SENSOR_MOCK_INTERVAL_MS / MOCK_TIME_SCALE                      \
+       : 1)
+#define MOCK_LATENCY_MS (CONFIG_SENSOR_MOCK_LATENCY_MS / MOCK_TIME_SCALE)
+
+typedef struct {
+  uint8_t channel;
+  uint32_t noise_state; // xorshift32 state
+  ReadoutTime sample_time;
+} MockSensor;
+
+static MockSensor mocks[CONFIG_SENSOR_MOCK_COUNT];
+static SensorDriver mock_drivers[CONFIG_SENSOR_MOCK_COUNT];
+
+static uint32_t mock_random(MockSensor *mock) {
+  uint32_t x = mock->noise_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  mock->noise_state = x;
+  return x;
+}
+
+// uniform noise in [-1, 1)
+static float mock_noise(MockSensor *mock) {
+  return (float)mock_random(mock) / 2147483648.0f - 1.0f;
+}
+
+static esp_err_t mock_init(const SensorDriver *driver) {
+  MockSensor *mock = driver->context;
+  mock->noise_state = 2654435761u * (mock->channel + 1u);
+  return ESP_OK;
+}
+
+static esp_err_t mock_start_sample(const SensorDriver *driver,
+                                   uint32_t *collect_delay_ms) {
+  MockSensor *mock = driver->context;
+  mock->sample_time = readout_pipeline_now();
+  *collect_delay_ms = MOCK_LATENCY_MS;
+  return ESP_OK;
+}
+
+static bool mock_collect(const SensorDriver *driver) {
+  MockSensor *mock = driver->context;
+  metrics_count(METRIC_SENSOR_READS);
+#if CONFIG_SENSOR_MOCK_ERROR_RATE > 0
+  // stands in for a read that fails its CRC check, the readout is skipped
+  if (mock_random(mock) % 1000 < CONFIG_SENSOR_MOCK_ERROR_RATE) {
+    metrics_count(METRIC_SENSOR_READ_ERRORS);
+    return false;
+  }
+#endif
+
+  // every channel gets its own offset and phase
+  const uint32_t t = mock->sample_time.timestamp + mock->channel * 37u;
+  const float phase = 2.0f * (float)M_PI *
+                      (float)(t % MOCK_SIGNAL_PERIOD) / MOCK_SIGNAL_PERIOD;
+  const float value = 20.0f + 0.5f * (float)mock->channel +
+                      2.0f * sinf(phase) + 0.05f * mock_noise(mock);
+
+  UniversalSingleReadout readout = {
+      .value = readout_value_to_fixed(value),
+      .descriptor = SENSOR_DESCRIPTOR_MOCK,
+      .channel = mock->channel};
+  readout_set_time(&readout, &mock->sample_time);
+  readout_pipeline_submit(&readout);
+  return false;
+}
+#endif
+
+void sensor_driver_mock_register(void) {
+#if CONFIG_SENSOR_MOCK_ENABLE
+  for (size_t i = 0; i < CONFIG_SENSOR_MOCK_COUNT; i++) {
+    mocks[i].channel = (uint8_t)i;
+    mock_drivers[i] = (SensorDriver){
+        .name = "mock",
+        .descriptor = SENSOR_DESCRIPTOR_MOCK,
+        .interval_ms = MOCK_INTERVAL_MS,
+        .context = &mocks[i],
+        .init = mock_init,
+        .start_sample = mock_start_sample,
+        .collect = mock_collect,
+    };
+    if (sensor_scheduler_register(&mock_drivers[i]) != ESP_OK)
+      break;
+  }
+#endif
+}
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _SENSOR_DRIVER_MOCK_H
+#define _SENSOR_DRIVER_MOCK_H
+
+/**
+ * @brief Registers CONFIG_SENSOR_MOCK_COUNT mock sensors with the sensor
+ * scheduler.
+ *
+ * Every mock sensor is a separate driver instance on its own channel, which
+ * "samples" a slow sine wave plus a little noise, with a fixed collect delay
+ * standing in for a conversion time. They exercise the scheduler, pipeline
+ * and publishing path without any hardware. Does nothing unless
+ * CONFIG_SENSOR_MOCK_ENABLE is set.
+ */
+void sensor_driver_mock_register(void);
+
+#endif //_SENSOR_DRIVER_MOCK_H
@@ -9,24 +9,234 @@
 
 #include "sensor_manager_ds18b20.h"
 
+#include "deferred_log.h"
 #include "ds18b20.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "metrics.h"
+#include "onewire_bus.h"
 #include "onewire_bus_impl_rmt.h"
+#include "onewire_cmd.h"
 #include "onewire_device.h"
-#include "system_state.h"
-#include "time.h"
+#include "readout_pipeline.h"
+#include "sensor_descriptors.h"
 #include "types.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 static const char *TAG = "sensor_manager_ds18b20";
 
-static DS18B20Sensor sensor;
+#define DS18B20_CMD_CONVERT_TEMP 0x44
+
+// worst-case conversion times from the DS18B20 datasheet, in milliseconds,
+// indexed by ds18b20_resolution_t
+static const uint32_t conversion_time_ms[] = {
+    [DS18B20_RESOLUTION_9B] = 94,
+    [DS18B20_RESOLUTION_10B] = 188,
+    [DS18B20_RESOLUTION_11B] = 375,
+    [DS18B20_RESOLUTION_12B] = 750,
+};
+
+static DS18B20Sensor sensors[DS18B20_MAX_DEVICES];
+static size_t sensor_count = 0;
+
+static portMUX_TYPE sensors_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static onewire_bus_handle_t bus = NULL;
+static ReadoutTime conversion_time;
+static int64_t conversion_start_us;
+static size_t next_to_read; // probe collect() reads next
+
+static ds18b20_resolution_t resolution_from_bits(const int bits) {
+  switch (bits) {
+  case 9:
+    return DS18B20_RESOLUTION_9B;
+  case 10:
+    return DS18B20_RESOLUTION_10B;
+  case 11:
+    return DS18B20_RESOLUTION_11B;
+  default:
+    return DS18B20_RESOLUTION_12B;
+  }
+}
+
+// Looks up the configured resolution of a probe, falling back to the default
+// if the overrides list (see Kconfig.projbuild) doesn't mention it.
+static ds18b20_resolution_t configured_resolution(const uint64_t address) {
+  const char *cursor = CONFIG_HARDWARE_DS18B20_RESOLUTION_OVERRIDES;
+
+  while (*cursor != '\0') {
+    char *end;
+    const uint64_t entry_address = strtoull(cursor, &end, 16);
+    if (*end != ':') {
+      ESP_LOGW(TAG, "Malformed resolution override list near \"%s\"", cursor);
+      break;
+    }
+    const long bits = strtol(end + 1, &end, 10);
+    if (entry_address == address) {
+      if (bits < 9 || bits > 12) {
+        ESP_LOGW(TAG, "Invalid resolution %ld for %016llX, using default",
+                 bits, address);
+        break;
+      }
+      return resolution_from_bits((int)bits);
+    }
+    cursor = strchr(end, ',');
+    if (cursor == NULL) {
+      break;
+    }
+    cursor++;
+  }
 
-void sensor_manager_ds18b20(void *pvParameters) {
-  ESP_LOGI(TAG, "%s task started", TAG);
+  return resolution_from_bits(CONFIG_HARDWARE_DS18B20_DEFAULT_RESOLUTION);
+}
 
+uint64_t sensor_manager_ds18b20_get_address(const uint8_t channel) {
+  // the table is only written before sensor_count is raised, so reading the
+  // already counted slots needs no locking
+  if (channel >= sensor_count)
+    return 0;
+  return sensors[channel].address;
+}
+
+esp_err_t sensor_manager_ds18b20_set_resolution(
+    const uint64_t address, const ds18b20_resolution_t resolution) {
+  esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+  portENTER_CRITICAL(&sensors_lock);
+  for (size_t i = 0; i < sensor_count; i++) {
+    if (sensors[i].address == address) {
+      sensors[i].requested_resolution = resolution;
+      ret = ESP_OK;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&sensors_lock);
+
+  return ret;
+}
+
+/**
+ * @brief Applies pending resolution changes and computes the conversion wait.
+ *
+ * Must only be called while no conversion is in progress.
+ *
+ * @return The datasheet conversion time of the slowest probe, in milliseconds.
+ */
+static uint32_t apply_resolutions(void) {
+  uint32_t wait_ms = 0;
+
+  for (size_t i = 0; i < sensor_count; i++) {
+    portENTER_CRITICAL(&sensors_lock);
+    const ds18b20_resolution_t requested = sensors[i].requested_resolution;
+    portEXIT_CRITICAL(&sensors_lock);
+
+    if (requested != sensors[i].resolution) {
+      const esp_err_t ret = ds18b20_set_resolution(sensors[i].handle, requested);
+      if (ret == ESP_OK) {
+        sensors[i].resolution = requested;
+        ESP_LOGI(TAG, "DS18B20 %016llX resolution set to %d bits",
+                 sensors[i].address, 9 + (int)requested);
+      } else {
+        ESP_LOGW(TAG, "Failed to set resolution of DS18B20 %016llX (%s)",
+                 sensors[i].address, esp_err_to_name(ret));
+      }
+    }
+
+    if (conversion_time_ms[sensors[i].resolution] > wait_ms) {
+      wait_ms = conversion_time_ms[sensors[i].resolution];
+    }
+  }
+
+  return wait_ms;
+}
+
+/**
+ * @brief Starts a temperature conversion on every probe on the bus.
+ *
+ * Sends a single skip-ROM CONVERT T, so N probes share one conversion window
+ * instead of needing N. Unlike
+ * ds18b20_trigger_temperature_conversion_for_all(), this does not block for
+ * the conversion itself, the scheduler collects the readouts once the
+ * datasheet conversion time of the slowest configured resolution has passed.
+ */
+static esp_err_t ds18b20_start_sample(const SensorDriver *driver,
+                                      uint32_t *collect_delay_ms) {
+  const uint8_t tx_buffer[] = {ONEWIRE_CMD_SKIP_ROM, DS18B20_CMD_CONVERT_TEMP};
+  *collect_delay_ms = apply_resolutions();
+
+  esp_err_t ret = onewire_bus_reset(bus);
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  ret = onewire_bus_write_bytes(bus, tx_buffer, sizeof(tx_buffer));
+  if (ret != ESP_OK) {
+    return ret;
+  }
+
+  conversion_time = readout_pipeline_now();
+  conversion_start_us = esp_timer_get_time();
+  next_to_read = 0;
+  return ESP_OK;
+}
+
+/**
+ * @brief Reads back the next probe after a conversion has completed and
+ * submits its readout to the readout pipeline.
+ *
+ * A read takes about 11 ms of bus time, so the probes are read one per call
+ * instead of holding up every other sensor for the whole bus. A failed read
+ * only skips that probe, so a single bad probe cannot take the whole cycle
+ * down.
+ *
+ * @return true while there are probes left to read.
+ */
+static bool ds18b20_collect(const SensorDriver *driver) {
+  if (next_to_read == 0) {
+    metrics_record(METRIC_CONVERSION_MS,
+                   (uint32_t)((esp_timer_get_time() - conversion_start_us) /
+                              1000));
+  }
+
+  const size_t i = next_to_read++;
+  float temperature;
+  const int64_t read_start = esp_timer_get_time();
+  const esp_err_t ret =
+      ds18b20_get_temperature(sensors[i].handle, &temperature);
+  metrics_record(METRIC_SENSOR_READ_US,
+                 (uint32_t)(esp_timer_get_time() - read_start));
+  metrics_count(METRIC_SENSOR_READS);
+  if (ret != ESP_OK) {
+    metrics_count(METRIC_SENSOR_READ_ERRORS);
+    ESP_LOGW(TAG, "Failed to read DS18B20 %016llX (%s), skipping",
+             sensors[i].address, esp_err_to_name(ret));
+    return next_to_read < sensor_count;
+  }
+
+  UniversalSingleReadout readout = {
+      .value = readout_value_to_fixed(temperature),
+      .descriptor = SENSOR_DESCRIPTOR_DS18B20,
+      .channel = (uint8_t)i};
+  readout_set_time(&readout, &conversion_time);
+
+  DLOG(ESP_LOG_INFO, DLOG_DS18B20_READOUT, (uint32_t)i,
+       (uint32_t)(sensors[i].address >> 32), (uint32_t)sensors[i].address,
+       (uint32_t)readout.value);
+  readout_pipeline_submit(&readout);
+  return next_to_read < sensor_count;
+}
+
+/**
+ * @brief Installs the 1-Wire bus and enumerates every DS18B20 on it.
+ *
+ * @return ESP_OK if at least one probe was found, ESP_ERR_NOT_FOUND
+ * otherwise.
+ */
+static esp_err_t ds18b20_init(const SensorDriver *driver) {
   // install 1-wire bus
-  onewire_bus_handle_t bus = NULL;
   onewire_bus_config_t bus_config = {
       .bus_gpio_num = CONFIG_HARDWARE_DS18B20_GPIO_PIN,
       .flags = {
@@ -34,28 +244,58 @@ void sensor_manager_ds18b20(void *pvParameters) {
                               // the external device didn't have one
       }};
   onewire_bus_rmt_config_t rmt_config = {.max_rx_bytes = ONEWIRE_MAX_RX_BYTES};
-  ESP_ERROR_CHECK(onewire_new_bus_rmt(&bus_config, &rmt_config, &bus));
+  esp_err_t ret = onewire_new_bus_rmt(&bus_config, &rmt_config, &bus);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to install the 1-Wire bus on GPIO %d (%s)",
+             CONFIG_HARDWARE_DS18B20_GPIO_PIN, esp_err_to_name(ret));
+    bus = NULL;
+    return ret;
+  }
 
   onewire_device_iter_handle_t iter = NULL;
   onewire_device_t next_onewire_device;
   esp_err_t search_result = ESP_OK;
 
   // create 1-wire device iterator, which is used for device search
-  ESP_ERROR_CHECK(onewire_new_device_iter(bus, &iter));
-  ESP_LOGI(TAG, "Device iterator created, searching for a DS18B20...");
+  ret = onewire_new_device_iter(bus, &iter);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create the device iterator (%s)",
+             esp_err_to_name(ret));
+    onewire_bus_del(bus);
+    bus = NULL;
+    return ret;
+  }
+  ESP_LOGI(TAG, "Device iterator created, searching for DS18B20 probes...");
   do {
     search_result = onewire_device_iter_get_next(iter, &next_onewire_device);
     if (search_result == ESP_OK) {
+      if (sensor_count >= DS18B20_MAX_DEVICES) {
+        ESP_LOGW(TAG,
+                 "Device table full (%d), ignoring OneWire device at "
+                 "address: %016llX",
+                 DS18B20_MAX_DEVICES, next_onewire_device.address);
+        continue;
+      }
       // found a new device, let's check if we
       // can upgrade it to a DS18B20
       ds18b20_config_t ds_cfg = {};
       onewire_device_address_t address;
-      // check if the device is a DS18B20, if so, return the ds18b20 handle
+      DS18B20Sensor *sensor = &sensors[sensor_count];
+      // check if the device is a DS18B20, if so, store the ds18b20 handle in
+      // the next free slot of the device table
       if (ds18b20_new_device_from_enumeration(&next_onewire_device, &ds_cfg,
-                                              &sensor.handle) == ESP_OK) {
-        ds18b20_get_device_address(sensor.handle, &address);
-        sensor.address = address;
-        ESP_LOGI(TAG, "Found a DS18B20 at address: %016llX", address);
+                                              &sensor->handle) == ESP_OK) {
+        ds18b20_get_device_address(sensor->handle, &address);
+        sensor->address = address;
+        // apply the configured resolution right away, the probe might have
+        // a different one stored in its EEPROM
+        sensor->resolution = configured_resolution(address);
+        sensor->requested_resolution = sensor->resolution;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(
+            ds18b20_set_resolution(sensor->handle, sensor->resolution));
+        sensor_count++;
+        ESP_LOGI(TAG, "Found a DS18B20 at address: %016llX (%d bits)", address,
+                 9 + (int)sensor->resolution);
       } else {
         ESP_LOGW(TAG, "Found an unknown OneWire device, address: %016llX",
                  next_onewire_device.address);
@@ -63,37 +303,23 @@ void sensor_manager_ds18b20(void *pvParameters) {
     }
   } while (search_result != ESP_ERR_NOT_FOUND);
 
-  if (sensor.handle == NULL) {
-    ESP_LOGW(TAG, "No DS18B20 found! Suspending sensor_manager_ds18b20 task.");
-    vTaskSuspend(NULL);
-  }
-
-  ESP_ERROR_CHECK(onewire_del_device_iter(iter));
-  ESP_LOGI(TAG, "Searching done, DS18B20 sensor found");
-
-  while (1) {
-    system_wait_for_bits(SYS_BIT_SENSOR_READ_REQUESTED, pdTRUE, portMAX_DELAY);
+  ESP_ERROR_CHECK_WITHOUT_ABORT(onewire_del_device_iter(iter));
 
-    system_wait_for_bits(SYS_BIT_NTP_SYNCED, pdTRUE, portMAX_DELAY);
-    float temperature;
-
-    time_t now;
-    time(&now);
-
-    ESP_ERROR_CHECK(ds18b20_trigger_temperature_conversion_for_all(bus));
-    ESP_ERROR_CHECK(ds18b20_get_temperature(sensor.handle, &temperature));
-
-    const UniversalSingleReadout readout = {.value = temperature,
-                                            .timestamp = now,
-                                            .sensor_type = "ds18b20",
-                                            .unit = "C"};
+  if (sensor_count == 0) {
+    ESP_LOGW(TAG, "No DS18B20 found!");
+    return ESP_ERR_NOT_FOUND;
+  }
 
-    if (readout_queue_send(readout, pdMS_TO_TICKS(100)) != pdPASS) {
-      ESP_LOGW(TAG, "Queue full, dropping readout!");
-    } else {
-      ESP_LOGI(TAG, "READOUT QUEUED -> DS18B20: %.2f", temperature);
-    }
+  ESP_LOGI(TAG, "Searching done, %d DS18B20 sensor(s) found",
+           (int)sensor_count);
+  return ESP_OK;
+}
 
-    system_clear_bits(SYS_BIT_SENSOR_READ_REQUESTED);
-  }
-}
\ No newline at end of file
+const SensorDriver sensor_driver_ds18b20 = {
+    .name = "ds18b20",
+    .descriptor = SENSOR_DESCRIPTOR_DS18B20,
+    .interval_ms = CONFIG_SOFTWARE_DS18B20_READOUT_INTERVAL * 1000,
+    .init = ds18b20_init,
+    .start_sample = ds18b20_start_sample,
+    .collect = ds18b20_collect,
+};
@@ -10,16 +10,47 @@
 #ifndef _SENSOR_MANAGER_H
 #define _SENSOR_MANAGER_H
 #include "ds18b20.h"
+#include "sensor_driver.h"
 #include "time.h"
 
 typedef struct {
   ds18b20_device_handle_t handle;
   uint64_t address;
+  ds18b20_resolution_t resolution;           // currently applied resolution
+  ds18b20_resolution_t requested_resolution; // applied before next conversion
 } DS18B20Sensor;
 
+#define DS18B20_MAX_DEVICES CONFIG_HARDWARE_DS18B20_MAX_DEVICES
+
 #define ONEWIRE_MAX_RX_BYTES                                                   \
   10 // 1byte ROM command + 8byte ROM number + 1byte device command
 
-void sensor_manager_ds18b20(void *pvParameters);
+// the DS18B20 driver, to be registered with the sensor scheduler
+extern const SensorDriver sensor_driver_ds18b20;
+
+/**
+ * @brief Gets the address of the probe behind a readout channel.
+ *
+ * Channels are the slots of the device table, which is filled in bus search
+ * order (so the same probes get the same channels across reboots).
+ *
+ * @param channel The channel stored in the readout.
+ * @return The probe address, or 0 if there is no probe on that channel.
+ */
+uint64_t sensor_manager_ds18b20_get_address(uint8_t channel);
+
+/**
+ * @brief Requests a new resolution for a single probe at runtime.
+ *
+ * The resolution is applied by the scheduler task before the next conversion
+ * starts, so it is safe to call from any task.
+ *
+ * @param address Address of the probe, as logged when it was found.
+ * @param resolution The resolution to switch the probe to.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no probe with that address
+ * has been enumerated.
+ */
+esp_err_t sensor_manager_ds18b20_set_resolution(uint64_t address,
+                                                ds18b20_resolution_t resolution);
 
 #endif //_SENSOR_MANAGER_H
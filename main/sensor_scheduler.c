@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "sensor_scheduler.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+static const char *TAG = "sensor_scheduler";
+
+typedef enum {
+  // collects sort before samples due at the same time, so a driver is free
+  // again by the time its next sample starts
+  SCHEDULER_EVENT_COLLECT = 0,
+  SCHEDULER_EVENT_SAMPLE = 1,
+} SchedulerEventKind;
+
+typedef struct {
+  int64_t deadline; // esp_timer_get_time() microseconds
+  uint8_t driver;   // index into drivers[]
+  uint8_t kind;     // SchedulerEventKind
+} SchedulerEvent;
+
+static const SensorDriver *drivers[CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS];
+static bool sample_running[CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS];
+static size_t driver_count = 0;
+
+// Binary min-heap of pending events, ordered by deadline. Every driver has
+// at most one sample and one collect pending.
+static SchedulerEvent events[2 * CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS];
+static size_t event_count = 0;
+
+static SensorSchedulerStats stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool event_before(const SchedulerEvent *a, const SchedulerEvent *b) {
+  if (a->deadline != b->deadline)
+    return a->deadline < b->deadline;
+  return a->kind < b->kind;
+}
+
+static void event_swap(const size_t a, const size_t b) {
+  const SchedulerEvent tmp = events[a];
+  events[a] = events[b];
+  events[b] = tmp;
+}
+
+static void event_push(const SchedulerEvent event) {
+  size_t i = event_count++;
+  events[i] = event;
+  while (i > 0 && event_before(&events[i], &events[(i - 1) / 2])) {
+    event_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static SchedulerEvent event_pop(void) {
+  const SchedulerEvent top = events[0];
+  events[0] = events[--event_count];
+
+  size_t i = 0;
+  while (1) {
+    const size_t left = 2 * i + 1;
+    const size_t right = left + 1;
+    size_t smallest = i;
+    if (left < event_count && event_before(&events[left], &events[smallest]))
+      smallest = left;
+    if (right < event_count && event_before(&events[right], &events[smallest]))
+      smallest = right;
+    if (smallest == i)
+      break;
+    event_swap(i, smallest);
+    i = smallest;
+  }
+  return top;
+}
+
+esp_err_t sensor_scheduler_register(const SensorDriver *driver) {
+  // run_sample() divides by it
+  assert(driver->interval_ms > 0);
+  if (driver_count >= CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS) {
+    ESP_LOGE(TAG, "Driver table full (%d), can't register %s",
+             CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS, driver->name);
+    return ESP_ERR_NO_MEM;
+  }
+  drivers[driver_count++] = driver;
+  return ESP_OK;
+}
+
+void sensor_scheduler_get_stats(SensorSchedulerStats *out) {
+  portENTER_CRITICAL(&stats_lock);
+  *out = stats;
+  portEXIT_CRITICAL(&stats_lock);
+}
+
+static void record_event(const int64_t lateness_us, const bool started,
+                         const bool skipped) {
+  portENTER_CRITICAL(&stats_lock);
+  stats.events++;
+  stats.total_lateness_us += lateness_us;
+  if (lateness_us > stats.max_lateness_us)
+    stats.max_lateness_us = lateness_us;
+  if (started)
+    stats.samples++;
+  if (skipped)
+    stats.skipped++;
+  portEXIT_CRITICAL(&stats_lock);
+}
+
+// Runs a due sample event and schedules the driver's next one
+static void run_sample(const SchedulerEvent *event, const int64_t now) {
+  const SensorDriver *driver = drivers[event->driver];
+  const int64_t interval = (int64_t)driver->interval_ms * 1000;
+
+  // fixed-rate schedule, but periods that were missed entirely are skipped
+  // instead of being run back to back
+  int64_t next = event->deadline + interval;
+  bool skipped = false;
+  if (next <= now) {
+    next += ((now - next) / interval + 1) * interval;
+    skipped = true;
+  }
+  event_push((SchedulerEvent){.deadline = next,
+                              .driver = event->driver,
+                              .kind = SCHEDULER_EVENT_SAMPLE});
+
+  bool started = false;
+  if (sample_running[event->driver]) {
+    ESP_LOGW(TAG, "%s: previous sample still running, skipping this one",
+             driver->name);
+    skipped = true;
+  } else {
+    uint32_t collect_delay_ms = 0;
+    const esp_err_t ret = driver->start_sample(driver, &collect_delay_ms);
+    if (ret == ESP_OK) {
+      sample_running[event->driver] = true;
+      started = true;
+      // the delay counts from when the measurement was actually started,
+      // which can be a while into start_sample() (e.g. after a DS18B20
+      // resolution change)
+      event_push((SchedulerEvent){
+          .deadline = esp_timer_get_time() + (int64_t)collect_delay_ms * 1000,
+          .driver = event->driver,
+          .kind = SCHEDULER_EVENT_COLLECT});
+    } else {
+      ESP_LOGE(TAG, "%s: failed to start a sample (%s)", driver->name,
+               esp_err_to_name(ret));
+    }
+  }
+
+  record_event(now - event->deadline, started, skipped);
+}
+
+static void run_collect(const SchedulerEvent *event, const int64_t now) {
+  const SensorDriver *driver = drivers[event->driver];
+  if (driver->collect(driver)) {
+    // more to read, after whatever else is due by now
+    event_push((SchedulerEvent){.deadline = esp_timer_get_time(),
+                                .driver = event->driver,
+                                .kind = SCHEDULER_EVENT_COLLECT});
+  } else {
+    sample_running[event->driver] = false;
+  }
+  record_event(now - event->deadline, false, false);
+}
+
+void sensor_scheduler(void *pvParameters) {
+  ESP_LOGI(TAG, "%s task started", TAG);
+
+  // initialize every driver and spread their first samples over their
+  // interval, so drivers with the same interval don't all fire at once
+  size_t scheduled = 0;
+  for (size_t i = 0; i < driver_count; i++) {
+    const esp_err_t ret = drivers[i]->init(drivers[i]);
+    if (ret != ESP_OK) {
+      ESP_LOGW(TAG, "%s: init failed (%s), not scheduling it", drivers[i]->name,
+               esp_err_to_name(ret));
+      continue;
+    }
+    const int64_t offset =
+        (int64_t)drivers[i]->interval_ms * 1000 * (int64_t)i /
+        (int64_t)driver_count;
+    event_push((SchedulerEvent){.deadline = offset,
+                                .driver = (uint8_t)i,
+                                .kind = SCHEDULER_EVENT_SAMPLE});
+    scheduled++;
+  }
+  // counted from when every driver is up, as init can take a while (a 1-Wire
+  // search, for one). Moving them all by the same amount keeps the heap.
+  const int64_t start = esp_timer_get_time();
+  for (size_t i = 0; i < event_count; i++)
+    events[i].deadline += start;
+
+  if (scheduled == 0) {
+    ESP_LOGW(TAG, "No sensor to schedule! Suspending the %s task.", TAG);
+    vTaskSuspend(NULL);
+  }
+  ESP_LOGI(TAG, "Scheduling %d sensor driver(s)", (int)scheduled);
+
+  // ReSharper disable once CppDFAEndlessLoop
+  while (1) {
+    const int64_t now = esp_timer_get_time();
+    const int64_t wait = events[0].deadline - now;
+    if (wait > 0) {
+      // round up, waking a tick late is better than spinning a tick early
+      const int64_t tick_us = (int64_t)portTICK_PERIOD_MS * 1000;
+      vTaskDelay((TickType_t)((wait + tick_us - 1) / tick_us));
+      continue;
+    }
+
+    const SchedulerEvent event = event_pop();
+    if (event.kind == SCHEDULER_EVENT_SAMPLE) {
+      run_sample(&event, now);
+    } else {
+      run_collect(&event, now);
+    }
+  }
+}
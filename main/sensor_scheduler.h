@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _SENSOR_SCHEDULER_H
+#define _SENSOR_SCHEDULER_H
+
+#include "esp_err.h"
+#include "sensor_driver.h"
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t samples; // samples started
+  uint32_t skipped; // samples skipped (sample still running or the
+                    // deadline already missed)
+  int64_t max_lateness_us;   // worst delay of an event past its deadline
+  int64_t total_lateness_us; // sum of the delays of every event
+  uint32_t events;           // events run (samples started + collects)
+} SensorSchedulerStats;
+
+/**
+ * @brief Adds a sensor driver to the schedule.
+ *
+ * Must be called before the sensor_scheduler task is started. The driver
+ * struct must stay valid for the lifetime of the firmware, and its interval
+ * must not be 0.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the driver table
+ * (CONFIG_SENSOR_SCHEDULER_MAX_DRIVERS) is full.
+ */
+esp_err_t sensor_scheduler_register(const SensorDriver *driver);
+
+/**
+ * @brief The sensor scheduler task.
+ *
+ * Initializes every registered driver and then runs all of them from a
+ * single deadline-ordered event queue, so adding a sensor doesn't cost a new
+ * task and stack.
+ */
+void sensor_scheduler(void *pvParameters);
+
+// Gets the scheduling statistics, safe to call from any task
+void sensor_scheduler_get_stats(SensorSchedulerStats *stats);
+
+#endif //_SENSOR_SCHEDULER_H
@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#include "sim_link.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "mqtt_manager.h"
+#include "outbox_pool.h"
+#include "publish_window.h"
+#include "readout_log.h"
+#include "system_state.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static const char *TAG = "sim_link";
+
+// a scenario time in seconds, compressed by CONFIG_SIM_TIME_SCALE, in ticks
+#define SIM_TICKS(seconds)                                                     \
+  pdMS_TO_TICKS((seconds) * 1000UL / CONFIG_SIM_TIME_SCALE)
+
+// how long the readouts logged during the last outage get to drain once the
+// scenario is over
+#define SETTLE_TIME_MS                                                         \
+  ((CONFIG_SIM_LINK_DOWN_TIME * 3000UL / CONFIG_SIM_TIME_SCALE) + 30000UL)
+
+// The heap over the scenario, sampled every time the link goes down and at
+// the end. A leak shows as free memory creeping down from one outage to the
+// next, fragmentation as the largest block shrinking faster than that.
+typedef struct {
+  unsigned samples;
+  size_t first_free;
+  size_t last_free;
+  size_t lowest_free;
+  size_t lowest_largest_block;
+  unsigned worst_fragmentation; // percent of the free heap not in one piece
+} HeapTrend;
+
+static HeapTrend heap_trend;
+
+static void sample_heap(void) {
+  const size_t free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  const size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+  const unsigned fragmentation =
+      free == 0 ? 0 : (unsigned)(100 - largest * 100 / free);
+
+  if (heap_trend.samples++ == 0) {
+    heap_trend.first_free = free;
+    heap_trend.lowest_free = free;
+    heap_trend.lowest_largest_block = largest;
+  }
+  heap_trend.last_free = free;
+  if (free < heap_trend.lowest_free)
+    heap_trend.lowest_free = free;
+  if (largest < heap_trend.lowest_largest_block)
+    heap_trend.lowest_largest_block = largest;
+  if (fragmentation > heap_trend.worst_fragmentation)
+    heap_trend.worst_fragmentation = fragmentation;
+}
+
+// Logs how the heap fared over the scenario
+static void log_heap_trend(void) {
+  ESP_LOGI(TAG,
+           "Heap over %u samples: %u bytes free at the start, %u at the end "
+           "(%+d), %u lowest; largest block %u lowest, %u%% fragmented at "
+           "worst",
+           heap_trend.samples, (unsigned)heap_trend.first_free,
+           (unsigned)heap_trend.last_free,
+           (int)heap_trend.last_free - (int)heap_trend.first_free,
+           (unsigned)heap_trend.lowest_free,
+           (unsigned)heap_trend.lowest_largest_block,
+           heap_trend.worst_fragmentation);
+}
+
+// Logs the metrics collected over the scenario as a single line
+static void log_report(void) {
+  static char report[CONFIG_MQTT_PAYLOAD_BUFFER_SIZE];
+  JsonWriter writer;
+  json_writer_init(&writer, report, sizeof(report));
+  if (!metrics_write_json(&writer) || !json_writer_finish(&writer)) {
+    ESP_LOGE(TAG, "Scenario report does not fit its buffer");
+    return;
+  }
+  ESP_LOGI(TAG, "Scenario report: %s", report);
+}
+
+#if CONFIG_SIM_BENCHMARK
+// Logs the rate readouts were published at over the scenario, one message
+// each without batching, and the most outbox memory they held at once
+static void log_benchmark(const uint32_t published, const TickType_t elapsed) {
+  const double seconds = (double)pdTICKS_TO_MS(elapsed) / 1000.0;
+  const double rate = seconds > 0 ? published / seconds : 0;
+#if CONFIG_MQTT_CUSTOM_OUTBOX
+  OutboxPoolStats outbox;
+  outbox_pool_get_stats(&outbox);
+  ESP_LOGI(TAG,
+           "Benchmark: QoS %d, %.0f msgs/s, outbox peak %u of %d slots "
+           "(%u of %u bytes), %u heap copies",
+           CONFIG_SENSOR_MOCK_MQTT_QOS, rate, (unsigned)outbox.peak,
+           OUTBOX_POOL_SLOTS, (unsigned)(outbox.peak * OUTBOX_POOL_SLOT_SIZE),
+           (unsigned)(OUTBOX_POOL_SLOTS * OUTBOX_POOL_SLOT_SIZE),
+           (unsigned)outbox.heap_copies);
+#else
+  ESP_LOGI(TAG, "Benchmark: QoS %d, %.0f msgs/s", CONFIG_SENSOR_MOCK_MQTT_QOS,
+           rate);
+#endif
+}
+#endif
+
+// Waits for the link to be back up and for the readout log to be drained.
+// Returns false if that takes longer than SETTLE_TIME_MS.
+static bool settle(void) {
+  const TickType_t start = xTaskGetTickCount();
+  while (xTaskGetTickCount() - start < pdMS_TO_TICKS(SETTLE_TIME_MS)) {
+    if ((system_get_bits() & SYS_BIT_MQTT_CONNECTED) &&
+        readout_log_pending() == 0)
+      return true;
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+  return false;
+}
+
+// Checks one of the scenario's expectations, logging the outcome either way
+static bool expect(const bool passed, const char *expectation,
+                   const unsigned value) {
+  if (passed) {
+    ESP_LOGI(TAG, "PASS: %s (%u)", expectation, value);
+  } else {
+    ESP_LOGE(TAG, "FAIL: %s (%u)", expectation, value);
+  }
+  return passed;
+}
+
+// Checks what the firmware has to get right over the scenario: every readout
+// survives the outages, and the link recovers from each of them. Returns
+// whether everything held.
+static bool check_scenario(const unsigned outages, const bool settled) {
+  MetricsSnapshot snapshot;
+  ReadoutQueueStats queue;
+  PublishWindowStats window;
+  metrics_snapshot(&snapshot);
+  // whatever was taken off the queue by now should have made it out a moment
+  // later, the sensors keep sampling meanwhile
+  const uint32_t received = snapshot.counters[METRIC_READOUTS_RECEIVED];
+  vTaskDelay(pdMS_TO_TICKS(1000));
+  metrics_snapshot(&snapshot);
+  readout_queue_get_stats(&queue);
+  publish_window_get_stats(&window);
+
+  bool passed = true;
+#if CONFIG_SIM_BENCHMARK
+  // the sensors are meant to outpace publishing here
+  ESP_LOGI(TAG, "Readouts dropped by the queue: %u", (unsigned)queue.dropped);
+#else
+  passed &= expect(queue.dropped == 0, "no readout dropped by the queue",
+                   queue.dropped);
+#endif
+  passed &= expect(settled, "readout log drained after the last outage",
+                   readout_log_pending());
+  passed &= expect(snapshot.counters[METRIC_MQTT_CONNECTS] > outages,
+                   "reconnected after every outage",
+                   snapshot.counters[METRIC_MQTT_CONNECTS]);
+  passed &= expect(snapshot.counters[METRIC_READOUTS_PUBLISHED] >= received,
+                   "every readout taken off the queue published",
+                   snapshot.counters[METRIC_READOUTS_PUBLISHED]);
+#if !CONFIG_SENSOR_MOCK_ENABLE || CONFIG_SENSOR_MOCK_MQTT_QOS > 0
+  // QoS 0 messages bypass the window, so there is nothing it could count
+  // then (the outbox check below covers that case)
+  passed &= expect(window.acked > 0, "messages acknowledged by the broker",
+                   window.acked);
+#endif
+#if CONFIG_MQTT_CUSTOM_OUTBOX
+  OutboxPoolStats outbox;
+  outbox_pool_get_stats(&outbox);
+  passed &= expect(outbox.heap_copies == 0,
+                   "every outbox message kept in the pool", outbox.heap_copies);
+#if CONFIG_SENSOR_MOCK_ENABLE && CONFIG_SENSOR_MOCK_MQTT_QOS == 0
+  // the birth message (QoS 1) takes a slot on every connection
+  passed &= expect(outbox.peak <= 1, "no QoS 0 message kept in the outbox",
+                   outbox.peak);
+#endif
+#endif
+  return passed;
+}
+
+void sim_link(void *pvParameters) {
+  const TickType_t duration = SIM_TICKS(CONFIG_SIM_SCENARIO_DURATION);
+  if (CONFIG_SIM_LINK_UP_TIME == 0 && duration == 0) {
+    // nothing to script
+    vTaskDelete(NULL);
+    return;
+  }
+
+  system_wait_for_bits(SYS_BIT_MQTT_CONNECTED, pdTRUE, portMAX_DELAY);
+  ESP_LOGI(TAG, "Scenario started: link up %ds, down %ds, runs for %ds, %dx "
+                "compressed",
+           CONFIG_SIM_LINK_UP_TIME, CONFIG_SIM_LINK_DOWN_TIME,
+           CONFIG_SIM_SCENARIO_DURATION, CONFIG_SIM_TIME_SCALE);
+  sample_heap();
+
+  const TickType_t start = xTaskGetTickCount();
+#if CONFIG_SIM_BENCHMARK
+  MetricsSnapshot snapshot;
+  metrics_snapshot(&snapshot);
+  const uint32_t published_at_start =
+      snapshot.counters[METRIC_READOUTS_PUBLISHED];
+#endif
+  bool link_up = true;
+  unsigned outages = 0;
+  // ReSharper disable once CppDFAEndlessLoop
+  while (1) {
+    TickType_t wait =
+        CONFIG_SIM_LINK_UP_TIME == 0
+            ? duration
+            : SIM_TICKS(link_up ? CONFIG_SIM_LINK_UP_TIME
+                                : CONFIG_SIM_LINK_DOWN_TIME);
+    if (duration > 0) {
+      const TickType_t elapsed = xTaskGetTickCount() - start;
+      if (elapsed >= duration)
+        break;
+      if (wait > duration - elapsed)
+        wait = duration - elapsed;
+    }
+    vTaskDelay(wait);
+    if (duration > 0 && xTaskGetTickCount() - start >= duration)
+      break;
+
+    link_up = !link_up;
+    if (!link_up)
+      sample_heap(); // after every stretch of the same load
+    mqtt_manager_set_link(link_up);
+    if (!link_up)
+      outages++;
+  }
+
+  if (!link_up) {
+    mqtt_manager_set_link(true);
+  }
+#if CONFIG_SIM_BENCHMARK
+  metrics_snapshot(&snapshot);
+  log_benchmark(snapshot.counters[METRIC_READOUTS_PUBLISHED] -
+                    published_at_start,
+                xTaskGetTickCount() - start);
+#endif
+  const bool settled = settle();
+  sample_heap();
+  log_report();
+  log_heap_trend();
+  const bool passed = check_scenario(outages, settled);
+  ESP_LOGI(TAG, "Scenario %s", passed ? "passed" : "failed");
+  exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (C) 2025 Stratos Thivaios
+//
+// EDLAVP-ESP-FW - The ESP-IDF Version of the EDLAVP firmware
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+
+#ifndef _SIM_LINK_H
+#define _SIM_LINK_H
+
+// Scripted broker link for load tests on the linux target, where the
+// firmware runs against a broker on the host (e.g. a local mosquitto, see
+// sdkconfig.defaults.linux) with mock sensors standing in for the probes.
+//
+// Once the first connection is up, the link is taken down every
+// CONFIG_SIM_LINK_UP_TIME seconds for CONFIG_SIM_LINK_DOWN_TIME seconds.
+// After CONFIG_SIM_SCENARIO_DURATION seconds the link is brought back up and
+// the readout log gets some time to drain. The metrics (throughput, drops and
+// latencies, see metrics.h) are then logged as a single "Scenario report"
+// line, followed by a PASS or FAIL line for every expectation of the
+// scenario: no readout dropped, the log drained, a reconnection after every
+// outage, every readout published, and (with CONFIG_MQTT_CUSTOM_OUTBOX) no
+// outbox message copied to the heap. The process exits with EXIT_FAILURE if
+// any of them failed, so CI can run it as a test. The heap is sampled at
+// every outage, and a "Heap over" line gives the free memory at the start,
+// the end and its lowest, and the largest free block and fragmentation at
+// their worst. With CONFIG_SIM_TIME_SCALE all of the scenario's times, the
+// mock sensors' included, are compressed: sdkconfig.soak runs a week of
+// outages in two hours.
+//
+// With CONFIG_SIM_BENCHMARK (sdkconfig.bench) the link stays up and the mock
+// sensors offer more readouts than the broker round trips may let through.
+// A "Benchmark" line then gives the messages published per second at the
+// mock sensors' QoS level and the most outbox memory they held at once.
+
+// Task function running the scenario
+void sim_link(void *pvParameters);
+
+#endif //_SIM_LINK_H
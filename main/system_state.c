@@ -10,61 +10,280 @@
 #include "system_state.h"
 #include "esp_log.h"
 #include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "readout_aggregate.h"
 #include "types.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
 static const char *TAG = "SYSTEM_STATE";
 static EventGroupHandle_t s_event_group = NULL;
 
-static QueueHandle_t readout_queue;
+// The readout queue is a single-producer/single-consumer ring of readout
+// records: only the sensor task sends and only the mqtt task receives. Each
+// side owns one index and only reads the other one, so with the drop-newest
+// overflow policy no critical section is needed at all. One slot is always
+// left empty to tell a full ring from an empty one. A readout with a summary
+// takes up two records (see ReadoutSummary), which are always added and
+// taken together.
+//
+// The other overflow policies make the producer take readouts away from the
+// consumer's end when the ring is full, and coalescing may move queued
+// records by one. Those paths, and only those, are serialized with
+// ring_lock, so the consumer never copies a slot that is being rewritten.
+// The producer still never blocks.
+#define READOUT_RING_SLOTS (CONFIG_READOUT_QUEUE_SIZE + 1)
+
+static UniversalSingleReadout readout_ring[READOUT_RING_SLOTS];
+static atomic_uint ring_head = 0; // next slot to write, owned by the producer
+static atomic_uint ring_tail = 0; // next slot to read, owned by the consumer
+
+#if CONFIG_READOUT_QUEUE_OVERFLOW_DROP_NEWEST
+#define ring_enter_critical()
+#define ring_exit_critical()
+#else
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+#define ring_enter_critical() portENTER_CRITICAL(&ring_lock)
+#define ring_exit_critical() portEXIT_CRITICAL(&ring_lock)
+#endif
+
+static atomic_uint readouts_dropped = 0;
+static atomic_uint readouts_coalesced = 0;
+
+// When the consumer has to block it publishes its task handle and raises the
+// waiting flag, the producer then wakes it with a task notification right
+// after it adds a readout.
+static TaskHandle_t consumer_task = NULL;
+static atomic_bool consumer_waiting = false;
+
+static unsigned ring_next(const unsigned index) {
+  return index + 1 == READOUT_RING_SLOTS ? 0 : index + 1;
+}
+
+static unsigned ring_advance(const unsigned index, const size_t records) {
+  return (unsigned)((index + records) % READOUT_RING_SLOTS);
+}
+
+static size_t ring_free(const unsigned head, const unsigned tail) {
+  return (tail + READOUT_RING_SLOTS - head - 1) % READOUT_RING_SLOTS;
+}
+
+static bool ring_has_data(void) {
+  return atomic_load_explicit(&ring_head, memory_order_acquire) !=
+         atomic_load_explicit(&ring_tail, memory_order_relaxed);
+}
+
+// Blocks the consumer until the ring has data or @p ticks_to_wait runs out.
+// The waiting flag is raised before the ring is checked again, so a readout
+// added in between is either seen here or followed by a notification.
+static bool wait_for_data(TickType_t ticks_to_wait) {
+  if (ring_has_data())
+    return true;
+  if (ticks_to_wait == 0)
+    return false;
+
+  TimeOut_t timeout;
+  vTaskSetTimeOutState(&timeout);
+  consumer_task = xTaskGetCurrentTaskHandle();
+
+  while (1) {
+    atomic_store(&consumer_waiting, true);
+    if (ring_has_data() ||
+        xTaskCheckForTimeOut(&timeout, &ticks_to_wait) == pdTRUE) {
+      atomic_store(&consumer_waiting, false);
+      return ring_has_data();
+    }
+    ulTaskNotifyTake(pdTRUE, ticks_to_wait);
+    // a notification can also be left over from an earlier wait, so this
+    // only means "check again"
+    atomic_store(&consumer_waiting, false);
+  }
+}
+
+#if !CONFIG_READOUT_QUEUE_OVERFLOW_DROP_NEWEST
+#if CONFIG_READOUT_QUEUE_OVERFLOW_COALESCE
+static unsigned ring_prev(const unsigned index) {
+  return index == 0 ? READOUT_RING_SLOTS - 1 : index - 1;
+}
+
+// The summary of the readout at @p index, whose summary record may have
+// wrapped around to the start of the ring
+static ReadoutSummary ring_summary(const unsigned index) {
+  if ((readout_ring[index].flags & READOUT_FLAG_SUMMARY) == 0)
+    return readout_get_summary(&readout_ring[index]);
+  ReadoutSummary summary;
+  memcpy(&summary, &readout_ring[ring_next(index)], sizeof(summary));
+  return summary;
+}
+#endif
+
+// Takes the oldest readout off the ring, according to the overflow policy.
+// Must be called by the producer, with ring_lock held.
+static void ring_remove_oldest(const unsigned head) {
+  const unsigned tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+  const unsigned after_oldest =
+      ring_advance(tail, readout_records(&readout_ring[tail]));
+
+#if CONFIG_READOUT_QUEUE_OVERFLOW_COALESCE
+  // fold the oldest readout into the next one from the same sensor, so the
+  // oldest data loses resolution instead of disappearing
+  const UniversalSingleReadout *oldest = &readout_ring[tail];
+  const ReadoutSummary oldest_summary = ring_summary(tail);
+  for (unsigned i = after_oldest; i != head;
+       i = ring_advance(i, readout_records(&readout_ring[i]))) {
+    UniversalSingleReadout *into = &readout_ring[i];
+    if (into->descriptor != oldest->descriptor ||
+        into->channel != oldest->channel)
+      continue;
+
+    const bool had_summary = into->flags & READOUT_FLAG_SUMMARY;
+    ReadoutSummary summary = ring_summary(i);
+    readout_aggregate_merge(into, &summary, oldest, &oldest_summary);
+
+    unsigned new_tail = after_oldest;
+    unsigned summary_slot = ring_next(i);
+    if (!had_summary) {
+      // the aggregate needs a record for its summary now: move everything
+      // from the end of the oldest readout up to it back by one, into the
+      // room the oldest readout leaves
+      for (unsigned j = after_oldest; j != summary_slot; j = ring_next(j)) {
+        readout_ring[ring_prev(j)] = readout_ring[j];
+      }
+      summary_slot = i;
+      new_tail = ring_prev(after_oldest);
+    }
+    memcpy(&readout_ring[summary_slot], &summary, sizeof(summary));
+    atomic_store_explicit(&ring_tail, new_tail, memory_order_release);
+    atomic_fetch_add(&readouts_coalesced, 1);
+    return;
+  }
+  // nothing to fold it into, fall through and drop it
+#endif
+
+  atomic_store_explicit(&ring_tail, after_oldest, memory_order_release);
+  atomic_fetch_add(&readouts_dropped, 1);
+}
+
+// Takes readouts off a full ring until @p records fit. Must be called by the
+// producer, with ring_lock held.
+static void ring_make_room(const unsigned head, const size_t records) {
+  // coalescing two single samples frees no record, but every round leaves
+  // one readout less, so this ends at the latest with the ring empty
+  while (ring_free(head, atomic_load_explicit(&ring_tail,
+                                              memory_order_relaxed)) <
+         records) {
+    ring_remove_oldest(head);
+  }
+}
+#endif
 
 /**
  * @brief Initializes the sensor readout queue.
  *
- * Creates a FreeRTOS queue that holds floating-point sensor readings.
- * Must be called before any send/receive operations.
+ * The ring is statically allocated, this only resets it. Must be called
+ * before any send/receive operations.
  */
 void readout_queue_init(void) {
-  readout_queue =
-      xQueueCreate(CONFIG_READOUT_QUEUE_SIZE, sizeof(UniversalSingleReadout));
-  if (readout_queue == NULL) {
-    ESP_LOGE(TAG, "FATAL: Queue creation failed!");
-    abort();
-  }
+  atomic_store(&ring_head, 0);
+  atomic_store(&ring_tail, 0);
+  ESP_LOGI(TAG, "Readout queue ready (%d records)", CONFIG_READOUT_QUEUE_SIZE);
 }
 
 /**
  * @brief Sends a sensor reading to the readout queue.
  *
- * If the queue is full, the function blocks for up to @p ticks_to_wait
- * before returning. Use 0 for a non-blocking send.
+ * Never blocks. If the queue is full, the configured overflow policy decides
+ * what is lost: the readout being sent (drop-newest), or the oldest queued
+ * ones, which are either dropped (drop-oldest) or folded into a newer readout
+ * of the same sensor (coalesce). Must only be called from a single task.
  *
- * @param readout Struct of the readout to enqueue.
- * @param ticks_to_wait Maximum number of ticks to wait if the queue is full.
- * @return pdPASS if the value was successfully enqueued, pdFAIL otherwise.
+ * @param readout The readout to enqueue, followed by its summary record if
+ * it has one (see ReadoutSummary).
+ * @return pdPASS if the readout was enqueued, pdFAIL if it was dropped.
  */
-BaseType_t readout_queue_send(const UniversalSingleReadout readout,
-                              const TickType_t ticks_to_wait) {
-  if (readout_queue == NULL)
+BaseType_t readout_queue_send(const UniversalSingleReadout *readout) {
+  const size_t records = readout_records(readout);
+  const unsigned head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+  if (ring_free(head, atomic_load_explicit(&ring_tail, memory_order_acquire)) <
+      records) {
+#if CONFIG_READOUT_QUEUE_OVERFLOW_DROP_NEWEST
+    atomic_fetch_add(&readouts_dropped, 1);
     return pdFAIL;
-  return xQueueSend(readout_queue, &readout, ticks_to_wait);
+#else
+    ring_enter_critical();
+    ring_make_room(head, records);
+    ring_exit_critical();
+#endif
+  }
+
+  // the slots from head on are never read by the consumer, so they can be
+  // written outside of the critical section
+  readout_ring[head] = readout[0];
+  if (records == 2)
+    readout_ring[ring_next(head)] = readout[1];
+  atomic_store_explicit(&ring_head, ring_advance(head, records),
+                        memory_order_release);
+  metrics_count(METRIC_READOUTS_QUEUED);
+
+  if (atomic_exchange(&consumer_waiting, false)) {
+    xTaskNotifyGive(consumer_task);
+  }
+  return pdPASS;
 }
 
 /**
- * @brief Receives a sensor reading from the readout queue.
+ * @brief Receives queued sensor readings, up to @p max_records records, in
+ * one call.
  *
- * If the queue is empty, the function blocks for up to @p ticks_to_wait
- * before returning. Use 0 for a non-blocking receive.
+ * A readout with a summary comes with its summary record right behind it
+ * (see ReadoutSummary), the two are never split, so @p max_records must be
+ * at least 2. If the queue is empty, the function blocks for up to
+ * @p ticks_to_wait until the first readout arrives, and then returns
+ * whatever is queued at that point without waiting for more. Use 0 for a
+ * non-blocking receive. Must only be called from a single task.
  *
- * @param readout Pointer to a variable to store the received struct of
- * the readout.
+ * @param records Array to store the received records in.
+ * @param max_records Capacity of @p records.
  * @param ticks_to_wait Maximum number of ticks to wait if the queue is empty.
- * @return pdPASS if a value was successfully received, pdFAIL otherwise.
+ * @return The number of records received, 0 if none arrived in time.
  */
-BaseType_t readout_queue_receive(UniversalSingleReadout *readout,
-                                 const TickType_t ticks_to_wait) {
-  if (readout_queue == NULL || readout == NULL)
-    return pdFAIL;
-  return xQueueReceive(readout_queue, readout, ticks_to_wait);
+size_t readout_queue_receive_batch(UniversalSingleReadout *records,
+                                   const size_t max_records,
+                                   const TickType_t ticks_to_wait) {
+  if (records == NULL || max_records == 0 || !wait_for_data(ticks_to_wait))
+    return 0;
+
+  ring_enter_critical();
+  const unsigned head = atomic_load_explicit(&ring_head, memory_order_acquire);
+  unsigned tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+  size_t count = 0;
+  uint32_t readouts = 0;
+  while (tail != head) {
+    const size_t readout_length = readout_records(&readout_ring[tail]);
+    if (count + readout_length > max_records)
+      break;
+    records[count++] = readout_ring[tail];
+    if (readout_length == 2)
+      records[count++] = readout_ring[ring_next(tail)];
+    tail = ring_advance(tail, readout_length);
+    readouts++;
+  }
+  atomic_store_explicit(&ring_tail, tail, memory_order_release);
+  ring_exit_critical();
+
+  metrics_add(METRIC_READOUTS_RECEIVED, readouts);
+  return count;
+}
+
+void readout_queue_get_stats(ReadoutQueueStats *stats) {
+  stats->dropped = atomic_load(&readouts_dropped);
+  stats->coalesced = atomic_load(&readouts_coalesced);
+  const unsigned head = atomic_load(&ring_head);
+  const unsigned tail = atomic_load(&ring_tail);
+  stats->depth = (head + READOUT_RING_SLOTS - tail) % READOUT_RING_SLOTS;
 }
 
 void system_state_init(void) {
@@ -86,6 +305,12 @@ void system_clear_bits(const EventBits_t bits) {
   }
 }
 
+EventBits_t system_get_bits(void) {
+  if (!s_event_group)
+    return 0;
+  return xEventGroupGetBits(s_event_group);
+}
+
 EventBits_t system_wait_for_bits(const EventBits_t bits,
                                  const BaseType_t wait_for_all,
                                  const TickType_t ticks_to_wait) {
@@ -10,16 +10,23 @@
 #ifndef _SYSTEM_STATE_H
 #define _SYSTEM_STATE_H
 
-#include "ds18b20.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "types.h"
 
 #define SYS_BIT_WIFI_CONNECTED (1 << 0)
 #define SYS_BIT_GOT_IP (1 << 1)
-#define SYS_BIT_NTP_SYNCED (1 << 2)
+// set once the clock has been synced at least once (or restored after a warm
+// reset), and never cleared again: between syncs the clock keeps running on
+// its own
+#define SYS_BIT_TIME_VALID (1 << 2)
 #define SYS_BIT_MQTT_CONNECTED (1 << 3)
-#define SYS_BIT_SENSOR_READ_REQUESTED (1 << 4)
+// a time sync is due and hasn't landed yet
+#define SYS_BIT_NTP_SYNCING (1 << 4)
+// a due time sync didn't land within CONFIG_TIMESYNC_TIMEOUT (or the clock
+// was restored after a reset with too large an error), the clock is running
+// unsynced since
+#define SYS_BIT_NTP_STALE (1 << 5)
 
 // should be called early in app_main()
 void system_state_init(void);
@@ -28,15 +35,23 @@ void system_state_init(void);
 
 void system_set_bits(EventBits_t bits);
 void system_clear_bits(EventBits_t bits);
+EventBits_t system_get_bits(void);
 EventBits_t system_wait_for_bits(EventBits_t bits, BaseType_t wait_for_all,
                                  TickType_t ticks_to_wait);
 
-// sensor readout queue wrappers
+// sensor readout queue (single producer, single consumer)
+
+typedef struct {
+  uint32_t dropped;   // readouts lost to a full queue
+  uint32_t coalesced; // readouts folded into a newer one of the same sensor
+  uint32_t depth;     // records waiting right now, see ReadoutSummary
+} ReadoutQueueStats;
 
 void readout_queue_init(void);
-BaseType_t readout_queue_send(UniversalSingleReadout readout,
-                              TickType_t ticks_to_wait);
-BaseType_t readout_queue_receive(UniversalSingleReadout *readout,
-                                 TickType_t ticks_to_wait);
+BaseType_t readout_queue_send(const UniversalSingleReadout *readout);
+size_t readout_queue_receive_batch(UniversalSingleReadout *records,
+                                   size_t max_records,
+                                   TickType_t ticks_to_wait);
+void readout_queue_get_stats(ReadoutQueueStats *stats);
 
 #endif //_SYSTEM_STATE_H
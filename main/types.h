@@ -11,11 +11,207 @@
 #define _TYPES_H
 #include "time.h"
 
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// readout timestamps are stored as seconds since this point in time
+// (2025-01-01T00:00:00Z), which fits a uint32_t until the year 2161
+#define READOUT_EPOCH_BASE 1735689600LL
+
+// readout timestamps carry a fraction of a second, in
+// 1/READOUT_SUBSECOND_SCALE units (just under 4 ms)
+#define READOUT_SUBSECOND_SCALE 256
+
+// readout values are stored as fixed point, in 1/READOUT_VALUE_SCALE units
+#define READOUT_VALUE_SCALE 10000
+
+// the spread of an aggregate (distance of min and max from the mean, standard
+// deviation) is stored in 1/READOUT_SPREAD_SCALE units, saturating at
+// UINT16_MAX
+#define READOUT_SPREAD_SCALE 1000
+
+// the readout summarizes several samples, see ReadoutSummary
+#define READOUT_FLAG_AGGREGATE (1 << 0)
+// the clock was being resynced when the readout was taken
+#define READOUT_FLAG_CLOCK_SYNCING (1 << 1)
+// the last clock sync before the readout failed, so its timestamp comes from
+// a clock that may have drifted
+#define READOUT_FLAG_CLOCK_STALE (1 << 2)
+// the readout was taken before the clock was first synced, so its timestamp
+// counts from boot (esp_timer) instead of from READOUT_EPOCH_BASE until it is
+// resolved, see readout_pipeline_resolve_time()
+#define READOUT_FLAG_MONOTONIC (1 << 3)
+// the readout is followed by its summary record, see ReadoutSummary
+#define READOUT_FLAG_SUMMARY (1 << 4)
+
+// the descriptor field of a summary record, no sensor has this index
+#define READOUT_SUMMARY_DESCRIPTOR UINT8_MAX
+
+/**
+ * Compact, fixed-size readout record, as it is queued and stored.
+ *
+ * Everything that is constant per sensor (type, unit, topic, hardware
+ * address) is left out and only resolved at serialization time, through the
+ * descriptor table (see sensor_descriptors.h).
+ *
+ * A readout holds a single sample, or (with READOUT_FLAG_AGGREGATE) the mean
+ * of the samples taken from @c timestamp onwards. Anything more than that is
+ * carried in a ReadoutSummary record following it.
+ */
 typedef struct {
-  float value;
-  time_t timestamp;
-  const char *sensor_type;
-  const char *unit;
+  uint32_t timestamp; // seconds since READOUT_EPOCH_BASE (or boot)
+  int32_t value;      // fixed point, see READOUT_VALUE_SCALE
+  uint8_t descriptor; // index into the sensor descriptor table
+  uint8_t channel;    // sensor instance, e.g. the DS18B20 probe slot
+  uint8_t flags;      // READOUT_FLAG_*
+  uint8_t subsecond;  // see READOUT_SUBSECOND_SCALE
 } UniversalSingleReadout;
 
+/**
+ * What a readout that stands for more than its own sample carries on top of
+ * it: the sample count and spread of an aggregate, and the number of
+ * readouts of the same channel the deadband stage suppressed right before it
+ * (see readout_pipeline.h), or before the readouts an aggregate was merged
+ * from. Those are not among its samples, as their values were never kept.
+ *
+ * Wherever readouts are queued, logged or passed around as an array of
+ * records, a readout with READOUT_FLAG_SUMMARY is followed by its summary in
+ * the next record, so single samples only ever take up one. A summary has
+ * the size of a record, with READOUT_SUMMARY_DESCRIPTOR where a readout has
+ * its descriptor, so one that got separated from its readout is recognized.
+ */
+typedef struct {
+  uint16_t samples;    // samples the readout stands for
+  uint16_t below;      // aggregate only: mean - min, see READOUT_SPREAD_SCALE
+  uint16_t above;      // aggregate only: max - mean
+  uint16_t stddev;     // aggregate only: population standard deviation
+  uint8_t descriptor;  // READOUT_SUMMARY_DESCRIPTOR
+  uint8_t reserved;
+  uint16_t suppressed; // readouts suppressed before it, see above
+} ReadoutSummary;
+
+_Static_assert(sizeof(ReadoutSummary) == sizeof(UniversalSingleReadout),
+               "a summary must fill exactly one readout record");
+_Static_assert(offsetof(ReadoutSummary, descriptor) ==
+                   offsetof(UniversalSingleReadout, descriptor),
+               "a summary must be recognizable by its descriptor");
+
+// The point in time a readout was taken, as drivers capture it when a sample
+// starts (see readout_pipeline_now())
+typedef struct {
+  uint32_t timestamp;
+  uint8_t subsecond;
+  uint8_t flags; // 0 or READOUT_FLAG_MONOTONIC
+} ReadoutTime;
+
+#ifdef READOUT_RECORD_SIZE
+// READOUT_RECORD_SIZE comes from main/CMakeLists.txt, which reports how many
+// readouts fit in the configured buffers at build time
+_Static_assert(sizeof(UniversalSingleReadout) == READOUT_RECORD_SIZE,
+               "UniversalSingleReadout size doesn't match the build report");
+#endif
+
+static inline int32_t readout_value_to_fixed(const double value) {
+  return (int32_t)lround(value * READOUT_VALUE_SCALE);
+}
+
+static inline double readout_value_from_fixed(const int32_t value) {
+  return (double)value / READOUT_VALUE_SCALE;
+}
+
+static inline uint16_t readout_spread_to_fixed(const double spread) {
+  const double scaled = round(spread * READOUT_SPREAD_SCALE);
+  if (scaled <= 0)
+    return 0;
+  return scaled >= UINT16_MAX ? UINT16_MAX : (uint16_t)scaled;
+}
+
+static inline double readout_spread_from_fixed(const uint16_t spread) {
+  return (double)spread / READOUT_SPREAD_SCALE;
+}
+
+// The summary of a readout, for a single sample one with just that sample
+static inline ReadoutSummary
+readout_get_summary(const UniversalSingleReadout *readout) {
+  ReadoutSummary summary = {.samples = 1,
+                            .descriptor = READOUT_SUMMARY_DESCRIPTOR};
+  if (readout->flags & READOUT_FLAG_SUMMARY)
+    memcpy(&summary, &readout[1], sizeof(summary));
+  return summary;
+}
+
+// Attaches a summary to the readout at @p records[0], in @p records[1]
+static inline void readout_set_summary(UniversalSingleReadout *records,
+                                       const ReadoutSummary *summary) {
+  ReadoutSummary stored = *summary;
+  stored.descriptor = READOUT_SUMMARY_DESCRIPTOR;
+  records[0].flags |= READOUT_FLAG_SUMMARY;
+  memcpy(&records[1], &stored, sizeof(stored));
+}
+
+// Number of records a readout takes up, along with its summary
+static inline size_t readout_records(const UniversalSingleReadout *readout) {
+  return readout->flags & READOUT_FLAG_SUMMARY ? 2 : 1;
+}
+
+// Whether a record is a summary rather than a readout
+static inline bool readout_is_summary(const UniversalSingleReadout *record) {
+  return record->descriptor == READOUT_SUMMARY_DESCRIPTOR;
+}
+
+// Adds up two readout counts, saturating at what a readout can hold
+static inline uint16_t readout_count_add(const uint32_t a, const uint32_t b) {
+  return a + b >= UINT16_MAX ? UINT16_MAX : (uint16_t)(a + b);
+}
+
+static inline uint32_t readout_timestamp_from_unix(const time_t timestamp) {
+  return (uint32_t)((int64_t)timestamp - READOUT_EPOCH_BASE);
+}
+
+static inline time_t readout_timestamp_to_unix(const uint32_t timestamp) {
+  return (time_t)(READOUT_EPOCH_BASE + timestamp);
+}
+
+// Builds a readout time from microseconds since READOUT_EPOCH_BASE (or boot)
+static inline ReadoutTime readout_time_from_us(const int64_t us,
+                                               const uint8_t flags) {
+  return (ReadoutTime){
+      .timestamp = (uint32_t)(us / 1000000),
+      .subsecond =
+          (uint8_t)((us % 1000000) * READOUT_SUBSECOND_SCALE / 1000000),
+      .flags = flags};
+}
+
+// Microseconds since READOUT_EPOCH_BASE (or boot) of a readout's timestamp
+static inline int64_t readout_time_to_us(const UniversalSingleReadout *readout) {
+  return (int64_t)readout->timestamp * 1000000 +
+         (int64_t)readout->subsecond * 1000000 / READOUT_SUBSECOND_SCALE;
+}
+
+// Milliseconds since the Unix epoch of a (resolved) readout's timestamp
+static inline int64_t
+readout_time_to_unix_ms(const UniversalSingleReadout *readout) {
+  return (READOUT_EPOCH_BASE + readout->timestamp) * 1000 +
+         ((int64_t)readout->subsecond * 1000 + READOUT_SUBSECOND_SCALE / 2) /
+             READOUT_SUBSECOND_SCALE;
+}
+
+static inline void readout_set_time(UniversalSingleReadout *readout,
+                                    const ReadoutTime *time) {
+  readout->timestamp = time->timestamp;
+  readout->subsecond = time->subsecond;
+  readout->flags = (uint8_t)((readout->flags & ~READOUT_FLAG_MONOTONIC) |
+                             time->flags);
+}
+
+// Whether readout a was taken before readout b, both on the same time base
+static inline bool readout_time_before(const UniversalSingleReadout *a,
+                                       const UniversalSingleReadout *b) {
+  return a->timestamp < b->timestamp ||
+         (a->timestamp == b->timestamp && a->subsecond < b->subsecond);
+}
+
 #endif //_TYPES_H